@@ -0,0 +1,24 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <functional>
+
+/// Problem size of a launch of the two-dimensional kernel
+struct Dimensions {
+  int rows;
+  int cols;
+  int blocks;
+  int timesteps;
+};
+
+/// Reads <rows> <cols> <blocks> <timesteps> from the command line arguments
+/// starting at the given index, or takes the default problem size of this
+/// configuration if the arguments end before it, and validates them with
+/// ValidateDimensions and the given checks of the calling mode, which throw
+/// std::invalid_argument. Prints the reason and returns false if the
+/// dimensions are invalid.
+bool ParseDimensions(int argc, char **argv, int first, Dimensions &dimensions,
+                     std::function<void(Dimensions const &)> const &check =
+                         std::function<void(Dimensions const &)>());
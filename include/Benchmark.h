@@ -0,0 +1,75 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Summary statistics of a set of timing samples in seconds.
+struct TimingStatistics {
+  int samples;
+  double min;
+  double median;
+  double p95;
+  double mean;
+  double stddev;
+};
+
+/// Computes the statistics of the given samples, which must not be empty.
+/// Percentiles use the nearest-rank method.
+TimingStatistics Summarize(std::vector<double> samples);
+
+/// Runs the function warmup times without timing it, then times each of the
+/// given number of iterations.
+template <typename Function>
+std::vector<double> TimeRepeated(Function const &function, const int warmup,
+                                 const int iterations) {
+  for (int i = 0; i < warmup; ++i) {
+    function();
+  }
+  std::vector<double> samples;
+  for (int i = 0; i < iterations; ++i) {
+    const auto begin = std::chrono::steady_clock::now();
+    function();
+    const auto end = std::chrono::steady_clock::now();
+    samples.emplace_back(std::chrono::duration<double>(end - begin).count());
+  }
+  return samples;
+}
+
+/// Results of benchmarking a kernel configuration, keyed by the kernel string
+/// that identifies the bitstream.
+struct BenchmarkResult {
+  std::string kernel;
+  int rows;
+  int cols;
+  int blocks;
+  int timesteps;
+  int warmup;
+  int iterations;
+  TimingStatistics execution;
+  TimingStatistics hostToDevice;
+  TimingStatistics deviceToHost;
+  /// Bytes moved between the kernel and device memory per execution
+  double bytesKernel;
+  /// Bytes copied in each direction between host and device
+  double bytesTransfer;
+  /// Floating point operations per execution
+  double operations;
+  /// Execution time predicted by the performance model
+  double predicted;
+};
+
+/// Writes the result as a JSON object with a single member named after the
+/// kernel string.
+void WriteJson(std::ostream &stream, BenchmarkResult const &result);
+
+/// Writes the result as a single CSV line, optionally preceded by a header.
+void WriteCsv(std::ostream &stream, BenchmarkResult const &result,
+              bool header);
+
+/// Prints a human readable summary of the result.
+void PrintSummary(std::ostream &stream, BenchmarkResult const &result);
@@ -0,0 +1,47 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <cstdint>
+
+/// Brain floating point storage type: the upper 16 bits of a single precision
+/// float, i.e., the same exponent range with 8 bits of mantissa. Values are
+/// converted to float for all arithmetic, and rounded to the nearest even
+/// value when stored, so the type only saves memory bandwidth and on-chip
+/// storage, while the accumulation type determines the precision of the
+/// arithmetic.
+class Bfloat16 {
+
+public:
+  Bfloat16() = default;
+
+  Bfloat16(const float value) : bits_(Round(value)) {}
+
+  operator float() const {
+    Bits_t converted;
+    converted.bits = static_cast<uint32_t>(bits_) << 16;
+    return converted.value;
+  }
+
+private:
+  union Bits_t {
+    float value;
+    uint32_t bits;
+  };
+
+  static uint16_t Round(const float value) {
+    Bits_t converted;
+    converted.value = value;
+    const uint32_t bits = converted.bits;
+    // Keep NaNs quiet instead of rounding them to infinity
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+      return static_cast<uint16_t>((bits >> 16) | 0x0040u);
+    }
+    // Round to nearest, ties to even
+    const uint32_t bias = 0x7FFFu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>((bits + bias) >> 16);
+  }
+
+  uint16_t bits_;
+};
@@ -4,170 +4,354 @@
 #pragma once
 
 #include "Stencil.h"
-#include "hlslib/xilinx/Stream.h"
+#include "SpscStream.h"
 #include "hlslib/xilinx/Utility.h"
 #ifndef STENCIL_SYNTHESIS
-#include <thread>
+#include "Dataflow.h"
 #endif
 
+/// Computes one timestep. The last stage additionally reduces the difference
+/// between its output and its input into the residual of every folded pass.
+/// The residual stream is passed through all stages, but only accessed by the
+/// last one.
+///
+/// Rows and columns beyond Dirichlet edges are part of the stream and keep
+/// their value, those beyond periodic edges are computed like the halos
+/// between blocks, and those beyond Neumann edges are mirrored from the
+/// window.
+///
+/// The grids of a batch are streamed back to back within every pass, such
+/// that the pipeline is only filled and drained once for the whole batch.
+///
+/// If the timesteps are not a multiple of the depth, the leading stages pass
+/// their input through in the last pass. Their halos are then computed by the
+/// following stages, which are wider than needed for the remaining timesteps,
+/// and the last stage still computes the residual of the last timestep.
+///
+/// With counters enabled, reports the iterations in which the input was empty
+/// or the output full as stalled.
 template <int stage>
-void Compute(hlslib::Stream<Kernel_t> &pipeIn,
-             hlslib::Stream<Kernel_t> &pipeOut) {
+void Compute(Stream_t<Kernel_t> &pipeIn,
+             Stream_t<Kernel_t> &pipeOut,
+             Stream_t<Residual_t> &residualOut,
+             STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+             const int boundaryModes, const int grids, const int rows,
+             const int cols, const int blocks, const int timesteps) {
 
-  static constexpr int kInputWidth =
-      kBlockWidthKernel + 2 * hlslib::CeilDivide(kDepth - stage, kKernelWidth);
+  static constexpr int kLineBuffers = Stencil_t::kLineBuffers;
+
+  // Number of rows in the neighborhood of a cell
+  static constexpr int kWindowRows = kLineBuffers + 1;
 
   // Size of the halo in either side
-  static constexpr int kBoundaryWidth = (kInputWidth - kBlockWidthKernel) / 2;
+  static constexpr int kBoundaryWidth =
+      hlslib::CeilDivide(kRadius * (kDepth - stage), kKernelWidth);
+
+  // Maximum width of a block including halos, used to size the line buffers
+  static constexpr int kInputWidthMax = kBlockWidthKernelMax + 2 * kBoundaryWidth;
+
+  const int timeFolded = TimeFolded(timesteps);
+  const bool bypassLast = stage < BypassStages(timesteps);
+  const int inputWidth = BlockWidthKernel(cols, blocks) + 2 * kBoundaryWidth;
+
+  const int modeTop = BoundaryMode(boundaryModes, kEdgeTop);
+  const int modeBottom = BoundaryMode(boundaryModes, kEdgeBottom);
+  const int modeLeft = BoundaryMode(boundaryModes, kEdgeLeft);
+  const int modeRight = BoundaryMode(boundaryModes, kEdgeRight);
+
+  // Rows streamed per block, and the range of them passed on to the next stage
+  const int rowsTop = BoundaryRows(modeTop, stage);
+  const int inputRows = InputRows(rows, boundaryModes, stage);
+  const int outputRowsBegin = rowsTop - BoundaryRows(modeTop, stage + 1);
+  const int outputRowsEnd =
+      rowsTop + rows + BoundaryRows(modeBottom, stage + 1);
+
+  // Whether the halo columns beyond the first and last block are streamed
+  const bool colsLeft = BoundaryCols(modeLeft);
+  const bool colsRight = BoundaryCols(modeRight);
 
   // Begin and end indices of the inner block size (without any halos)
   static constexpr int kInnerBegin = kBoundaryWidth;
-  static constexpr int kInnerEnd = kInputWidth - kBoundaryWidth;
+  const int innerEnd = inputWidth - kBoundaryWidth;
 
   // Only shrink the output if we hit the boundary of the data width
   static constexpr bool kShrinkOutput =
-      (kKernelWidth + kDepth - stage - 1) % kKernelWidth == 0;
+      kBoundaryWidth !=
+      hlslib::CeilDivide(kRadius * (kDepth - stage - 1), kKernelWidth);
 
-  // The stencil radius is always smaller than the halo size, so we always
-  // shrink by one
+  // The stencil radius is never larger than the data width, so we shrink by at
+  // most one
   static constexpr int kOutputBegin = kShrinkOutput ? 1 : 0;
-  static constexpr int kOutputEnd =
-      kShrinkOutput ? kInputWidth - 1 : kInputWidth;
-
+  const int outputEnd = kShrinkOutput ? inputWidth - 1 : inputWidth;
+
+  // The input stream is read this many iterations ahead of the cell being
+  // computed, such that all rows of the neighborhood and the next column are
+  // available. Passes are streamed back to back, such that the last cells of
+  // a pass are computed while reading the next one.
+  const int lookahead = kRadius * inputWidth + 1;
+  const long totalCells = static_cast<long>(timeFolded) * grids * blocks *
+                          inputRows * inputWidth;
+  const long iterations = totalCells + lookahead;
+
+  // Line buffer i holds row (i - kRadius) relative to the cell being computed,
+  // and is fed by line buffer i + 1, or by the input stream for the last one.
   // The typedef seems to break the high level synthesis tool when applying
   // pragmas
-  hlslib::Stream<Kernel_t, kInputWidth> northBuffer("northBuffer");
-  hlslib::Stream<Kernel_t, kInputWidth> centerBuffer("centerBuffer");
+  Stream_t<Kernel_t, kInputWidthMax> lineBuffers[kLineBuffers];
+#ifndef STENCIL_SYNTHESIS
+  NameStreams(lineBuffers, "lineBuffers");
+#endif
+
+  // Previous, current and next column for each row of the neighborhood
+  Kernel_t window[kWindowRows][3];
+  #pragma HLS ARRAY_PARTITION variable=window complete dim=0
+
+  static constexpr bool kResidual = stage == kDepth - 1;
+
+  // The sum of squares is accumulated into interleaved partial sums, such that
+  // consecutive iterations never add to the same partial sum
+  Accumulate_t residualMax(0);
+  Accumulate_t residualSums[kResidualLanes];
+  #pragma HLS ARRAY_PARTITION variable=residualSums complete
+  #pragma HLS DEPENDENCE variable=residualSums inter false
+  for (int l = 0; l < kResidualLanes; ++l) {
+    #pragma HLS UNROLL
+    residualSums[l] = Accumulate_t(0);
+  }
+  int residualLane = 0;
+
+  Counter_t stalled = 0;
+
+  // Pass and grid being computed
+  int pass = 0;
+  int grid = 0;
+
+  // Position being read from the input stream
+  int bRead = 0;
+  int rRead = 0;
+  int cRead = 0;
 
-  int t = 0;
+  // Position being computed
   int b = 0;
   int r = 0;
   int c = 0;
 
-  Data_t shiftWest(kBoundary);
-  Kernel_t shiftCenter(kBoundary);
-
 ComputeFlat:
-  for (long i = 0;
-       i < kTimeFolded * kBlocks * kRows * kInputWidth + kInputWidth - 1; ++i) {
+  for (long i = 0; i < iterations; ++i) {
     #pragma HLS PIPELINE
 
-#ifdef STENCIL_KERNEL_DEBUG
-    std::stringstream debugStream;
-    debugStream << "Stage " << stage << ": (" << t << ", " << b << ", "
-                << r << ", " << c - kBoundaryWidth << "): ";
-    bool debugCond = stage == 0 && r == 0 && c - kBoundaryWidth == 0 && b == 0;
-#endif
-
-    const bool isSaturating = i < kInputWidth - 1; // Shift right by one 
-    const bool isDraining = i >= kTimeFolded * kBlocks * kRows * kInputWidth;
-    const bool inBounds = ((b > 0 || c >= kInnerBegin) &&
-                           (b < kBlocks - 1 || c < kInnerEnd));
-    const bool inBlock = c >= kInnerBegin && c < kInnerEnd;
-
-    if (isSaturating) {
-      Kernel_t read;
-      if (i >= kInnerBegin - 1) { // Shift right by one
+    // Columns beyond Neumann edges are not present in the input stream, and
+    // are mirrored when computing the cells next to them
+    Kernel_t read(kBoundary);
+    bool stall = false;
+    if (i < totalCells) {
+      if ((bRead > 0 || colsLeft || cRead >= kInnerBegin) &&
+          (bRead < blocks - 1 || colsRight || cRead < innerEnd)) {
+        stall = kCounters && pipeIn.IsEmpty();
         read = pipeIn.Pop();
-      } else {
-        read = Kernel_t(kBoundary);
       }
-      centerBuffer.WriteOptimistic(read, kInputWidth);
-#ifdef STENCIL_KERNEL_DEBUG
-      debugStream << "saturating " << read << "\n";
-      if (debugCond) {
-        std::cout << debugStream.str();
+      if (cRead == inputWidth - 1) {
+        cRead = 0;
+        if (rRead == inputRows - 1) {
+          rRead = 0;
+          bRead = (bRead == blocks - 1) ? 0 : (bRead + 1);
+        } else {
+          ++rRead;
+        }
+      } else {
+        ++cRead;
       }
-#endif
-    } else { // Use else instead of continue or the whole pipeline breaks...
-
-      Kernel_t read;
-      if (!isDraining) {
-        // If not on the last row, check if the column in this block is out
-        // of bounds. If on the last row, check if the column is out of
-        // bounds in the NEXT block. Written below in DNF form:
-        if ((b == 0 && c < kInnerBegin && r < kRows - 1) ||
-            (b == kBlocks - 1 && c < kInnerBegin && r == kRows - 1) ||
-            (b == kBlocks - 1 && c >= kInnerEnd && r < kRows - 1) ||
-            (b == kBlocks - 2 && c >= kInnerEnd && r == kRows - 1)) {
-
-          read = Kernel_t(kBoundary);
+    }
 
-        } else {
+    // Advance the line buffers by one column. Each line buffer delays its
+    // input by a full row, and only contains data once the rows before it
+    // have been filled.
+    Kernel_t column[kWindowRows];
+    column[kLineBuffers] = read;
+  ReadLineBuffers:
+    for (int l = 0; l < kLineBuffers; ++l) {
+      #pragma HLS UNROLL
+      const long fillBegin = static_cast<long>(kLineBuffers - l) * inputWidth;
+      column[l] = (i >= fillBegin) ? lineBuffers[l].ReadOptimistic()
+                                   : Kernel_t(kBoundary);
+    }
+  WriteLineBuffers:
+    for (int l = 0; l < kLineBuffers; ++l) {
+      #pragma HLS UNROLL
+      const long fillBegin =
+          static_cast<long>(kLineBuffers - l - 1) * inputWidth;
+      // Stop writing once the remaining values can no longer be consumed, so
+      // the line buffers are empty when the kernel terminates
+      if (i >= fillBegin && i < iterations - inputWidth) {
+        lineBuffers[l].WriteOptimistic(column[l + 1], inputWidth);
+      }
+    }
 
-          read = pipeIn.Pop();
+    // Shift the window left by one column
+  ShiftWindow:
+    for (int l = 0; l < kWindowRows; ++l) {
+      #pragma HLS UNROLL
+      window[l][0] = window[l][1];
+      window[l][1] = window[l][2];
+      window[l][2] = column[l];
+    }
 
+    // Wait until the window is centered on the first cell. Use if instead of
+    // continue or the whole pipeline breaks...
+    if (i >= lookahead) {
+
+      // Row of the cell in the domain, which is negative or beyond the last
+      // row for the rows streamed beyond the top and bottom edge
+      const int row = r - rowsTop;
+
+      // Rows beyond Neumann edges are mirrored across the edge. Rows that are
+      // not part of the stream only affect cells that are not passed on, and
+      // are replaced by the boundary value.
+      Kernel_t neighborhood[kWindowRows][3];
+      #pragma HLS ARRAY_PARTITION variable=neighborhood complete dim=0
+    CollectRows:
+      for (int l = 0; l < kWindowRows; ++l) {
+        #pragma HLS UNROLL
+        const int neighbor = row + l - kRadius;
+        const int source =
+            (neighbor < 0 && modeTop == kBoundaryNeumann)
+                ? (l - 2 * neighbor - 1)
+                : ((neighbor >= rows && modeBottom == kBoundaryNeumann)
+                       ? (l + 2 * (rows - neighbor) - 1)
+                       : l);
+        const bool inStream = source >= 0 && source < kWindowRows &&
+                              r + source - kRadius >= 0 &&
+                              r + source - kRadius < inputRows;
+        for (int k = 0; k < 3; ++k) {
+          #pragma HLS UNROLL
+          neighborhood[l][k] = inStream ? window[inStream ? source : l][k]
+                                        : Kernel_t(kBoundary);
         }
       }
 
-      // Collect vertical values
-      const auto north =
-          (r > 0) ? northBuffer.ReadOptimistic() : Kernel_t(kBoundary);
-      const auto south = (r < kRows - 1) ? read : Kernel_t(kBoundary);
-
-      // Use center value shifted forward to populate bulk of west and east
-      // vectors
-      Kernel_t west, east;
-      shiftCenter.ShiftTo<0, 1, kKernelWidth - 1>(west);
-      shiftCenter.ShiftTo<1, 0, kKernelWidth - 1>(east);
-
-      // Read the next center value to collect the last element of east
-      const auto nextCenter = centerBuffer.ReadOptimistic();
-      east[kKernelWidth - 1] = nextCenter[0];
-
-      // We shifted the last element of west forward from last iteration
-      west[0] = shiftWest;
-
-      // Now update the line buffers
-      if (!isDraining) {
-        centerBuffer.WriteOptimistic(read, kInputWidth);
-        if (r < kRows - 1) {
-          northBuffer.WriteOptimistic(shiftCenter);
+      // Columns beyond Neumann edges mirror the first or last vector of the
+      // domain. The stencil radius never exceeds the kernel width, so only
+      // the adjacent vector is needed.
+      const bool mirrorLeft =
+          modeLeft == kBoundaryNeumann && b == 0 && c == kInnerBegin;
+      const bool mirrorRight = modeRight == kBoundaryNeumann &&
+                               b == blocks - 1 && c == innerEnd - 1;
+    MirrorCols:
+      for (int l = 0; l < kWindowRows; ++l) {
+        #pragma HLS UNROLL
+        Kernel_t mirrored;
+        for (int w = 0; w < kKernelWidth; ++w) {
+          #pragma HLS UNROLL
+          mirrored[w] = neighborhood[l][1][kKernelWidth - 1 - w];
+        }
+        if (mirrorLeft) {
+          neighborhood[l][0] = mirrored;
+        }
+        if (mirrorRight) {
+          neighborhood[l][2] = mirrored;
         }
       }
 
-      // Values have been consumed, so shift all center registers left 
-      shiftWest = shiftCenter[kKernelWidth - 1];
-      shiftCenter = nextCenter;
-
 #ifdef STENCIL_KERNEL_DEBUG
-      debugStream << "N" << north << ", W" << west << ", E" << east << ", S"
-                  << south;
+      std::stringstream debugStream;
+      debugStream << "Stage " << stage << ": (" << b << ", " << r << ", "
+                  << c - kBoundaryWidth << "): ";
+      bool debugCond =
+          stage == 0 && r == 0 && c - kBoundaryWidth == 0 && b == 0;
+      for (int l = 0; l < kWindowRows; ++l) {
+        debugStream << "R" << l - kRadius << neighborhood[l][1] << " ";
+      }
 #endif
 
-      // Now we can perform the actual compute
+      // Now we can perform the actual compute. The points are accumulated
+      // in Accumulate_t, and only the result is rounded to Data_t.
       Kernel_t result;
     ComputeSIMD:
       for (int w = 0; w < kKernelWidth; ++w) {
         #pragma HLS UNROLL
-        const Data_t northVal = north[w];
-        const Data_t westVal = west[w];
-        const Data_t eastVal = east[w];
-        const Data_t southVal = south[w];
-        const Data_t factor = 0.25; // Cannot be constexpr due to half precision
-        const Data_t add0 = northVal + westVal;
-        const Data_t add1 = add0 + eastVal;
-        const Data_t add2 = add1 + southVal;
-        STENCIL_RESOURCE_PRAGMA_ADD(add0);
-        STENCIL_RESOURCE_PRAGMA_ADD(add1);
-        STENCIL_RESOURCE_PRAGMA_ADD(add2);
-        const Data_t mult = factor * add2;
-        STENCIL_RESOURCE_PRAGMA_MULT(mult);
-        result[w] = mult;
+        Accumulate_t acc;
+      ComputePoints:
+        for (int p = 0; p < Stencil_t::kPoints; ++p) {
+          #pragma HLS UNROLL
+          // Index into the concatenation of the previous, current and next
+          // column of the row
+          const int index = kKernelWidth + w + Stencil_t::ColOffset(p);
+          const Accumulate_t value = static_cast<Accumulate_t>(
+              neighborhood[Stencil_t::RowOffset(p) + kRadius]
+                          [index / kKernelWidth][index % kKernelWidth]);
+          // Cannot be constexpr due to half precision
+          const Accumulate_t weight = Stencil_t::Weight(p);
+          Accumulate_t term = value;
+          if (!Stencil_t::IsUnitWeight(p)) {
+            const Accumulate_t mult = weight * value;
+            STENCIL_RESOURCE_PRAGMA_MULT(mult);
+            term = mult;
+          }
+          if (p == 0) {
+            acc = term;
+          } else {
+            const Accumulate_t add = acc + term;
+            STENCIL_RESOURCE_PRAGMA_ADD(add);
+            acc = add;
+          }
+        }
+        if (!Stencil_t::IsUnitScale()) {
+          const Accumulate_t factor = Stencil_t::ScaleValue();
+          const Accumulate_t mult = factor * acc;
+          STENCIL_RESOURCE_PRAGMA_MULT(mult);
+          acc = mult;
+        }
+        result[w] = static_cast<Data_t>(acc);
+      }
+
+      // Cells beyond Dirichlet edges keep their value, as do all cells of a
+      // stage that is bypassed
+      const bool dirichlet =
+          (row < 0 && modeTop == kBoundaryDirichlet) ||
+          (row >= rows && modeBottom == kBoundaryDirichlet) ||
+          (b == 0 && c < kInnerBegin && modeLeft == kBoundaryDirichlet) ||
+          (b == blocks - 1 && c >= innerEnd &&
+           modeRight == kBoundaryDirichlet);
+      const bool bypass = bypassLast && pass == timeFolded - 1;
+      if (dirichlet || bypass) {
+        result = window[kRadius][1];
       }
 
       // Only output values if the next unit needs them
-      if (c >= kOutputBegin && c < kOutputEnd && inBounds) {
-        Kernel_t write;
-        if (inBounds) {
-          write = result;
-        } else {
-          write = Kernel_t(kBoundary);
+      const bool inBounds = ((b > 0 || colsLeft || c >= kInnerBegin) &&
+                             (b < blocks - 1 || colsRight || c < innerEnd));
+      if (c >= kOutputBegin && c < outputEnd && r >= outputRowsBegin &&
+          r < outputRowsEnd && inBounds) {
+        stall = stall || (kCounters && pipeOut.IsFull());
+        pipeOut.Push(result);
+        if (kResidual) {
+          // The output of the last stage covers every cell exactly once per
+          // pass, so this covers the full domain
+          Accumulate_t squares[kKernelWidth];
+          #pragma HLS ARRAY_PARTITION variable=squares complete
+        ResidualSIMD:
+          for (int w = 0; w < kKernelWidth; ++w) {
+            #pragma HLS UNROLL
+            Accumulate_t diff =
+                static_cast<Accumulate_t>(result[w]) -
+                static_cast<Accumulate_t>(neighborhood[kRadius][1][w]);
+            diff = (diff < 0) ? Accumulate_t(-diff) : diff;
+            residualMax = (diff > residualMax) ? diff : residualMax;
+            squares[w] = diff * diff;
+          }
+          Accumulate_t sum = squares[0];
+        ResidualReduce:
+          for (int w = 1; w < kKernelWidth; ++w) {
+            #pragma HLS UNROLL
+            sum = sum + squares[w];
+          }
+          residualSums[residualLane] = residualSums[residualLane] + sum;
+          residualLane =
+              (residualLane == kResidualLanes - 1) ? 0 : (residualLane + 1);
         }
-        pipeOut.Push(write);
 #ifdef STENCIL_KERNEL_DEBUG
         if (debugCond) {
-          debugStream << " -> " << write << "\n"; 
+          debugStream << " -> " << result << "\n"; 
         }
 #endif
       } else {
@@ -185,13 +369,34 @@ ComputeFlat:
 #endif
 
       // Index calculations
-      if (c == kInputWidth - 1) {
+      if (c == inputWidth - 1) {
         c = 0;
-        if (r == kRows - 1) {
+        if (r == inputRows - 1) {
           r = 0;
-          if (b == kBlocks - 1) {
+          if (b == blocks - 1) {
             b = 0;
-            ++t;
+            if (grid == grids - 1) {
+              grid = 0;
+              ++pass;
+            } else {
+              ++grid;
+            }
+            if (kResidual) {
+              // End of the pass over this grid
+              Accumulate_t sum(0);
+            ResidualLanes:
+              for (int l = 0; l < kResidualLanes; ++l) {
+                #pragma HLS UNROLL
+                sum = sum + residualSums[l];
+                residualSums[l] = Accumulate_t(0);
+              }
+              Residual_t residual;
+              residual[kResidualMax] = residualMax;
+              residual[kResidualSumSquares] = sum;
+              residualOut.Push(residual);
+              residualMax = Accumulate_t(0);
+              residualLane = 0;
+            }
           } else {
             ++b;
           }
@@ -201,47 +406,88 @@ ComputeFlat:
       } else {
         ++c;
       }
+
+    }
+
+    if (stall) {
+      ++stalled;
     }
 
   }
 
+#ifdef STENCIL_ENABLE_COUNTERS
+  counters.Push(MakeCounters(iterations, stalled, 0));
+#endif
+
 }
 
 #ifdef STENCIL_SYNTHESIS
 
 template <int stage>
-void UnrollCompute(hlslib::Stream<Kernel_t> &previous,
-                   hlslib::Stream<Kernel_t> &last) {
+void UnrollCompute(Stream_t<Kernel_t> &previous,
+                   Stream_t<Kernel_t> &last,
+                   Stream_t<Residual_t> &residual,
+                   STENCIL_COUNTERS(Stream_t<Counters_t> counters[kDepth],)
+                   const int boundaryModes, const int grids, const int rows,
+                   const int cols, const int blocks, const int timesteps) {
   #pragma HLS INLINE
-  hlslib::Stream<Kernel_t, kPipeDepth> next("pipe");
-  Compute<kDepth - stage>(previous, next);
-  UnrollCompute<stage - 1>(next, last);
+  Stream_t<Kernel_t, kPipeDepth> next("pipe");
+  Compute<kDepth - stage>(previous, next, residual,
+                          STENCIL_COUNTERS(counters[kDepth - stage],)
+                          boundaryModes, grids, rows, cols, blocks, timesteps);
+  UnrollCompute<stage - 1>(next, last, residual, STENCIL_COUNTERS(counters,)
+                           boundaryModes, grids, rows, cols, blocks,
+                           timesteps);
 }
 
 template <>
-void UnrollCompute<1>(hlslib::Stream<Kernel_t> &previous,
-                      hlslib::Stream<Kernel_t> &last) {
+inline void UnrollCompute<1>(Stream_t<Kernel_t> &previous,
+                             Stream_t<Kernel_t> &last,
+                             Stream_t<Residual_t> &residual,
+                             STENCIL_COUNTERS(
+                                 Stream_t<Counters_t> counters[kDepth],)
+                             const int boundaryModes, const int grids,
+                             const int rows, const int cols, const int blocks,
+                             const int timesteps) {
 #pragma HLS INLINE
-  Compute<kDepth - 1>(previous, last);
+  Compute<kDepth - 1>(previous, last, residual,
+                      STENCIL_COUNTERS(counters[kDepth - 1],) boundaryModes,
+                      grids, rows, cols, blocks, timesteps);
 }
 
 #else
 
 template <int stage>
-void UnrollCompute(hlslib::Stream<Kernel_t> &previous,
-                   hlslib::Stream<Kernel_t> &last,
-                   std::vector<std::thread> &threads) {
-  static hlslib::Stream<Kernel_t> next("pipe");
-  threads.emplace_back(Compute<kDepth - stage>, std::ref(previous),
-                       std::ref(next));
-  UnrollCompute<stage - 1>(next, last, threads);
+void UnrollCompute(Stream_t<Kernel_t> &previous,
+                   Stream_t<Kernel_t> &last,
+                   Stream_t<Residual_t> &residual,
+                   STENCIL_COUNTERS(Stream_t<Counters_t> counters[kDepth],)
+                   const int boundaryModes, const int grids, const int rows,
+                   const int cols, const int blocks, const int timesteps,
+                   Dataflow &dataflow) {
+  auto &next = dataflow.MakeStream<Stream_t<Kernel_t>>("pipe");
+  dataflow.Add(Compute<kDepth - stage>, std::ref(previous),
+               std::ref(next), std::ref(residual),
+               STENCIL_COUNTERS(std::ref(counters[kDepth - stage]),)
+               boundaryModes, grids, rows, cols, blocks, timesteps);
+  UnrollCompute<stage - 1>(next, last, residual, STENCIL_COUNTERS(counters,)
+                           boundaryModes, grids, rows, cols, blocks,
+                           timesteps, dataflow);
 }
 
 template <>
-void UnrollCompute<1>(hlslib::Stream<Kernel_t> &previous,
-                      hlslib::Stream<Kernel_t> &last,
-                      std::vector<std::thread> &threads) {
-  threads.emplace_back(Compute<kDepth - 1>, std::ref(previous), std::ref(last));
+inline void UnrollCompute<1>(Stream_t<Kernel_t> &previous,
+                             Stream_t<Kernel_t> &last,
+                             Stream_t<Residual_t> &residual,
+                             STENCIL_COUNTERS(
+                                 Stream_t<Counters_t> counters[kDepth],)
+                             const int boundaryModes, const int grids,
+                             const int rows, const int cols, const int blocks,
+                             const int timesteps, Dataflow &dataflow) {
+  dataflow.Add(Compute<kDepth - 1>, std::ref(previous), std::ref(last),
+               std::ref(residual),
+               STENCIL_COUNTERS(std::ref(counters[kDepth - 1]),)
+               boundaryModes, grids, rows, cols, blocks, timesteps);
 }
 
 #endif
@@ -0,0 +1,320 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include "Stencil.h"
+#include "SpscStream.h"
+#include "hlslib/xilinx/Utility.h"
+#ifndef STENCIL_SYNTHESIS
+#include "Dataflow.h"
+#endif
+
+/// Three-dimensional variant of Compute. The domain is tiled along columns
+/// (blocks) and rows (row blocks), and each tile is streamed plane by plane,
+/// row by row. Every stage consumes one row of halo on either side of the tile
+/// and the same column halo as the two-dimensional kernel. Planes are not
+/// tiled, so the z-neighbors are held in two plane buffers, which together
+/// with two line buffers delay the input stream such that the next plane,
+/// next row, current row, previous row and previous plane are available for
+/// each cell. Like Compute, the leading stages pass their input through in the
+/// last pass if the timesteps are not a multiple of the depth.
+template <int stage>
+void Compute3D(Stream_t<Kernel_t> &pipeIn,
+               Stream_t<Kernel_t> &pipeOut, const int planes,
+               const int rows, const int cols, const int rowBlocks,
+               const int blocks, const int timesteps) {
+
+  // Size of the halo in either side along columns
+  static constexpr int kBoundaryWidth =
+      hlslib::CeilDivide(kRadius * (kDepth - stage), kKernelWidth);
+
+  // Number of halo rows in either side along rows
+  static constexpr int kHaloRows = kRadius3D * (kDepth - stage);
+
+  // Maximum dimensions of a tile including halos, used to size the buffers
+  static constexpr int kInputWidthMax = kBlockWidthKernelMax + 2 * kBoundaryWidth;
+  static constexpr int kInputHeightMax = kTileRowsMax + 2 * kHaloRows;
+
+  const int timeFolded = TimeFolded(timesteps);
+  const bool bypassLast = stage < BypassStages(timesteps);
+  const int tileRows = TileRows(rows, rowBlocks);
+  const int inputWidth = BlockWidthKernel(cols, blocks) + 2 * kBoundaryWidth;
+  const int inputHeight = tileRows + 2 * kHaloRows;
+
+  // Begin and end indices of the inner block size (without any halos)
+  static constexpr int kInnerBegin = kBoundaryWidth;
+  const int innerEnd = inputWidth - kBoundaryWidth;
+
+  // Only shrink the output if we hit the boundary of the data width
+  static constexpr bool kShrinkOutput =
+      kBoundaryWidth !=
+      hlslib::CeilDivide(kRadius * (kDepth - stage - 1), kKernelWidth);
+  static constexpr int kOutputBegin = kShrinkOutput ? 1 : 0;
+  const int outputEnd = kShrinkOutput ? inputWidth - 1 : inputWidth;
+
+  // The input stream is read a full plane ahead of the cell being computed
+  const long planeSize = static_cast<long>(inputHeight) * inputWidth;
+  const long lookahead = planeSize;
+  const long totalCells = static_cast<long>(timeFolded) * rowBlocks * blocks *
+                          planes * planeSize;
+  const long iterations = totalCells + lookahead;
+
+  // The input is delayed by a chain of buffers. Each buffer starts producing
+  // once its input has been delayed by its length, and stops consuming once
+  // the remaining values can no longer be produced, so all buffers are empty
+  // when the kernel terminates:
+  //   input      -> next plane     (c, r, z + 1)
+  //   planeNext  -> next row       (c, r + 1, z)
+  //   lineNext   -> next column    (c + 1, r, z), shifted through the window
+  //   window     -> previous column (c - 1, r, z)
+  //   linePrev   -> previous row   (c, r - 1, z)
+  //   planePrev  -> previous plane (c, r, z - 1)
+  const long planeDelay = planeSize - inputWidth;
+  const long lineDelay = inputWidth - 1;
+  const long lineNextBegin = planeDelay;
+  const long linePrevBegin = planeSize + 1;
+  const long planePrevBegin = linePrevBegin + lineDelay;
+  const long lineNextFill = lineNextBegin + lineDelay;
+  const long linePrevFill = planePrevBegin;
+  const long planePrevFill = planePrevBegin + planeDelay;
+
+  // The typedef seems to break the high level synthesis tool when applying
+  // pragmas
+  Stream_t<Kernel_t, (kInputHeightMax - 1) * kInputWidthMax> planeNext;
+  Stream_t<Kernel_t, (kInputHeightMax - 1) * kInputWidthMax> planePrev;
+  Stream_t<Kernel_t, kInputWidthMax> lineNext;
+  Stream_t<Kernel_t, kInputWidthMax> linePrev;
+
+  // Previous, current and next column of the current row
+  Kernel_t window[3];
+  #pragma HLS ARRAY_PARTITION variable=window complete
+
+  // Position being read from the input stream
+  int bRead = 0;
+  int lRead = 0;
+  int cRead = 0;
+
+  // Position being computed
+  int pass = 0;
+  int tb = 0;
+  int b = 0;
+  int z = 0;
+  int r = 0;
+  int c = 0;
+
+ComputeFlat:
+  for (long i = 0; i < iterations; ++i) {
+    #pragma HLS PIPELINE
+
+    // Columns outside the domain are not present in the input stream, and are
+    // replaced by the boundary value
+    Kernel_t read(kBoundary);
+    if (i < totalCells) {
+      if ((bRead > 0 || cRead >= kInnerBegin) &&
+          (bRead < blocks - 1 || cRead < innerEnd)) {
+        read = pipeIn.Pop();
+      }
+      if (cRead == inputWidth - 1) {
+        cRead = 0;
+        if (lRead == planes * inputHeight - 1) {
+          lRead = 0;
+          bRead = (bRead == blocks - 1) ? 0 : (bRead + 1);
+        } else {
+          ++lRead;
+        }
+      } else {
+        ++cRead;
+      }
+    }
+
+    // Advance the delay chain by one cell
+    const Kernel_t next = (i >= lineNextBegin) ? planeNext.ReadOptimistic()
+                                               : Kernel_t(kBoundary);
+    const Kernel_t east = (i >= lineNextFill) ? lineNext.ReadOptimistic()
+                                              : Kernel_t(kBoundary);
+    const Kernel_t prev = (i >= linePrevFill) ? linePrev.ReadOptimistic()
+                                              : Kernel_t(kBoundary);
+    const Kernel_t below = (i >= planePrevFill) ? planePrev.ReadOptimistic()
+                                                : Kernel_t(kBoundary);
+
+    // Shift the window left by one column
+    window[0] = window[1];
+    window[1] = window[2];
+    window[2] = east;
+
+    if (i < iterations - planeDelay) {
+      planeNext.WriteOptimistic(read, planeDelay);
+    }
+    if (i >= lineNextBegin && i < iterations - lineDelay) {
+      lineNext.WriteOptimistic(next, lineDelay);
+    }
+    if (i >= linePrevBegin && i < iterations - lineDelay) {
+      linePrev.WriteOptimistic(window[0], lineDelay);
+    }
+    if (i >= planePrevBegin && i < iterations - planeDelay) {
+      planePrev.WriteOptimistic(prev, planeDelay);
+    }
+
+    // Wait until the delay chain is centered on the first cell. Use if instead
+    // of continue or the whole pipeline breaks...
+    if (i >= lookahead) {
+
+      // Neighbors outside the domain are replaced by the boundary value
+      const int rGlobal = tb * tileRows + r - kHaloRows;
+      const Kernel_t planeAbove = (z < planes - 1) ? read : Kernel_t(kBoundary);
+      const Kernel_t planeBelow = (z > 0) ? below : Kernel_t(kBoundary);
+      const Kernel_t rowBelow =
+          (rGlobal < rows - 1) ? next : Kernel_t(kBoundary);
+      const Kernel_t rowAbove = (rGlobal > 0) ? prev : Kernel_t(kBoundary);
+
+      // Accumulated in Accumulate_t, and only the result is rounded to Data_t
+      Kernel_t result;
+    ComputeSIMD:
+      for (int w = 0; w < kKernelWidth; ++w) {
+        #pragma HLS UNROLL
+        Accumulate_t acc;
+      ComputePoints:
+        for (int p = 0; p < Stencil3D_t::kPoints; ++p) {
+          #pragma HLS UNROLL
+          Accumulate_t value;
+          if (Stencil3D_t::PlaneOffset(p) != 0) {
+            value = static_cast<Accumulate_t>(
+                (Stencil3D_t::PlaneOffset(p) < 0) ? planeBelow[w]
+                                                  : planeAbove[w]);
+          } else if (Stencil3D_t::RowOffset(p) != 0) {
+            value = static_cast<Accumulate_t>(
+                (Stencil3D_t::RowOffset(p) < 0) ? rowAbove[w] : rowBelow[w]);
+          } else {
+            // Index into the concatenation of the previous, current and next
+            // column of the row
+            const int index = kKernelWidth + w + Stencil3D_t::ColOffset(p);
+            value = static_cast<Accumulate_t>(
+                window[index / kKernelWidth][index % kKernelWidth]);
+          }
+          // Cannot be constexpr due to half precision
+          const Accumulate_t weight = Stencil3D_t::Weight(p);
+          Accumulate_t term = value;
+          if (!Stencil3D_t::IsUnitWeight(p)) {
+            const Accumulate_t mult = weight * value;
+            STENCIL_RESOURCE_PRAGMA_MULT(mult);
+            term = mult;
+          }
+          if (p == 0) {
+            acc = term;
+          } else {
+            const Accumulate_t add = acc + term;
+            STENCIL_RESOURCE_PRAGMA_ADD(add);
+            acc = add;
+          }
+        }
+        if (!Stencil3D_t::IsUnitScale()) {
+          const Accumulate_t factor = Stencil3D_t::ScaleValue();
+          const Accumulate_t mult = factor * acc;
+          STENCIL_RESOURCE_PRAGMA_MULT(mult);
+          acc = mult;
+        }
+        result[w] = static_cast<Data_t>(acc);
+      }
+      if (bypassLast && pass == timeFolded - 1) {
+        result = window[1];
+      }
+
+      // Only output values if the next unit needs them. The outermost rows
+      // depend on rows outside the tile, so they are always dropped.
+      const bool inBounds = ((b > 0 || c >= kInnerBegin) &&
+                             (b < blocks - 1 || c < innerEnd));
+      if (c >= kOutputBegin && c < outputEnd && inBounds && r > 0 &&
+          r < inputHeight - 1) {
+        pipeOut.Push(result);
+      }
+
+      // Index calculations
+      if (c == inputWidth - 1) {
+        c = 0;
+        if (r == inputHeight - 1) {
+          r = 0;
+          if (z == planes - 1) {
+            z = 0;
+            if (b == blocks - 1) {
+              b = 0;
+              if (tb == rowBlocks - 1) {
+                tb = 0;
+                ++pass;
+              } else {
+                ++tb;
+              }
+            } else {
+              ++b;
+            }
+          } else {
+            ++z;
+          }
+        } else {
+          ++r;
+        }
+      } else {
+        ++c;
+      }
+
+    }
+
+  }
+
+}
+
+#ifdef STENCIL_SYNTHESIS
+
+template <int stage>
+void UnrollCompute3D(Stream_t<Kernel_t> &previous,
+                     Stream_t<Kernel_t> &last, const int planes,
+                     const int rows, const int cols, const int rowBlocks,
+                     const int blocks, const int timesteps) {
+  #pragma HLS INLINE
+  Stream_t<Kernel_t, kPipeDepth> next("pipe");
+  Compute3D<kDepth - stage>(previous, next, planes, rows, cols, rowBlocks,
+                            blocks, timesteps);
+  UnrollCompute3D<stage - 1>(next, last, planes, rows, cols, rowBlocks, blocks,
+                             timesteps);
+}
+
+template <>
+inline void UnrollCompute3D<1>(Stream_t<Kernel_t> &previous,
+                               Stream_t<Kernel_t> &last,
+                               const int planes, const int rows,
+                               const int cols, const int rowBlocks,
+                               const int blocks, const int timesteps) {
+  #pragma HLS INLINE
+  Compute3D<kDepth - 1>(previous, last, planes, rows, cols, rowBlocks, blocks,
+                        timesteps);
+}
+
+#else
+
+template <int stage>
+void UnrollCompute3D(Stream_t<Kernel_t> &previous,
+                     Stream_t<Kernel_t> &last, const int planes,
+                     const int rows, const int cols, const int rowBlocks,
+                     const int blocks, const int timesteps,
+                     Dataflow &dataflow) {
+  auto &next = dataflow.MakeStream<Stream_t<Kernel_t>>("pipe");
+  dataflow.Add(Compute3D<kDepth - stage>, std::ref(previous),
+               std::ref(next), planes, rows, cols, rowBlocks, blocks,
+               timesteps);
+  UnrollCompute3D<stage - 1>(next, last, planes, rows, cols, rowBlocks, blocks,
+                             timesteps, dataflow);
+}
+
+template <>
+inline void UnrollCompute3D<1>(Stream_t<Kernel_t> &previous,
+                               Stream_t<Kernel_t> &last,
+                               const int planes, const int rows,
+                               const int cols, const int rowBlocks,
+                               const int blocks, const int timesteps,
+                               Dataflow &dataflow) {
+  dataflow.Add(Compute3D<kDepth - 1>, std::ref(previous),
+               std::ref(last), planes, rows, cols, rowBlocks, blocks,
+               timesteps);
+}
+
+#endif
@@ -0,0 +1,112 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef STENCIL_SIMULATION_WORKERS
+#define STENCIL_SIMULATION_WORKERS 0
+#endif
+
+/// Collects the processes of a simulated dataflow region and runs them to
+/// completion, mirroring the processes that run concurrently in hardware.
+/// Each kernel invocation creates its own Dataflow, which also owns the
+/// streams connecting the processes, so simulated kernels are reentrant and
+/// any number of them can run concurrently in the same process.
+///
+/// With STENCIL_COOPERATIVE_SIMULATION, every process runs as a resumable task
+/// with its own stack, and the tasks are multiplexed onto a fixed pool of
+/// STENCIL_SIMULATION_WORKERS threads (or one per core if zero). A task
+/// suspends whenever it would block on a stream, so the number of threads is
+/// independent of the depth of the pipeline. If every remaining task is
+/// suspended on a stream that can never become ready, Run throws instead of
+/// hanging. Tasks left suspended by a deadlock or by a process that threw are
+/// unwound before Run throws, so the streams and buffers on their stacks are
+/// destroyed. Otherwise every process runs in a separate thread.
+class Dataflow {
+
+ public:
+  Dataflow() = default;
+
+  Dataflow(Dataflow const &) = delete;
+  Dataflow &operator=(Dataflow const &) = delete;
+
+  /// Adds a process, taking arguments the same way as std::thread
+  template <typename Function, typename... Args>
+  void Add(Function &&function, Args &&... args) {
+    processes_.emplace_back(std::bind(std::forward<Function>(function),
+                                      std::forward<Args>(args)...));
+  }
+
+  /// Creates a stream that lives as long as the dataflow, for streams that
+  /// connect processes added by different functions. The stream is allocated
+  /// with its own alignment, which keeps the indices of simulation streams on
+  /// separate cache lines, as new only guarantees that since C++17.
+  template <typename Stream, typename... Args>
+  Stream &MakeStream(Args &&... args) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, std::max(alignof(Stream), sizeof(void *)),
+                       sizeof(Stream)) != 0) {
+      throw std::bad_alloc();
+    }
+    Stream *stream;
+    try {
+      stream = new (memory) Stream(std::forward<Args>(args)...);
+    } catch (...) {
+      std::free(memory);
+      throw;
+    }
+    std::shared_ptr<Stream> owner(stream, [](Stream *s) {
+      s->~Stream();
+      std::free(s);
+    });
+    streams_.emplace_back(std::move(owner));
+    return *stream;
+  }
+
+  /// Runs all processes added so far until they return. Throws
+  /// DataflowDeadlock if the processes deadlock, and rethrows the first
+  /// exception thrown by a process.
+  void Run();
+
+ private:
+  std::vector<std::function<void()>> processes_;
+  std::vector<std::shared_ptr<void>> streams_;
+};
+
+/// Thrown by Dataflow::Run if every remaining process is blocked on a stream
+/// that can never become ready
+class DataflowDeadlock : public std::runtime_error {
+
+ public:
+  DataflowDeadlock(std::string const &message,
+                   std::vector<std::string> const &streams)
+      : std::runtime_error(message), streams_(streams) {}
+
+  /// Names of the streams the processes are blocked on, each listed once
+  std::vector<std::string> const &Streams() const { return streams_; }
+
+ private:
+  std::vector<std::string> streams_;
+};
+
+/// Called by streams when the calling process would block. If the process
+/// runs as a cooperative task, suspends it until ready() holds and returns
+/// true. Returns false if the caller is not a cooperative task and has to
+/// block by itself. Tasks for which preferred() holds are resumed before
+/// tasks that are merely ready, which avoids thrashing between processes of a
+/// full pipeline. The name identifies the stream in deadlock reports. Throws
+/// an exception only Dataflow catches if the task is cancelled while
+/// suspended, which unwinds the stack of the process.
+bool DataflowWait(std::function<bool()> const &ready,
+                  std::function<bool()> const &preferred,
+                  std::string const &name);
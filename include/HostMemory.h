@@ -0,0 +1,105 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+/// Alignment of host buffers. The OpenCL runtime transfers page-aligned host
+/// memory to and from the device directly, while unaligned memory is first
+/// copied through an aligned bounce buffer.
+constexpr size_t kHostAlignment = 4096;
+
+/// Size of the huge pages backing large blocks when huge pages are enabled
+constexpr size_t kHostHugePageSize = 2 << 20;
+
+/// Default bound on the free bytes an arena keeps for reuse
+constexpr size_t kHostFreeBytesMax = size_t(1) << 30;
+
+/// Pool of page-aligned host memory. Freed blocks are kept and handed out
+/// again to later allocations of a similar size, such that buffers allocated
+/// over and over, e.g., for every job, are neither returned to the operating
+/// system nor faulted in again. When huge pages are enabled, blocks of at
+/// least kHostHugePageSize bytes are backed by transparent huge pages, which
+/// reduces TLB misses and the cost of pinning the pages of large transfers.
+/// The free blocks are bounded in total size: once they exceed the bound, the
+/// largest free blocks are returned to the operating system, so allocations of
+/// ever-changing sizes do not grow the pool without limit. Thread-safe.
+class HostArena {
+
+public:
+  explicit HostArena(bool hugePages, size_t freeBytesMax = kHostFreeBytesMax);
+
+  /// Frees every block, including blocks that are still in use.
+  ~HostArena();
+
+  HostArena(HostArena const &) = delete;
+  HostArena &operator=(HostArena const &) = delete;
+
+  /// Returns a block of at least the given size aligned to kHostAlignment,
+  /// reusing a free block if one of at most twice the size is available.
+  void *Allocate(size_t bytes);
+
+  /// Returns a block obtained from Allocate to the pool, and returns the
+  /// largest free blocks to the operating system while the free blocks exceed
+  /// the bound of the arena. Throws std::invalid_argument if the block is not
+  /// in use, i.e., if it was allocated elsewhere or was already freed.
+  void Deallocate(void *block);
+
+  /// Returns every free block to the operating system.
+  void Trim();
+
+  /// Bytes held by the pool, both in use and free.
+  size_t BytesReserved() const;
+
+  /// Bytes held by the pool in free blocks, at most the bound of the arena.
+  size_t BytesFree() const;
+
+  /// The arena backing AlignedAllocator, which uses huge pages if
+  /// STENCIL_HOST_HUGE_PAGES is enabled. It is never destroyed, so buffers
+  /// can safely be released during static destruction.
+  static HostArena &Global();
+
+private:
+  bool hugePages_;
+  size_t freeBytesMax_;
+  mutable std::mutex mutex_;
+  std::multimap<size_t, void *> free_;
+  std::unordered_map<void *, size_t> used_;
+  size_t reserved_{0};
+  size_t freeBytes_{0};
+};
+
+/// Standard allocator drawing page-aligned memory from the global arena.
+template <typename T>
+class AlignedAllocator {
+
+public:
+  using value_type = T;
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(AlignedAllocator<U> const &) {}
+
+  T *allocate(const size_t n) {
+    return static_cast<T *>(HostArena::Global().Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *const pointer, size_t) {
+    HostArena::Global().Deallocate(pointer);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(AlignedAllocator<T> const &, AlignedAllocator<U> const &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(AlignedAllocator<T> const &, AlignedAllocator<U> const &) {
+  return false;
+}
@@ -0,0 +1,15 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <ostream>
+#include <string>
+
+/// Writes the value as a quoted JSON string, escaping quotes, backslashes and
+/// control characters.
+void WriteJsonString(std::ostream &stream, std::string const &value);
+
+/// Writes the value as a JSON number with the precision of the stream, or as
+/// null if it is infinite or not a number, which JSON cannot represent.
+void WriteJsonNumber(std::ostream &stream, double value);
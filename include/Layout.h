@@ -0,0 +1,127 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include "Stencil.h"
+#include <vector>
+
+// Device layout: a batch of grids is stored as consecutive ping-pong buffers,
+// each holding two grids of rows x cols values packed into memory words. With
+// multiple banks, rows are interleaved in groups of kBankRows rows, and bank k
+// holds every row r with (r / kBankRows) % banks == k of every grid, such that
+// each bank holds a contiguous ping-pong buffer of rows / banks rows per grid.
+// The kernel reads the first half of a ping-pong buffer, and the result is in
+// the second half after an odd number of folded passes. A single buffer is
+// the layout of one bank.
+//
+// The conversions below split the rows between one thread per core, and copy
+// each row as a contiguous array of values.
+
+/// Zero-copy view of one grid of a batch stored in the device layout, which
+/// is valid as long as the underlying buffers are. Every row of the grid is a
+/// contiguous run of cols / kMemoryWidth memory words in its bank.
+class GridView {
+
+public:
+  /// View of the half of the ping-pong buffer of the given grid that holds
+  /// the result after the given number of timesteps.
+  GridView(std::vector<Memory_t *> const &banks, long rows, long cols,
+           long grid, long timesteps);
+
+  long rows() const { return rows_; }
+
+  long cols() const { return cols_; }
+
+  /// First memory word of the given row
+  Memory_t *Row(const long row) const {
+    const long banks = banks_.size();
+    return banks_[RowBank(row, banks)] +
+           (offset_ + BankRow(row, banks)) * memoryCols_;
+  }
+
+  Data_t Get(const long row, const long col) const {
+    return Row(row)[col / kMemoryWidth][(col % kMemoryWidth) / kKernelWidth]
+                   [col % kKernelWidth];
+  }
+
+  void Set(const long row, const long col, const Data_t value) const {
+    Row(row)[col / kMemoryWidth][(col % kMemoryWidth) / kKernelWidth]
+            [col % kKernelWidth] = value;
+  }
+
+private:
+  std::vector<Memory_t *> banks_;
+  long rows_;
+  long cols_;
+  long memoryCols_;
+  /// Row of the view within each bank
+  long offset_;
+};
+
+/// Copies count consecutive values out of memory words, starting at the first
+/// value of the first word.
+void UnpackValues(Memory_t const *words, Data_t *values, long count);
+
+/// Pointers to the first word of every buffer, in the form taken by the
+/// conversions.
+std::vector<Memory_t *> BankPointers(std::vector<HostBuffer_t> &banks);
+
+std::vector<Memory_t const *> BankPointers(
+    std::vector<HostBuffer_t> const &banks);
+
+/// Copies row-major grids into the first half of their ping-pong buffers in
+/// the given banks, which must hold the whole batch. Uses the given number of
+/// threads, or one per core if 0.
+void PackGrids(std::vector<std::vector<Data_t>> const &grids,
+               std::vector<Memory_t *> const &banks, long rows, long cols,
+               int threads = 0);
+
+/// Copies the grids of a batch out of the given banks after the given number
+/// of timesteps into row-major grids, which must already have the size of
+/// the batch. The inverse of PackGrids.
+void UnpackGrids(std::vector<Memory_t const *> const &banks,
+                 std::vector<std::vector<Data_t>> &grids, long rows,
+                 long cols, long timesteps, int threads = 0);
+
+/// Copies rowsTotal rows of ping-pong buffers of rows x cols grids between
+/// device layouts of different numbers of banks, e.g., from a single buffer
+/// to one buffer per bank.
+void CopyLayout(std::vector<Memory_t const *> const &from,
+                std::vector<Memory_t *> const &to, long rowsTotal, long rows,
+                long cols, int threads = 0);
+
+/// Splits a ping-pong buffer of two grids into one buffer per bank, such that
+/// bank k holds every row r with RowBank(r, kDimms) == k of both grids. A batch of
+/// ping-pong buffers stored back to back is split grid by grid.
+std::vector<HostBuffer_t> SplitBanks(HostBuffer_t const &host, long rows,
+                                     long cols);
+
+/// Reassembles both grids of the ping-pong buffer from the buffers of each
+/// bank. The inverse of SplitBanks.
+HostBuffer_t MergeBanks(std::vector<HostBuffer_t> const &banks, long rows,
+                        long cols);
+
+/// Packs a batch of grids of rows x cols values into consecutive ping-pong
+/// buffers, with every grid in the first half of its buffer
+HostBuffer_t PackBatch(std::vector<std::vector<Data_t>> const &grids,
+                       long rows, long cols);
+
+/// Extracts the grids of a batch after the given number of timesteps, which
+/// are in the second half of their ping-pong buffer for an odd number of
+/// folded passes. The inverse of PackBatch.
+std::vector<std::vector<Data_t>> UnpackBatch(HostBuffer_t const &packed,
+                                             long rows, long cols,
+                                             long timesteps);
+
+/// Packs a batch of grids directly into the buffers of each bank, which is
+/// equivalent to SplitBanks(PackBatch(grids, rows, cols), rows, cols) without
+/// staging the whole batch in a single buffer first
+std::vector<HostBuffer_t> PackBanks(
+    std::vector<std::vector<Data_t>> const &grids, long rows, long cols);
+
+/// Extracts the grids of a batch directly from the buffers of each bank after
+/// the given number of timesteps. The inverse of PackBanks.
+std::vector<std::vector<Data_t>> UnpackBanks(
+    std::vector<HostBuffer_t> const &banks, long rows, long cols,
+    long timesteps);
@@ -4,43 +4,148 @@
 #pragma once
 
 #include "Stencil.h"
-#include "hlslib/xilinx/Stream.h"
+#include "SpscStream.h"
 
 #ifdef STENCIL_SYNTHESIS
 
-// Single DIMM
-void Read(Memory_t const *memory, hlslib::Stream<Kernel_t> &toKernel);
+// Single DIMM, inserting the values of Dirichlet edges from the boundary
+// buffer, and reading from the half of the ping-pong buffer of the first pass
+void Read(Memory_t const *memory, Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &readCounters,
+                           Stream_t<Counters_t> &widenCounters,)
+          int boundaryModes, int grids, int rows, int cols, int blocks,
+          int timesteps, int firstPass);
 
-// Dual DIMM
-void Read(Memory_t const *memory0, Memory_t const *memory1,
-          hlslib::Stream<Kernel_t> &toKernel);
+// Multi-bank: reads the rows held by the given bank
+void ReadBank(Memory_t const *memory, Stream_t<Memory_t> &toMerge,
+              STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+              int bank, int boundaryModes, int grids, int rows, int cols,
+              int blocks, int timesteps, int firstPass);
 
-// Single DIMM
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory);
+// Multi-bank: merges the rows read from all banks into the kernel stream,
+// inserting the values of Dirichlet edges from the boundary buffer
+void Read(Stream_t<Memory_t> fromBanks[kDimms], Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &widenCounters,)
+          int boundaryModes, int grids, int rows, int cols, int blocks,
+          int timesteps);
 
-// Dual DIMM
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory0,
-           Memory_t *memory1);
+// Single DIMM, writing to the half of the ping-pong buffer of the first pass
+void Write(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+           STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+           int grids, int rows, int cols, int blocks, int timesteps,
+           int firstPass);
+
+// Multi-bank: distributes the rows of the kernel stream between banks
+void Write(Stream_t<Kernel_t> &fromKernel,
+           Stream_t<Memory_t> toBanks[kDimms], int grids, int rows,
+           int cols, int blocks, int timesteps);
+
+// Multi-bank: writes the rows held by a single bank
+void WriteBank(Stream_t<Memory_t> &fromMux, Memory_t *memory,
+               STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+               int grids, int rows, int cols, int blocks, int timesteps,
+               int firstPass);
+
+// Writes the residual of every folded pass of every grid computed by the
+// last stage, where the passes streamed start at the given first pass of all
+// passes of the kernel
+void WriteResidual(Stream_t<Residual_t> &fromKernel, Residual_t *memory,
+                   int grids, int timesteps, int firstPass, int passes);
+
+#ifdef STENCIL_ENABLE_COUNTERS
+// Writes the counters reported by every process to the counter buffer, where
+// only the first banks are in use, adding to those of earlier passes unless
+// the first pass is zero
+void WriteCounters(Stream_t<Counters_t> readCounters[kDimms],
+                   Stream_t<Counters_t> &widenCounters,
+                   Stream_t<Counters_t> computeCounters[kDepth],
+                   Stream_t<Counters_t> writeCounters[kDimms],
+                   Counter_t *memory, int banks, int firstPass);
+#endif
+
+// Three-dimensional
+void Read3D(Memory_t const *memory, Stream_t<Kernel_t> &toKernel,
+            int planes, int rows, int cols, int rowBlocks, int blocks,
+            int timesteps);
+
+// Three-dimensional
+void Write3D(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+             int planes, int rows, int cols, int rowBlocks, int blocks,
+             int timesteps);
 
 #else
 
-#include <thread>
+#include "Dataflow.h"
 
-// Single DIMM
-void Read(Memory_t const *memory, hlslib::Stream<Kernel_t> &toKernel,
-          std::vector<std::thread> &threads);
+// Single DIMM, inserting the values of Dirichlet edges from the boundary
+// buffer, and reading from the half of the ping-pong buffer of the first pass
+void Read(Memory_t const *memory, Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &readCounters,
+                           Stream_t<Counters_t> &widenCounters,)
+          int boundaryModes, int grids, int rows, int cols, int blocks,
+          int timesteps, int firstPass, Dataflow &dataflow);
 
-// Dual DIMM
-void Read(Memory_t const *memory0, Memory_t const *memory1,
-          hlslib::Stream<Kernel_t> &toKernel,
-          std::vector<std::thread> &threads);
+// Multi-bank: reads the rows held by the given bank
+void ReadBank(Memory_t const *memory, Stream_t<Memory_t> &toMerge,
+              STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+              int bank, int boundaryModes, int grids, int rows, int cols,
+              int blocks, int timesteps, int firstPass, Dataflow &dataflow);
+
+// Multi-bank: merges the rows read from all banks into the kernel stream,
+// inserting the values of Dirichlet edges from the boundary buffer
+void Read(Stream_t<Memory_t> fromBanks[kDimms], Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &widenCounters,)
+          int boundaryModes, int grids, int rows, int cols, int blocks,
+          int timesteps, Dataflow &dataflow);
+
+// Single DIMM, writing to the half of the ping-pong buffer of the first pass
+void Write(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+           STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+           int grids, int rows, int cols, int blocks, int timesteps,
+           int firstPass, Dataflow &dataflow);
+
+// Multi-bank: distributes the rows of the kernel stream between banks
+void Write(Stream_t<Kernel_t> &fromKernel,
+           Stream_t<Memory_t> toBanks[kDimms], int grids, int rows,
+           int cols, int blocks, int timesteps, Dataflow &dataflow);
+
+// Multi-bank: writes the rows held by a single bank
+void WriteBank(Stream_t<Memory_t> &fromMux, Memory_t *memory,
+               STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+               int grids, int rows, int cols, int blocks, int timesteps,
+               int firstPass, Dataflow &dataflow);
+
+// Writes the residual of every folded pass of every grid computed by the
+// last stage, where the passes streamed start at the given first pass of all
+// passes of the kernel
+void WriteResidual(Stream_t<Residual_t> &fromKernel, Residual_t *memory,
+                   int grids, int timesteps, int firstPass, int passes,
+                   Dataflow &dataflow);
+
+#ifdef STENCIL_ENABLE_COUNTERS
+// Writes the counters reported by every process to the counter buffer, where
+// only the first banks are in use, adding to those of earlier passes unless
+// the first pass is zero
+void WriteCounters(Stream_t<Counters_t> readCounters[kDimms],
+                   Stream_t<Counters_t> &widenCounters,
+                   Stream_t<Counters_t> computeCounters[kDepth],
+                   Stream_t<Counters_t> writeCounters[kDimms],
+                   Counter_t *memory, int banks, int firstPass,
+                   Dataflow &dataflow);
+#endif
 
-// Single DIMM
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory,
-           std::vector<std::thread> &threads);
+// Three-dimensional
+void Read3D(Memory_t const *memory, Stream_t<Kernel_t> &toKernel,
+            int planes, int rows, int cols, int rowBlocks, int blocks,
+            int timesteps, Dataflow &dataflow);
 
-// Dual DIMM
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory0,
-           Memory_t *memory1, std::vector<std::thread> &threads);
+// Three-dimensional
+void Write3D(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+             int planes, int rows, int cols, int rowBlocks, int blocks,
+             int timesteps, Dataflow &dataflow);
 
 #endif
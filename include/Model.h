@@ -0,0 +1,92 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+/// Performance and resource model of the two-dimensional kernel for arbitrary
+/// configurations, used by Stats and the host for the compiled configuration
+/// (see CyclesRequired in Stencil.h) and by Explore to search the design
+/// space. Each design point corresponds to the CMake
+/// cache variables STENCIL_DEPTH, STENCIL_KERNEL_WIDTH, STENCIL_MEMORY_WIDTH,
+/// STENCIL_BLOCKS and STENCIL_DIMMS.
+struct DesignPoint {
+  long depth;
+  long kernelWidth;
+  long memoryWidth;
+  long blocks;
+  long dimms;
+};
+
+constexpr long ModelCeilDivide(const long a, const long b) {
+  return (a + b - 1) / b;
+}
+
+constexpr long ModelBlockWidthKernel(DesignPoint const &d, const long cols) {
+  return (cols / d.blocks) / d.kernelWidth;
+}
+
+constexpr long ModelHaloKernel(DesignPoint const &d, const long radius) {
+  return ModelCeilDivide(radius * d.depth, d.kernelWidth);
+}
+
+constexpr long ModelHaloMemory(DesignPoint const &d, const long radius) {
+  return ModelCeilDivide(radius * d.depth, d.memoryWidth);
+}
+
+/// Elements held in the line buffers of all stages
+template <typename Stencil>
+constexpr unsigned long ModelBufferSpace(DesignPoint const &d,
+                                         const long cols) {
+  return (d.blocks == 1)
+             ? (d.depth * Stencil::kLineBuffers *
+                ModelBlockWidthKernel(d, cols) * d.blocks * d.kernelWidth)
+             : (Stencil::kLineBuffers *
+                (d.depth * ModelBlockWidthKernel(d, cols) * d.kernelWidth +
+                 Stencil::kRadius * d.depth * d.depth +
+                 Stencil::kRadius * d.depth));
+}
+
+/// Cycles spent on the given problem size, excluding pipeline latency. Every
+/// block streams the given number of boundary rows beyond the top and bottom
+/// edge on top of the rows of the grid. With a barrier between passes, every
+/// pass but the last additionally drains the pipeline. The grids of a batch
+/// are streamed back to back, so the latency is only paid once per batch.
+template <typename Stencil>
+constexpr unsigned long ModelCycles(DesignPoint const &d, const long rows,
+                                    const long cols, const long timesteps,
+                                    const long boundaryRows,
+                                    const bool barrier, const long grids = 1) {
+  return (ModelBlockWidthKernel(d, cols) +
+          2 * ModelHaloKernel(d, Stencil::kRadius)) *
+             (rows + boundaryRows) * d.blocks *
+             ModelCeilDivide(timesteps, d.depth) * grids +
+         (barrier ? (ModelCeilDivide(timesteps, d.depth) - 1) * d.depth *
+                        (Stencil::kRadius *
+                             (ModelBlockWidthKernel(d, cols) +
+                              2 * ModelHaloKernel(d, Stencil::kRadius)) +
+                         1)
+                  : 0);
+}
+
+/// Fraction of cycles spent on cells that are not part of a halo
+template <typename Stencil>
+constexpr float ModelEfficiency(DesignPoint const &d, const long cols) {
+  return (d.blocks == 1)
+             ? 1
+             : ModelBlockWidthKernel(d, cols) /
+                   static_cast<float>(ModelBlockWidthKernel(d, cols) +
+                                      2 * ModelHaloKernel(d, Stencil::kRadius));
+}
+
+template <typename Stencil>
+constexpr long ModelOpsPerCycle(DesignPoint const &d) {
+  return d.depth * d.kernelWidth * Stencil::kOperations;
+}
+
+/// Memory bandwidth in GB/s required to read and write one vector of the
+/// kernel width every cycle at the given clock rate in MHz
+constexpr double ModelBandwidthRequired(DesignPoint const &d,
+                                        const long dataBytes,
+                                        const double clock) {
+  return 2 * d.kernelWidth * dataBytes * 1e-3 * clock;
+}
@@ -0,0 +1,117 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include "Stencil.h"
+#include <chrono>
+#include <future>
+#include <vector>
+
+/// Rows of the domain that are advanced by one folded pass on the device. The
+/// strip is extended by a halo on every side that is not an edge of the
+/// domain, which absorbs the error introduced by the artificial boundary at
+/// the edges of the strip.
+struct Strip {
+  /// First row transferred to the device
+  int begin;
+  /// Rows transferred to the device, including the halos
+  int rows;
+  /// First row written back to the domain, relative to begin
+  int innerBegin;
+  /// Rows written back to the domain
+  int innerRows;
+};
+
+/// Offsets and sizes of the transfers of a strip in memory words, which are
+/// the same for every bank. The host holds a ping-pong buffer of the full
+/// domain, and the device a ping-pong buffer of the strip.
+struct StripTransfer {
+  long inputHost;
+  long inputWords;
+  long outputDevice;
+  long outputHost;
+  long outputWords;
+};
+
+/// Seconds spent in each part of an out-of-core execution. Transfers overlap
+/// with kernel execution, so the total is less than the sum of the parts when
+/// the transfers are hidden.
+struct OutOfCoreTiming {
+  double upload;
+  double execute;
+  double download;
+  double total;
+};
+
+/// Rows of the halo on either side of a strip. Every timestep propagates the
+/// error of the artificial boundary by the radius of the stencil, so a folded
+/// pass needs kRadius * kDepth rows, rounded up to whole groups of rows of
+/// every bank.
+int StripHalo();
+
+/// Splits the rows of the domain into strips of at most stripRows rows that
+/// are written back, extended by the halo.
+std::vector<Strip> MakeStrips(int rows, int stripRows);
+
+/// Most rows transferred by any strip, which determines the device memory
+/// required.
+int StripRowsMax(std::vector<Strip> const &strips);
+
+/// Throws if the domain cannot be executed in strips of the given rows.
+void ValidateOutOfCore(int rows, int cols, int blocks, int timesteps,
+                       int stripRows, int boundaryModes);
+
+/// Boundary of a strip, which takes the edges of the domain where the strip
+/// touches them, and a constant Dirichlet boundary at the halos.
+Boundary StripBoundary(Boundary const &boundary, Strip const &strip);
+
+/// Transfers of a strip in the given sweep over the domain. Sweeps alternate
+/// between the halves of the host ping-pong buffer, while every strip is
+/// advanced by a single folded pass from the first into the second half of
+/// the device buffer.
+StripTransfer MakeStripTransfer(Strip const &strip, int rows, int cols,
+                                int banks, int sweep);
+
+/// Runs the given number of sweeps over the strips. Consecutive strips
+/// alternate between two slots on the device, such that the result of the
+/// previous strip is downloaded and the next strip is uploaded while the
+/// kernel executes on the current strip. Every function is called with the
+/// index of the strip, its slot and the sweep.
+template <typename Upload, typename Execute, typename Download>
+OutOfCoreTiming RunOutOfCore(std::vector<Strip> const &strips,
+                             const int sweeps, Upload const &upload,
+                             Execute const &execute,
+                             Download const &download) {
+  using Clock = std::chrono::steady_clock;
+  OutOfCoreTiming timing{0, 0, 0, 0};
+  const auto Timed = [](double &elapsed, auto const &f) {
+    const auto begin = Clock::now();
+    f();
+    elapsed += std::chrono::duration<double>(Clock::now() - begin).count();
+  };
+  const int n = strips.size();
+  const auto begin = Clock::now();
+  for (int sweep = 0; sweep < sweeps; ++sweep) {
+    Timed(timing.upload, [&]() { upload(0, 0, sweep); });
+    for (int i = 0; i < n; ++i) {
+      // The transfers only touch the other slot, and only the timing of the
+      // transfers, so they can proceed alongside the kernel
+      auto transfers = std::async(std::launch::async, [&, i]() {
+        if (i > 0) {
+          Timed(timing.download,
+                [&]() { download(i - 1, (i - 1) % 2, sweep); });
+        }
+        if (i + 1 < n) {
+          Timed(timing.upload, [&]() { upload(i + 1, (i + 1) % 2, sweep); });
+        }
+      });
+      Timed(timing.execute, [&]() { execute(i, i % 2, sweep); });
+      transfers.get();
+    }
+    // Every strip of the next sweep depends on its neighbors in this sweep
+    Timed(timing.download, [&]() { download(n - 1, (n - 1) % 2, sweep); });
+  }
+  timing.total = std::chrono::duration<double>(Clock::now() - begin).count();
+  return timing;
+}
@@ -5,6 +5,102 @@
 #pragma once
 
 #include "Stencil.h"
+#include <array>
+#include <ostream>
 #include <vector>
 
-std::vector<Data_t> Reference(std::vector<Data_t> const &input);
+/// Uses a constant Dirichlet boundary of kBoundary on every edge
+std::vector<Data_t> Reference(std::vector<Data_t> const &input, int rows,
+                              int cols, int timesteps);
+
+std::vector<Data_t> Reference(std::vector<Data_t> const &input, int rows,
+                              int cols, int timesteps,
+                              Boundary const &boundary);
+
+std::vector<Data_t> Reference3D(std::vector<Data_t> const &input, int planes,
+                                int rows, int cols, int timesteps);
+
+/// Errors accepted when verifying results. A cell matches if its absolute
+/// error is at most absolute + relative * |reference|, or if it is at most the
+/// given number of units in the last place (ulps) of Data_t away from the
+/// reference. Zero disables the relative and ulp tolerances.
+struct Tolerance {
+  Tolerance(const double absolute, const double relative = 0,
+            const long ulps = 0)
+      : absolute(absolute), relative(relative), ulps(ulps) {}
+  double absolute;
+  double relative;
+  long ulps;
+};
+
+/// Buckets of the histogram of distances in ulps. Bucket 0 counts exact
+/// matches, bucket 1 distances of up to one ulp, bucket b > 1 distances in
+/// (2^(b - 2), 2^(b - 1)], and the last bucket every larger distance and NaNs.
+constexpr int kUlpBuckets = 16;
+
+/// Number of cells with the largest errors kept by the verifier
+constexpr int kWorstCells = 8;
+
+struct ErrorLocation {
+  int row;
+  int col;
+  double expected;
+  double actual;
+  double error;
+};
+
+/// Error of a result computed by the kernel relative to the reference
+struct ErrorStatistics {
+  long cells;
+  /// Largest absolute error
+  double maxAbsolute;
+  /// Largest absolute error divided by the magnitude of the reference value,
+  /// ignoring reference values of zero
+  double maxRelative;
+  /// Root mean square of the absolute error
+  double rms;
+  /// Largest distance in units in the last place of Data_t
+  double maxUlps;
+  /// Number of cells whose error exceeds the tolerance
+  long mismatches;
+  /// Index of the first mismatching cell, or -1 if there is none
+  long firstMismatch;
+  Tolerance tolerance;
+  std::array<long, kUlpBuckets> ulpHistogram;
+  /// Cells with the largest absolute errors, largest first, with NaNs ranked
+  /// above every other error
+  std::vector<ErrorLocation> worst;
+};
+
+/// Difference between 1 and the next larger value representable by Data_t
+double DataEpsilon();
+
+/// Smallest positive value representable by Accumulate_t, which bounds the
+/// error of every value rounded to a fixed point accumulation type
+double AccumulationResolution();
+
+/// Largest absolute error accepted when verifying results. This is
+/// STENCIL_VERIFY_ABSOLUTE if set, and otherwise 1e-4 for single and double
+/// precision, and a few units in the last place around 1 for narrower data
+/// types.
+double VerifyTolerance();
+
+/// Tolerance of verification, combining VerifyTolerance with the relative and
+/// ulp tolerances STENCIL_VERIFY_RELATIVE and STENCIL_VERIFY_ULPS.
+Tolerance DefaultTolerance();
+
+/// Compares rows x cols values stored in the memory layout of the kernel,
+/// starting at the given word, against the reference. The cells are split
+/// between one thread per core.
+ErrorStatistics CompareResult(std::vector<Data_t> const &reference,
+                              Memory_t const *result, int rows, int cols,
+                              Tolerance const &tolerance);
+
+/// Prints the statistics on a single line.
+void PrintErrorStatistics(std::ostream &stream,
+                          ErrorStatistics const &statistics);
+
+/// Prints the histogram of distances in ulps and the cells with the largest
+/// errors, one per line.
+void PrintErrorDetails(std::ostream &stream,
+                       ErrorStatistics const &statistics);
@@ -0,0 +1,171 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include "hlslib/xilinx/SDAccel.h"
+#include "Stencil.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using DeviceBuffer_t =
+    hlslib::ocl::Buffer<Memory_t, hlslib::ocl::Access::readWrite>;
+using ResidualBuffer_t =
+    hlslib::ocl::Buffer<Residual_t, hlslib::ocl::Access::readWrite>;
+using CounterBuffer_t =
+    hlslib::ocl::Buffer<Counter_t, hlslib::ocl::Access::readWrite>;
+
+/// Device memory of a launch: the ping-pong buffers of a batch of grids split
+/// into one buffer per bank, the residual of every folded pass of every grid,
+/// the performance counters and the boundary. Pooled buffers can be larger
+/// than the launch requires.
+struct DeviceGrids {
+  std::vector<DeviceBuffer_t> banks;
+  ResidualBuffer_t residual;
+  CounterBuffer_t counters;
+  DeviceBuffer_t boundary;
+  /// Capacity of each buffer of banks in memory words
+  long bankWords;
+  /// Capacity of the residual buffer in folded passes
+  long residuals;
+  /// Capacity of the boundary buffer in memory words
+  long boundaryWords;
+};
+
+/// Device memory taken from the pool of a runtime, which returns to the pool
+/// when the last copy is destroyed. Must not outlive the runtime.
+using DeviceLease_t = std::shared_ptr<DeviceGrids>;
+
+/// Grids of the same size advanced by a single launch of the kernel, which
+/// all share the same boundary conditions.
+struct Job {
+  std::vector<std::vector<Data_t>> grids;
+  Boundary boundary;
+  int rows;
+  int cols;
+  int blocks;
+  int timesteps;
+};
+
+/// Seconds spent by a job in each phase. Uploads include packing the grids
+/// into the memory layout of the kernel, and downloads include unpacking them.
+/// The latency runs from submission to completion, including the time spent
+/// waiting in the queue.
+struct JobTiming {
+  double queued;
+  double upload;
+  double execute;
+  double download;
+  double latency;
+};
+
+struct JobResult {
+  /// Grids after the timesteps of the job
+  std::vector<std::vector<Data_t>> grids;
+  /// Residual of every folded pass, stored grid by grid
+  std::vector<Residual_t> residual;
+  /// Performance counters of the launch, which are only read back if counters
+  /// are enabled
+  std::vector<Counter_t> counters;
+  JobTiming timing;
+};
+
+/// Host side of the kernel, which loads the program once and keeps it loaded
+/// for every launch. Device memory is pooled, so launches of the same or a
+/// smaller size reuse the buffers of previous launches instead of allocating
+/// new ones. Jobs submitted to the queue are executed one at a time in
+/// submission order by a worker thread, which uploads the next job and
+/// downloads the previous job while it has handed the current one to a second
+/// long-lived thread that executes the kernel.
+class Runtime {
+
+public:
+  /// Loads the given bitstream, which defaults to the kernel of this build.
+  explicit Runtime(std::string const &path = kKernelString +
+                                             std::string(".xclbin"));
+
+  /// Finishes every job in the queue before returning.
+  ~Runtime();
+
+  Runtime(Runtime const &) = delete;
+  Runtime &operator=(Runtime const &) = delete;
+
+  /// Device memory for a batch of the given number of grids, taken from the
+  /// pool if a pooled set of buffers is large enough, and allocated otherwise.
+  DeviceLease_t Acquire(int grids, int rows, int cols, int timesteps);
+
+  /// Kernel operating on the given device memory, using whichever of Jacobi
+  /// and JacobiBanks this build targets. Throws if the device memory is too
+  /// small for the launch.
+  hlslib::ocl::Kernel MakeKernel(DeviceGrids &device, int boundaryModes,
+                                 int grids, int rows, int cols, int blocks,
+                                 int timesteps);
+
+  /// Appends the job to the queue. Throws if the job is invalid; errors
+  /// during execution are reported through the future.
+  std::future<JobResult> Submit(Job job);
+
+  /// Number of times device memory was allocated rather than reused.
+  int Allocations() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending {
+    Job job;
+    std::promise<JobResult> promise;
+    Clock::time_point submitted;
+  };
+
+  /// Job taken from the queue, with the state carried between its phases
+  struct Staged {
+    Pending pending;
+    DeviceLease_t device;
+    std::vector<HostBuffer_t> hostBanks;
+    JobResult result;
+    std::exception_ptr error;
+  };
+
+  /// Takes the next job from the queue, waiting for one to be submitted if
+  /// requested. Returns nullptr if there is no job, or if the runtime is
+  /// being destroyed and the queue is empty.
+  std::unique_ptr<Staged> Next(bool wait);
+
+  void Upload(Staged &staged);
+
+  void Execute(Staged &staged);
+
+  /// Downloads the result and fulfils the promise of the job.
+  void Complete(Staged &staged);
+
+  void Work();
+
+  /// Executes the jobs handed over by Work until the runtime is destroyed.
+  void ExecuteJobs();
+
+  hlslib::ocl::Context context_;
+  hlslib::ocl::Program program_;
+  mutable std::mutex poolMutex_;
+  std::vector<std::unique_ptr<DeviceGrids>> pool_;
+  int allocations_{0};
+  std::mutex queueMutex_;
+  std::condition_variable queueCondition_;
+  std::deque<Pending> queue_;
+  bool stopping_{false};
+  std::thread worker_;
+  // Job handed from the worker to the executor, which is reset once the
+  // kernel has executed
+  std::mutex executeMutex_;
+  std::condition_variable executeCondition_;
+  Staged *executing_{nullptr};
+  bool executorStopping_{false};
+  std::thread executor_;
+};
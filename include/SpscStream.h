@@ -0,0 +1,379 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include "hlslib/xilinx/Stream.h"
+
+#if defined(STENCIL_SYNTHESIS) || !defined(STENCIL_SPSC_STREAMS)
+
+/// Stream type used by all processes of the kernel. Synthesis always uses the
+/// hlslib stream, which maps to a hardware FIFO.
+template <typename T, unsigned depth = 0>
+using Stream_t = hlslib::Stream<T, depth>;
+
+/// Only simulation streams carry names
+template <typename Stream, size_t n>
+void NameStreams(Stream (&)[n], char const *) {}
+
+/// Pushes the given values in order. The hlslib stream has no batched
+/// operations, so they are pushed one at a time.
+template <typename T, unsigned depth>
+void PushN(hlslib::Stream<T, depth> &stream, T const *values, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    stream.Push(values[i]);
+  }
+}
+
+/// Pops the given number of values in order, one at a time
+template <typename T, unsigned depth>
+void PopN(hlslib::Stream<T, depth> &stream, T *values, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = stream.Pop();
+  }
+}
+
+#else
+
+#include "Dataflow.h"
+#include "StreamStatistics.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef STENCIL_SPSC_DEFAULT_DEPTH
+#define STENCIL_SPSC_DEFAULT_DEPTH 64
+#endif
+
+/// Lock-free single-producer/single-consumer ring buffer used in place of
+/// hlslib::Stream in simulation. Every stream has exactly one producer and
+/// one consumer process (or a single process acting as both for line
+/// buffers), each running as a thread or as a cooperative task of Dataflow.
+///
+/// The read and write indices live on separate cache lines, and each side
+/// keeps a cached copy of the other side's index, which is only refreshed when
+/// the ring appears full or empty. A blocked cooperative task is suspended by
+/// the scheduler. A blocked thread spins briefly, yields, and finally parks on
+/// a condition variable until it is woken by the other side. PushN and PopN
+/// move as many values as fit at once, and publish the index and check for a
+/// parked side once per batch rather than once per value. They are offered to
+/// host code and tests: the processes of the kernel move one word per
+/// iteration of their pipelined loops, which is also what their counters and
+/// stall statistics sample.
+///
+/// With STENCIL_STREAM_STATISTICS, the producer additionally tracks the
+/// occupancy after every push and the pushes that found the stream full, the
+/// consumer the pops that found it empty, and the stream records them under
+/// its name when it is destroyed. The capacity can then be capped by name at
+/// runtime (see StreamStatistics.h).
+template <typename T, unsigned depth = 0>
+class SpscStream {
+
+ public:
+  SpscStream() : SpscStream("(unnamed)") {}
+
+  explicit SpscStream(char const *name) : SpscStream(std::string(name)) {}
+
+  explicit SpscStream(std::string const &name)
+      : name_(name), mask_(RingSize(kCapacity) - 1),
+        buffer_(RingSize(kCapacity)) {
+#ifdef STENCIL_STREAM_STATISTICS
+    SetName(name);
+#endif
+  }
+
+  SpscStream(SpscStream const &) = delete;
+  SpscStream &operator=(SpscStream const &) = delete;
+
+#ifdef STENCIL_STREAM_STATISTICS
+  ~SpscStream() {
+    RecordStreamStatistics(StreamStatistics{name_, capacity_, 1, pushes_,
+                                            highWater_, fullStalls_,
+                                            emptyStalls_, histogram_});
+  }
+#endif
+
+  void Push(T const &value) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    WaitForSpace(tail);
+    buffer_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    RecordPushes(tail, 1);
+    Wake();
+  }
+
+  /// Pushes the given values in order, blocking until all have been pushed
+  void PushN(T const *values, const size_t n) {
+    for (size_t pushed = 0; pushed < n;) {
+      const auto tail = tail_.load(std::memory_order_relaxed);
+      WaitForSpace(tail);
+      const size_t count =
+          std::min(n - pushed, Capacity() - (tail - cachedHead_));
+      for (size_t i = 0; i < count; ++i) {
+        buffer_[(tail + i) & mask_] = values[pushed + i];
+      }
+      tail_.store(tail + count, std::memory_order_release);
+      RecordPushes(tail, count);
+      Wake();
+      pushed += count;
+    }
+  }
+
+  T Pop() {
+    const auto head = head_.load(std::memory_order_relaxed);
+    WaitForData(head);
+    T value = buffer_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    Wake();
+    return value;
+  }
+
+  /// Pops the given number of values in order, blocking until all have been
+  /// popped
+  void PopN(T *values, const size_t n) {
+    for (size_t popped = 0; popped < n;) {
+      const auto head = head_.load(std::memory_order_relaxed);
+      WaitForData(head);
+      const size_t count = std::min(n - popped, cachedTail_ - head);
+      for (size_t i = 0; i < count; ++i) {
+        values[popped + i] = buffer_[(head + i) & mask_];
+      }
+      head_.store(head + count, std::memory_order_release);
+      Wake();
+      popped += count;
+    }
+  }
+
+  T ReadBlocking() { return Pop(); }
+
+  void WriteBlocking(T const &value, int) { Push(value); }
+
+  /// The kernel only reads optimistically when data is guaranteed to be
+  /// available, so this never blocks in practice
+  T ReadOptimistic() { return Pop(); }
+
+  /// The kernel only writes optimistically when space is guaranteed to be
+  /// available, so this never blocks in practice
+  void WriteOptimistic(T const &value, int) { Push(value); }
+
+  bool IsEmpty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  bool IsFull() const { return Size() >= Capacity(); }
+
+  size_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  std::string const &name() const { return name_; }
+
+  /// Renames the stream, e.g., the elements of an array of streams, which
+  /// must happen before the stream is used
+  void SetName(std::string const &name) {
+    name_ = name;
+#ifdef STENCIL_STREAM_STATISTICS
+    const size_t cap = StreamDepth(name);
+    capacity_ = (cap > 0 && cap < kCapacity) ? cap : kCapacity;
+    histogram_.assign(StreamHistogramBucket(capacity_) + 1, 0);
+#endif
+  }
+
+ private:
+  static constexpr size_t kCapacity =
+      (depth > 0) ? depth : STENCIL_SPSC_DEFAULT_DEPTH;
+
+#ifdef STENCIL_STREAM_STATISTICS
+  size_t Capacity() const { return capacity_; }
+#else
+  static constexpr size_t Capacity() { return kCapacity; }
+#endif
+
+  static constexpr size_t kCacheLine = 64;
+
+  static size_t RingSize(const size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  /// Waits until the ring has space for the value at the given write index
+  void WaitForSpace(const size_t tail) {
+#ifdef STENCIL_STREAM_STATISTICS
+    if (tail - head_.load(std::memory_order_acquire) >= Capacity()) {
+      ++fullStalls_;
+    }
+#endif
+    if (tail - cachedHead_ >= Capacity()) {
+      Wait(
+          [&]() {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            return tail - cachedHead_ < Capacity();
+          },
+          [&]() {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            return tail - cachedHead_ <= Capacity() / 2;
+          });
+    }
+  }
+
+  /// Waits until the ring holds the value at the given read index
+  void WaitForData(const size_t head) {
+#ifdef STENCIL_STREAM_STATISTICS
+    if (head == tail_.load(std::memory_order_acquire)) {
+      ++emptyStalls_;
+    }
+#endif
+    if (head == cachedTail_) {
+      Wait(
+          [&]() {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            return head != cachedTail_;
+          },
+          [&]() {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            return cachedTail_ - head >= (Capacity() + 1) / 2;
+          });
+    }
+  }
+
+  /// Records the occupancy after each of the given number of values pushed
+  /// from the given write index
+  void RecordPushes(const size_t tail, const size_t count) {
+#ifdef STENCIL_STREAM_STATISTICS
+    const size_t head = head_.load(std::memory_order_acquire);
+    for (size_t i = 1; i <= count; ++i) {
+      const size_t occupancy = tail + i - std::min(head, tail + i);
+      highWater_ = std::max(highWater_, occupancy);
+      ++histogram_[StreamHistogramBucket(occupancy)];
+    }
+    pushes_ += count;
+#else
+    (void)tail;
+    (void)count;
+#endif
+  }
+
+  /// Spins, then yields, then parks until the ready predicate holds. The
+  /// preferred predicate holds once the ring is at least half empty (for the
+  /// producer) or half full (for the consumer), which lets the cooperative
+  /// scheduler move data in bursts rather than one element at a time.
+  template <typename Ready, typename Preferred>
+  void Wait(Ready const &ready, Preferred const &preferred) {
+    // The cached index of the other side is usually just stale
+    if (ready()) {
+      return;
+    }
+    TraceSpan span(name_, "wait");
+    // Cooperative tasks are suspended by the scheduler instead of blocking the
+    // worker thread they run on
+    if (DataflowWait(ready, preferred, name_)) {
+      return;
+    }
+    // Spinning only helps if the other side can run at the same time
+    static const int kSpins =
+        (std::thread::hardware_concurrency() > 1) ? 256 : 0;
+    static constexpr int kYields = 16;
+    for (int i = 0; i < kSpins; ++i) {
+      if (ready()) {
+        return;
+      }
+      Pause();
+    }
+    for (int i = 0; i < kYields; ++i) {
+      if (ready()) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    parked_.fetch_add(1, std::memory_order_relaxed);
+    // Pairs with the fence in Wake: either the other side sees this side
+    // parked and notifies it, or this side sees the index it stored
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!ready()) {
+      wake_.wait(lock);
+    }
+    parked_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /// Called after storing an index. The fence orders the release store of the
+  /// index before the load of the parked count, which the release store alone
+  /// does not, so a side that parks concurrently is never missed.
+  void Wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked_.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake_.notify_all();
+    }
+  }
+
+  std::string name_;
+  const size_t mask_;
+  std::vector<T> buffer_;
+
+  // Consumer side
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  size_t cachedTail_{0};
+
+  // Producer side
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t cachedHead_{0};
+
+#ifdef STENCIL_STREAM_STATISTICS
+  size_t capacity_{kCapacity};
+  long pushes_{0};
+  size_t highWater_{0};
+  long fullStalls_{0};
+  std::vector<long> histogram_;
+  // Only touched by the consumer
+  alignas(kCacheLine) long emptyStalls_{0};
+#endif
+
+  // Parking, only touched when a side blocks
+  alignas(kCacheLine) std::atomic<int> parked_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+};
+
+/// Stream type used by all processes of the kernel
+template <typename T, unsigned depth = 0>
+using Stream_t = SpscStream<T, depth>;
+
+/// Pushes the given values in order with a single batched push
+template <typename T, unsigned depth>
+void PushN(SpscStream<T, depth> &stream, T const *values, const size_t n) {
+  stream.PushN(values, n);
+}
+
+/// Pops the given number of values in order with a single batched pop
+template <typename T, unsigned depth>
+void PopN(SpscStream<T, depth> &stream, T *values, const size_t n) {
+  stream.PopN(values, n);
+}
+
+/// Gives every stream of an array the same name, under which they are
+/// reported in deadlocks and stream statistics
+template <typename Stream, size_t n>
+void NameStreams(Stream (&streams)[n], char const *name) {
+  for (auto &stream : streams) {
+    stream.SetName(name);
+  }
+}
+
+#endif
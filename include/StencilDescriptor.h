@@ -0,0 +1,183 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+/// Compile-time description of a stencil. A stencil is the weighted sum of a
+/// set of points in the neighborhood of each cell, multiplied by a common
+/// scale:
+///
+///   out(r, c) = scale * (w_0 * in(r + dr_0, c + dc_0) + ...)
+///
+/// Points are summed in the order they are specified, both in the kernel and in
+/// the reference implementation. Multiplications by unit weights and scales are
+/// elided at compile time, and count towards neither resources nor operations.
+///
+/// Coefficients are specified as ratios to keep them representable as template
+/// arguments, e.g., StencilRatio<1, 4> for 0.25. Three-dimensional stencils
+/// additionally offset points by plane using StencilPoint3D.
+
+template <long numerator, long denominator = 1>
+struct StencilRatio {
+  static_assert(denominator != 0, "Denominator cannot be zero.");
+  static constexpr double Value() {
+    return static_cast<double>(numerator) / denominator;
+  }
+  static constexpr bool IsUnit() { return numerator == denominator; }
+};
+
+constexpr int StencilAbs(const int x) { return (x < 0) ? -x : x; }
+
+constexpr int StencilMax(const int a, const int b) { return (a > b) ? a : b; }
+
+/// A single point of the neighborhood, given as plane, row and column offset
+/// relative to the cell being updated.
+template <int planeOffset, int rowOffset, int colOffset,
+          typename Weight = StencilRatio<1>>
+struct StencilPoint3D {
+  static constexpr int kPlaneOffset = planeOffset;
+  static constexpr int kRowOffset = rowOffset;
+  static constexpr int kColOffset = colOffset;
+  static constexpr int kRadius = StencilMax(
+      StencilAbs(planeOffset), StencilMax(StencilAbs(rowOffset),
+                                          StencilAbs(colOffset)));
+  /// Number of dimensions this point is offset in
+  static constexpr int kDistance = StencilAbs(planeOffset) +
+                                   StencilAbs(rowOffset) +
+                                   StencilAbs(colOffset);
+  using Weight_t = Weight;
+};
+
+/// A single point of a two-dimensional neighborhood, given as row and column
+/// offset relative to the cell being updated.
+template <int rowOffset, int colOffset, typename Weight = StencilRatio<1>>
+using StencilPoint = StencilPoint3D<0, rowOffset, colOffset, Weight>;
+
+template <typename... Points>
+struct StencilPointList;
+
+template <>
+struct StencilPointList<> {
+  static constexpr int PlaneOffset(int) { return 0; }
+  static constexpr int RowOffset(int) { return 0; }
+  static constexpr int ColOffset(int) { return 0; }
+  static constexpr double Weight(int) { return 0; }
+  static constexpr bool IsUnitWeight(int) { return true; }
+  static constexpr int Radius() { return 0; }
+  static constexpr int MaxDistance() { return 0; }
+  static constexpr int NonUnitWeights() { return 0; }
+};
+
+template <typename Point, typename... Points>
+struct StencilPointList<Point, Points...> {
+  using Next_t = StencilPointList<Points...>;
+  static constexpr int PlaneOffset(int i) {
+    return (i == 0) ? Point::kPlaneOffset : Next_t::PlaneOffset(i - 1);
+  }
+  static constexpr int RowOffset(int i) {
+    return (i == 0) ? Point::kRowOffset : Next_t::RowOffset(i - 1);
+  }
+  static constexpr int ColOffset(int i) {
+    return (i == 0) ? Point::kColOffset : Next_t::ColOffset(i - 1);
+  }
+  static constexpr double Weight(int i) {
+    return (i == 0) ? Point::Weight_t::Value() : Next_t::Weight(i - 1);
+  }
+  static constexpr bool IsUnitWeight(int i) {
+    return (i == 0) ? Point::Weight_t::IsUnit() : Next_t::IsUnitWeight(i - 1);
+  }
+  static constexpr int Radius() {
+    return StencilMax(Point::kRadius, Next_t::Radius());
+  }
+  static constexpr int MaxDistance() {
+    return StencilMax(Point::kDistance, Next_t::MaxDistance());
+  }
+  static constexpr int NonUnitWeights() {
+    return (Point::Weight_t::IsUnit() ? 0 : 1) + Next_t::NonUnitWeights();
+  }
+};
+
+template <typename Scale, typename... Points>
+struct StencilDescriptor {
+
+  using PointList_t = StencilPointList<Points...>;
+
+  /// Number of points in the neighborhood
+  static constexpr int kPoints = sizeof...(Points);
+
+  /// Largest offset in any dimension, which determines the halo width that is
+  /// consumed by each timestep
+  static constexpr int kRadius = PointList_t::Radius();
+
+  /// Number of rows that must be buffered on chip to produce a row of output
+  static constexpr int kLineBuffers = 2 * kRadius;
+
+  /// Whether all points lie on the axes through the center (a star stencil)
+  static constexpr bool kIsStar = PointList_t::MaxDistance() <= 1;
+
+  /// Floating point operations required to update a single cell
+  static constexpr int kOperations = (kPoints - 1) +
+                                     PointList_t::NonUnitWeights() +
+                                     (Scale::IsUnit() ? 0 : 1);
+
+  static constexpr int PlaneOffset(int i) {
+    return PointList_t::PlaneOffset(i);
+  }
+  static constexpr int RowOffset(int i) { return PointList_t::RowOffset(i); }
+  static constexpr int ColOffset(int i) { return PointList_t::ColOffset(i); }
+  static constexpr double Weight(int i) { return PointList_t::Weight(i); }
+  static constexpr bool IsUnitWeight(int i) {
+    return PointList_t::IsUnitWeight(i);
+  }
+  static constexpr double ScaleValue() { return Scale::Value(); }
+  static constexpr bool IsUnitScale() { return Scale::IsUnit(); }
+
+  static_assert(kPoints > 0, "Stencil must have at least one point.");
+  static_assert(kRadius > 0, "Stencil must access at least one neighbor.");
+};
+
+/// The classical 4-point Jacobi average of the north, west, east and south
+/// neighbors.
+using Jacobi4Point =
+    StencilDescriptor<StencilRatio<1, 4>, StencilPoint<-1, 0>,
+                      StencilPoint<0, -1>, StencilPoint<0, 1>,
+                      StencilPoint<1, 0>>;
+
+/// Explicit diffusion step with the center cell weighted against its four
+/// neighbors.
+using Weighted5Point =
+    StencilDescriptor<StencilRatio<1>,
+                      StencilPoint<-1, 0, StencilRatio<1, 8>>,
+                      StencilPoint<0, -1, StencilRatio<1, 8>>,
+                      StencilPoint<0, 0, StencilRatio<1, 2>>,
+                      StencilPoint<0, 1, StencilRatio<1, 8>>,
+                      StencilPoint<1, 0, StencilRatio<1, 8>>>;
+
+/// Average of the full 3x3 box around each cell.
+using Box9Point =
+    StencilDescriptor<StencilRatio<1, 9>, StencilPoint<-1, -1>,
+                      StencilPoint<-1, 0>, StencilPoint<-1, 1>,
+                      StencilPoint<0, -1>, StencilPoint<0, 0>,
+                      StencilPoint<0, 1>, StencilPoint<1, -1>,
+                      StencilPoint<1, 0>, StencilPoint<1, 1>>;
+
+/// Star of radius two, weighting the nearest neighbors twice as much as the
+/// outer neighbors.
+using Star2 =
+    StencilDescriptor<StencilRatio<1, 12>, StencilPoint<-2, 0>,
+                      StencilPoint<-1, 0, StencilRatio<2>>,
+                      StencilPoint<0, -2>,
+                      StencilPoint<0, -1, StencilRatio<2>>,
+                      StencilPoint<0, 1, StencilRatio<2>>,
+                      StencilPoint<0, 2>,
+                      StencilPoint<1, 0, StencilRatio<2>>,
+                      StencilPoint<2, 0>>;
+
+/// Explicit 7-point heat diffusion step in three dimensions, weighting the
+/// center twice as much as each of its six neighbors.
+using Heat7Point3D =
+    StencilDescriptor<StencilRatio<1, 8>, StencilPoint3D<-1, 0, 0>,
+                      StencilPoint3D<0, -1, 0>, StencilPoint3D<0, 0, -1>,
+                      StencilPoint3D<0, 0, 0, StencilRatio<2>>,
+                      StencilPoint3D<0, 0, 1>, StencilPoint3D<0, 1, 0>,
+                      StencilPoint3D<1, 0, 0>>;
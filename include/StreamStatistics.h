@@ -0,0 +1,71 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// With STENCIL_STREAM_STATISTICS, every simulation stream tracks its
+// occupancy, and reports it under its name when it is destroyed, i.e., at the
+// end of every kernel invocation. Streams of the same name, e.g., the pipes
+// between compute stages or the buffers of every bank, are aggregated, as they
+// share the same depth in hardware. Depths can be capped by name at runtime,
+// which is used to search for the smallest depths the dataflow completes
+// with. Without it, streams carry no statistics and ignore caps.
+#ifdef STENCIL_STREAM_STATISTICS
+constexpr bool kStreamStatistics = true;
+#else
+constexpr bool kStreamStatistics = false;
+#endif
+
+/// Occupancy of all streams of the same name
+struct StreamStatistics {
+  std::string name;
+  /// Capacity of the streams in simulation
+  size_t depth;
+  /// Number of streams aggregated
+  long streams;
+  long pushes;
+  /// Largest number of elements held at once by any of the streams
+  size_t highWater;
+  /// Pushes that found the stream full, and pops that found it empty
+  long fullStalls;
+  long emptyStalls;
+  /// Pushes by the occupancy after the push, where bucket 0 counts an
+  /// occupancy of 1, and bucket b > 0 occupancies in (2^(b-1), 2^b]
+  std::vector<long> histogram;
+};
+
+/// Bucket of the occupancy histogram that counts the given occupancy
+size_t StreamHistogramBucket(size_t occupancy);
+
+/// Adds the statistics of a stream to the streams of the same name.
+/// Thread-safe.
+void RecordStreamStatistics(StreamStatistics const &statistics);
+
+/// Statistics of every stream recorded since the last reset, ordered by name
+std::vector<StreamStatistics> CollectStreamStatistics();
+
+void ResetStreamStatistics();
+
+/// Caps the capacity of every stream of the given name created from now on,
+/// which never exceeds the depth the stream is declared with. A depth of 0
+/// removes the cap.
+void SetStreamDepth(std::string const &name, size_t depth);
+
+/// Caps all streams at once, replacing every previous cap
+void SetStreamDepths(std::map<std::string, size_t> const &depths);
+
+/// Cap of the streams of the given name, or 0 if they are not capped
+size_t StreamDepth(std::string const &name);
+
+/// Prints the statistics of every stream, along with the depth recommended
+/// for it if given.
+void PrintStreamStatistics(std::ostream &stream,
+                           std::vector<StreamStatistics> const &statistics,
+                           std::map<std::string, size_t> const &recommended =
+                               std::map<std::string, size_t>());
@@ -0,0 +1,102 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#pragma once
+
+#include <string>
+
+// With STENCIL_TRACE, the host records a span for every phase of a run, and
+// the simulation a span for the lifetime of every dataflow process and every
+// time a process blocks on a stream. Spans are recorded into a buffer per
+// thread and written as a Chrome trace, which can be opened in Perfetto or
+// chrome://tracing. Without it, spans compile to nothing.
+#ifdef STENCIL_TRACE
+constexpr bool kTrace = true;
+#else
+constexpr bool kTrace = false;
+#endif
+
+/// Nanoseconds since the start of the program
+long TraceNow();
+
+/// Creates a track that spans are recorded on, shown as a thread of the given
+/// name. Every thread gets its own track on first use, but work that moves
+/// between threads, such as cooperative tasks, can have a track of its own.
+int MakeTraceTrack(std::string const &name);
+
+/// Track spans of the calling thread are currently recorded on
+int TraceTrack();
+
+/// Records the spans of the calling thread on the given track from now on,
+/// returning the previous track
+int SetTraceTrack(int track);
+
+/// Names the track of the calling thread
+void NameTraceThread(std::string const &name);
+
+/// Records a span on the given track, with timestamps from TraceNow
+void RecordTraceSpan(std::string const &name, char const *category,
+                     int track, long begin, long end);
+
+/// Writes every span recorded so far as a Chrome trace. Threads may keep
+/// recording while the trace is written: the spans of every thread are taken
+/// under the lock of its buffer, so spans that end after its buffer has been
+/// taken are not part of the trace. Throws std::runtime_error if the file
+/// cannot be written.
+void WriteTrace(std::string const &path);
+
+/// Writes the trace to the given file when destroyed, however the program
+/// returns, if tracing is enabled
+class TraceWriter {
+
+ public:
+  explicit TraceWriter(std::string const &path) : path_(path) {}
+
+  ~TraceWriter();
+
+  TraceWriter(TraceWriter const &) = delete;
+  TraceWriter &operator=(TraceWriter const &) = delete;
+
+ private:
+  std::string path_;
+};
+
+/// Span from construction until destruction or End, on the track of the
+/// calling thread at construction
+class TraceSpan {
+
+ public:
+#ifdef STENCIL_TRACE
+  explicit TraceSpan(std::string const &name, char const *category = "host")
+      : name_(name), category_(category), track_(TraceTrack()),
+        begin_(TraceNow()) {}
+
+  ~TraceSpan() { End(); }
+
+  /// Ends the span early, e.g., when the phase ends in the middle of a scope
+  void End() {
+    if (!ended_) {
+      RecordTraceSpan(name_, category_, track_, begin_, TraceNow());
+      ended_ = true;
+    }
+  }
+#else
+  // Takes the name as is, such that no string is built
+  template <typename Name>
+  explicit TraceSpan(Name const &, char const * = "host") {}
+
+  void End() {}
+#endif
+
+  TraceSpan(TraceSpan const &) = delete;
+  TraceSpan &operator=(TraceSpan const &) = delete;
+
+#ifdef STENCIL_TRACE
+ private:
+  std::string name_;
+  char const *category_;
+  int track_;
+  long begin_;
+  bool ended_{false};
+#endif
+};
@@ -0,0 +1,70 @@
+#!/bin/bash
+# Author:  Johannes de Fine Licht (definelicht@inf.ethz.ch)
+#
+# Builds the kernel once for every number of rows per bank group, benchmarks
+# each build with ExecuteKernel, and prints the bandwidth achieved by every
+# setting. Each setting is configured in its own subdirectory of the given
+# build directory with the given CMake flags, and its kernel is only compiled
+# and linked if the bitstream does not exist yet. The results of every setting
+# are collected in bank_rows.csv in the build directory.
+#
+# Usage: SweepBankRows.sh <build directory> <iterations> "<rows per group...>"
+#                         [<CMake flags...>]
+#
+# The problem size is the default of the configuration, so pass e.g.
+# -DSTENCIL_ROWS=8192 among the CMake flags to change it. Every setting must
+# divide the rows evenly between the groups of all banks.
+
+set -e
+
+if [ "$#" -lt 3 ]; then
+  echo "Usage: $0 <build directory> <iterations> \"<rows per group...>\"" \
+       "[<CMake flags...>]" >&2
+  exit 1
+fi
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+mkdir -p "$1"
+BUILD_ROOT=$(cd "$1" && pwd)
+ITERATIONS=$2
+BANK_ROWS=$3
+shift 3
+
+SUMMARY="$BUILD_ROOT/bank_rows.csv"
+rm -f "$SUMMARY"
+for GROUP in $BANK_ROWS; do
+  BUILD_DIR="$BUILD_ROOT/bank_rows_$GROUP"
+  mkdir -p "$BUILD_DIR"
+  (cd "$BUILD_DIR" && cmake "$SOURCE_DIR" -DSTENCIL_BANK_ROWS="$GROUP" "$@")
+  cmake --build "$BUILD_DIR" --target ExecuteKernel.exe
+  KERNEL=$(sed -n 's/^char const \*const kKernelString = "\(.*\)";$/\1/p' \
+           "$BUILD_DIR/Stencil.h")
+  if [ ! -f "$BUILD_DIR/$KERNEL.xclbin" ]; then
+    if cmake --build "$BUILD_DIR" --target help | grep -q "build_kernel"; then
+      cmake --build "$BUILD_DIR" --target build_kernel
+    else
+      cmake --build "$BUILD_DIR" --target compile_hardware
+      cmake --build "$BUILD_DIR" --target link_hardware
+    fi
+  fi
+  # Benchmark results are appended to the file of the kernel, so start anew
+  rm -f "$BUILD_DIR/${KERNEL}_benchmark.csv"
+  (cd "$BUILD_DIR" && ./ExecuteKernel.exe benchmark 1 "$ITERATIONS" csv)
+  # Prefix every row with the setting, keeping only the first header
+  awk -v group="$GROUP" -v header="$([ -f "$SUMMARY" ] && echo 0 || echo 1)" \
+      'NR == 1 { if (header == 1) print "bank_rows," $0; next }
+       { print group "," $0 }' \
+      "$BUILD_DIR/${KERNEL}_benchmark.csv" >> "$SUMMARY"
+done
+
+echo
+awk -F, 'NR == 1 {
+           for (i = 1; i <= NF; ++i) {
+             if ($i == "bandwidth_gbs") { bandwidth = i }
+             if ($i == "execution_median") { median = i }
+           }
+           printf "%12s %16s %18s\n", "Bank rows", "Kernel [s]",
+                  "Bandwidth [GB/s]"
+           next
+         }
+         { printf "%12s %16s %18s\n", $1, $median, $bandwidth }' "$SUMMARY"
@@ -0,0 +1,38 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Arguments.h"
+#include "Stencil.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+bool ParseDimensions(const int argc, char **argv, const int first,
+                     Dimensions &dimensions,
+                     std::function<void(Dimensions const &)> const &check) {
+  dimensions = {static_cast<int>(kRows), static_cast<int>(kCols),
+                static_cast<int>(kBlocks), static_cast<int>(kTimeTotal)};
+  try {
+    if (argc > first) {
+      try {
+        dimensions.rows = std::stoi(argv[first]);
+        dimensions.cols = std::stoi(argv[first + 1]);
+        dimensions.blocks = std::stoi(argv[first + 2]);
+        dimensions.timesteps = std::stoi(argv[first + 3]);
+      } catch (std::logic_error const &) {
+        // Thrown by std::stoi for arguments that are not integers or too
+        // large, with a message that only names the function
+        throw std::invalid_argument("Dimensions must be integers.");
+      }
+    }
+    ValidateDimensions(dimensions.rows, dimensions.cols, dimensions.blocks,
+                       dimensions.timesteps);
+    if (check) {
+      check(dimensions);
+    }
+  } catch (std::invalid_argument const &err) {
+    std::cerr << "Invalid dimensions: " << err.what() << std::endl;
+    return false;
+  }
+  return true;
+}
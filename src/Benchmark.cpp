@@ -0,0 +1,139 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Benchmark.h"
+#include "Json.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+TimingStatistics Summarize(std::vector<double> samples) {
+  if (samples.empty()) {
+    throw std::invalid_argument("Cannot summarize zero samples.");
+  }
+  std::sort(samples.begin(), samples.end());
+  const int n = samples.size();
+  TimingStatistics stats;
+  stats.samples = n;
+  stats.min = samples.front();
+  stats.median = (n % 2 == 1)
+                     ? samples[n / 2]
+                     : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+  // Nearest rank: the smallest sample such that at least 95% are not larger
+  const int rank = static_cast<int>(std::ceil(0.95 * n));
+  stats.p95 = samples[std::max(rank, 1) - 1];
+  double sum = 0;
+  for (auto s : samples) {
+    sum += s;
+  }
+  stats.mean = sum / n;
+  double squares = 0;
+  for (auto s : samples) {
+    squares += (s - stats.mean) * (s - stats.mean);
+  }
+  stats.stddev = (n > 1) ? std::sqrt(squares / (n - 1)) : 0;
+  return stats;
+}
+
+namespace {
+
+void WriteJsonStatistics(std::ostream &stream, char const *name,
+                         TimingStatistics const &stats) {
+  stream << "    \"" << name << "\": {\"samples\": " << stats.samples
+         << ", \"min\": " << stats.min << ", \"median\": " << stats.median
+         << ", \"p95\": " << stats.p95 << ", \"mean\": " << stats.mean
+         << ", \"stddev\": " << stats.stddev << "}";
+}
+
+void WriteCsvStatistics(std::ostream &stream, TimingStatistics const &stats) {
+  stream << "," << stats.min << "," << stats.median << "," << stats.p95 << ","
+         << stats.mean << "," << stats.stddev;
+}
+
+} // End anonymous namespace
+
+void WriteJson(std::ostream &stream, BenchmarkResult const &result) {
+  const auto median = result.execution.median;
+  stream << std::setprecision(9);
+  stream << "{\n  ";
+  WriteJsonString(stream, result.kernel);
+  stream << ": {\n";
+  stream << "    \"rows\": " << result.rows << ",\n";
+  stream << "    \"cols\": " << result.cols << ",\n";
+  stream << "    \"blocks\": " << result.blocks << ",\n";
+  stream << "    \"timesteps\": " << result.timesteps << ",\n";
+  stream << "    \"warmup\": " << result.warmup << ",\n";
+  stream << "    \"iterations\": " << result.iterations << ",\n";
+  WriteJsonStatistics(stream, "execution", result.execution);
+  stream << ",\n";
+  WriteJsonStatistics(stream, "host_to_device", result.hostToDevice);
+  stream << ",\n";
+  WriteJsonStatistics(stream, "device_to_host", result.deviceToHost);
+  stream << ",\n";
+  // Rates are null if a phase was too fast to be measured
+  stream << "    \"bandwidth_gbs\": ";
+  WriteJsonNumber(stream, 1e-9 * result.bytesKernel / median);
+  stream << ",\n    \"host_to_device_gbs\": ";
+  WriteJsonNumber(stream,
+                  1e-9 * result.bytesTransfer / result.hostToDevice.median);
+  stream << ",\n    \"device_to_host_gbs\": ";
+  WriteJsonNumber(stream,
+                  1e-9 * result.bytesTransfer / result.deviceToHost.median);
+  stream << ",\n    \"performance_gops\": ";
+  WriteJsonNumber(stream, 1e-9 * result.operations / median);
+  stream << ",\n    \"predicted\": " << result.predicted << ",\n";
+  stream << "    \"ratio_to_predicted\": ";
+  WriteJsonNumber(stream, median / result.predicted);
+  stream << "\n";
+  stream << "  }\n}\n";
+}
+
+void WriteCsv(std::ostream &stream, BenchmarkResult const &result,
+              const bool header) {
+  if (header) {
+    stream << "kernel,rows,cols,blocks,timesteps,warmup,iterations";
+    for (auto name : {"execution", "host_to_device", "device_to_host"}) {
+      for (auto stat : {"min", "median", "p95", "mean", "stddev"}) {
+        stream << "," << name << "_" << stat;
+      }
+    }
+    stream << ",bandwidth_gbs,host_to_device_gbs,device_to_host_gbs,"
+              "performance_gops,predicted,ratio_to_predicted\n";
+  }
+  const auto median = result.execution.median;
+  stream << std::setprecision(9);
+  stream << result.kernel << "," << result.rows << "," << result.cols << ","
+         << result.blocks << "," << result.timesteps << "," << result.warmup
+         << "," << result.iterations;
+  WriteCsvStatistics(stream, result.execution);
+  WriteCsvStatistics(stream, result.hostToDevice);
+  WriteCsvStatistics(stream, result.deviceToHost);
+  stream << "," << 1e-9 * result.bytesKernel / median << ","
+         << 1e-9 * result.bytesTransfer / result.hostToDevice.median << ","
+         << 1e-9 * result.bytesTransfer / result.deviceToHost.median << ","
+         << 1e-9 * result.operations / median << "," << result.predicted
+         << "," << median / result.predicted << "\n";
+}
+
+void PrintSummary(std::ostream &stream, BenchmarkResult const &result) {
+  const auto median = result.execution.median;
+  stream << "Kernel:           " << result.kernel << "\n";
+  stream << "Iterations:       " << result.iterations << " (" << result.warmup
+         << " warmup)\n";
+  stream << "Execution:        " << median << " s median / "
+         << result.execution.min << " s min / " << result.execution.p95
+         << " s p95 / " << result.execution.stddev << " s stddev\n";
+  stream << "Host to device:   " << result.hostToDevice.median << " s / "
+         << 1e-9 * result.bytesTransfer / result.hostToDevice.median
+         << " GB/s\n";
+  stream << "Device to host:   " << result.deviceToHost.median << " s / "
+         << 1e-9 * result.bytesTransfer / result.deviceToHost.median
+         << " GB/s\n";
+  stream << "Bandwidth:        " << 1e-9 * result.bytesKernel / median
+         << " GB/s\n";
+  stream << "Performance:      " << 1e-9 * result.operations / median
+         << " GOp/s\n";
+  stream << "Predicted:        " << result.predicted << " s (measured is "
+         << median / result.predicted << "x)\n";
+}
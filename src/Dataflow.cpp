@@ -0,0 +1,295 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Dataflow.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#ifdef STENCIL_COOPERATIVE_SIMULATION
+#include <ucontext.h>
+#endif
+
+namespace {
+
+/// Name of the trace track of a process, which is only built when tracing
+std::string ProcessName(const size_t index) {
+  return kTrace ? "process " + std::to_string(index) : std::string();
+}
+
+} // End anonymous namespace
+
+#ifndef STENCIL_COOPERATIVE_SIMULATION
+
+void Dataflow::Run() {
+  std::vector<std::thread> threads;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  for (size_t i = 0; i < processes_.size(); ++i) {
+    auto &process = processes_[i];
+    const auto name = ProcessName(i);
+    threads.emplace_back([&process, &error, &errorMutex, name]() {
+      if (kTrace) {
+        NameTraceThread(name);
+      }
+      TraceSpan span(name, "dataflow");
+      try {
+        process();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  processes_.clear();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+bool DataflowWait(std::function<bool()> const &,
+                  std::function<bool()> const &, std::string const &) {
+  return false;
+}
+
+#else
+
+namespace {
+
+// Processes only keep a handful of scalars and small arrays on the stack, but
+// the stack is only committed as it is touched, so err on the large side
+constexpr size_t kStackSize = 1 << 20;
+
+// How long an idle worker waits before checking whether a task running on
+// another worker has made a suspended task ready
+constexpr auto kIdlePoll = std::chrono::microseconds(50);
+
+struct Task {
+  std::function<void()> process;
+  // Trace track the task records its spans on, wherever it runs
+  std::string name;
+  int track{0};
+  std::unique_ptr<char[]> stack;
+  ucontext_t context;
+  // Context of the worker that resumed the task, to return to when suspending
+  ucontext_t *worker{nullptr};
+  // Condition the task is suspended on, or null if it is runnable
+  std::function<bool()> const *ready{nullptr};
+  std::function<bool()> const *preferred{nullptr};
+  std::string const *waitingOn{nullptr};
+  bool finished{false};
+  // Set once the dataflow gives up on the task, which makes it unwind its
+  // stack instead of continuing when it is resumed
+  bool cancelled{false};
+  std::exception_ptr error;
+};
+
+/// Thrown into a cancelled task to unwind its stack, so that the streams and
+/// buffers living on it are destroyed before the stack is freed. It does not
+/// derive from std::exception, so processes catching those do not swallow it.
+struct TaskCancelled {};
+
+thread_local Task *currentTask = nullptr;
+
+void RunTask() {
+  Task *task = currentTask;
+  {
+    TraceSpan span(task->name, "dataflow");
+    try {
+      // A task cancelled before it ever ran has nothing to unwind
+      if (!task->cancelled) {
+        task->process();
+      }
+    } catch (TaskCancelled const &) {
+    } catch (...) {
+      task->error = std::current_exception();
+    }
+  }
+  task->finished = true;
+  swapcontext(&task->context, task->worker);
+}
+
+} // End anonymous namespace
+
+void Dataflow::Run() {
+
+  std::vector<std::unique_ptr<Task>> tasks;
+  std::vector<Task *> queue;
+  for (size_t i = 0; i < processes_.size(); ++i) {
+    std::unique_ptr<Task> task(new Task);
+    task->process = std::move(processes_[i]);
+    task->name = ProcessName(i);
+    if (kTrace) {
+      task->track = MakeTraceTrack(task->name);
+    }
+    task->stack.reset(new char[kStackSize]);
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack.get();
+    task->context.uc_stack.ss_size = kStackSize;
+    task->context.uc_link = nullptr;
+    makecontext(&task->context, RunTask, 0);
+    queue.emplace_back(task.get());
+    tasks.emplace_back(std::move(task));
+  }
+  processes_.clear();
+
+  std::mutex mutex;
+  std::condition_variable progress;
+  int running = 0;
+  int finished = 0;
+  bool deadlock = false;
+  std::exception_ptr error;
+
+  const int total = tasks.size();
+  int workers = STENCIL_SIMULATION_WORKERS;
+  if (workers <= 0) {
+    workers = std::thread::hardware_concurrency();
+  }
+  workers = std::max(1, std::min(total, workers));
+
+  auto worker = [&]() {
+    ucontext_t self;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (finished < total && !deadlock && !error) {
+      // Resume the first task in round-robin order that can make substantial
+      // progress, or otherwise any progress. Suspended tasks are only touched
+      // while holding the lock, so their conditions can be evaluated safely
+      // from any worker.
+      auto it = std::find_if(queue.begin(), queue.end(), [](Task *t) {
+        return t->ready == nullptr || (*t->preferred)();
+      });
+      if (it == queue.end()) {
+        it = std::find_if(queue.begin(), queue.end(),
+                          [](Task *t) { return (*t->ready)(); });
+      }
+      if (it == queue.end()) {
+        if (running == 0) {
+          // Nothing is running that could make any suspended task ready
+          deadlock = true;
+          progress.notify_all();
+          break;
+        }
+        progress.wait_for(lock, kIdlePoll);
+        continue;
+      }
+      Task *task = *it;
+      queue.erase(it);
+      task->ready = nullptr;
+      task->preferred = nullptr;
+      task->waitingOn = nullptr;
+      task->worker = &self;
+      ++running;
+      lock.unlock();
+      currentTask = task;
+      // The worker track shows which process runs when, while the spans of
+      // the task itself go to its own track
+      TraceSpan slice(task->name, "schedule");
+      const int workerTrack = kTrace ? SetTraceTrack(task->track) : 0;
+      swapcontext(&self, &task->context);
+      if (kTrace) {
+        SetTraceTrack(workerTrack);
+      }
+      slice.End();
+      currentTask = nullptr;
+      lock.lock();
+      --running;
+      if (task->finished) {
+        ++finished;
+        if (task->error && !error) {
+          error = task->error;
+        }
+      } else {
+        queue.emplace_back(task);
+      }
+      progress.notify_all();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int i = 1; i < workers; ++i) {
+    pool.emplace_back([&worker]() {
+      if (kTrace) {
+        NameTraceThread("dataflow worker");
+      }
+      worker();
+    });
+  }
+  worker();
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  // The names refer to streams that may live on the stacks of the suspended
+  // tasks, so collect them before unwinding those
+  std::vector<std::string> names;
+  for (auto task : queue) {
+    if (task->waitingOn != nullptr &&
+        std::find(names.begin(), names.end(), *task->waitingOn) ==
+            names.end()) {
+      names.emplace_back(*task->waitingOn);
+    }
+  }
+
+  // Whether the processes deadlocked or one of them threw, resume every task
+  // that did not finish with the cancel flag set, which unwinds its stack
+  // before the stack is freed along with the task
+  ucontext_t self;
+  for (auto task : queue) {
+    task->cancelled = true;
+    task->worker = &self;
+    currentTask = task;
+    const int workerTrack = kTrace ? SetTraceTrack(task->track) : 0;
+    swapcontext(&self, &task->context);
+    if (kTrace) {
+      SetTraceTrack(workerTrack);
+    }
+    currentTask = nullptr;
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (deadlock) {
+    std::string message = "Dataflow deadlock: " +
+                          std::to_string(total - finished) +
+                          " processes are blocked on streams";
+    for (size_t i = 0; i < names.size(); ++i) {
+      message += ((i == 0) ? ": " : ", ") + names[i];
+    }
+    message += ".";
+    throw DataflowDeadlock(message, names);
+  }
+}
+
+bool DataflowWait(std::function<bool()> const &ready,
+                  std::function<bool()> const &preferred,
+                  std::string const &name) {
+  Task *task = currentTask;
+  if (task == nullptr) {
+    return false;
+  }
+  if (!task->cancelled) {
+    // The worker only resumes the task once the condition holds, or once the
+    // dataflow cancels it
+    task->ready = &ready;
+    task->preferred = &preferred;
+    task->waitingOn = &name;
+    swapcontext(&task->context, task->worker);
+  }
+  if (task->cancelled) {
+    throw TaskCancelled();
+  }
+  return true;
+}
+
+#endif
@@ -1,286 +1,875 @@
 /// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
 /// @copyright This software is copyrighted under the BSD 3-Clause License. 
 
-#include "hlslib/xilinx/SDAccel.h"
+#include "Runtime.h"
 #include "Stencil.h"
+#include "Arguments.h"
+#include "Layout.h"
+#include "OutOfCore.h"
 #include "Reference.h"
+#include "Benchmark.h"
+#include "Trace.h"
+#include <algorithm>
 #include <string>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <chrono>
 #include <cmath>
+#include <vector>
 
-int main(int argc, char **argv) {
+struct BenchmarkOptions {
+  int warmup;
+  int iterations;
+  std::string format;
+};
 
-  if (argc > 2) {
-    std::cerr << "Usage: ./ExecuteKernel [<verify [on/off]>]" << std::endl;
-    return 1;
+struct SolveOptions {
+  std::string norm;
+  double tolerance;
+  int maxLaunches;
+};
+
+/// Input grid whose values vary along both dimensions, such that rows or
+/// columns misplaced by the device layout fail verification
+std::vector<Data_t> InputGrid(const int rows, const int cols) {
+  std::vector<Data_t> input(static_cast<long>(rows) * cols);
+  for (long i = 0; i < static_cast<long>(input.size()); ++i) {
+    input[i] = Data_t(0.125 * ((i / cols) % 7 + 3 * ((i % cols) % 5)));
   }
+  return input;
+}
 
-  bool verify = false;
-  if (argc == 2) {
-    if (std::string(argv[1]) == "on") {
-      verify = true;
-    } else if (std::string(argv[1]) == "off") {
-      verify = false;
-    } else {
-      std::cerr << "Verify option must be either \"on\" or \"off\"."
+/// Norm of the residual of a single folded pass
+double ResidualNorm(Residual_t const &residual, std::string const &norm) {
+  return (norm == "max")
+             ? static_cast<double>(residual[kResidualMax])
+             : std::sqrt(static_cast<double>(residual[kResidualSumSquares]));
+}
+
+/// Relaunches the kernel until the residual of the last folded pass of a
+/// launch drops below the tolerance. The grid stays on the device between
+/// launches; only the residual of each pass is copied back. Returns whether
+/// the solve converged.
+template <typename Execute, typename CopyResidual>
+bool RunSolve(Execute const &execute, CopyResidual const &copyResidual,
+              SolveOptions const &options, const int timesteps) {
+  std::vector<Residual_t> residual(TimeFolded(timesteps));
+  double elapsed = 0;
+  for (int launch = 0; launch < options.maxLaunches; ++launch) {
+    const auto begin = std::chrono::steady_clock::now();
+    execute();
+    const auto end = std::chrono::steady_clock::now();
+    elapsed += std::chrono::duration<double>(end - begin).count();
+    copyResidual(residual);
+    const double norm = ResidualNorm(residual.back(), options.norm);
+    std::cout << "Launch " << launch + 1 << ": "
+              << static_cast<long>(launch + 1) * timesteps
+              << " timesteps, residual " << norm << " (" << options.norm
+              << ")" << std::endl;
+    if (norm <= options.tolerance) {
+      std::cout << "Converged after " << static_cast<long>(launch + 1) * timesteps
+                << " timesteps in " << elapsed << " seconds of execution."
                 << std::endl;
-      return 1;
+      return true;
     }
   }
+  std::cerr << "Did not converge to " << options.tolerance << " within "
+            << options.maxLaunches << " launches." << std::endl;
+  return false;
+}
+
+/// Bytes read from memory by the kernel, including halos unless they are
+/// reused on chip
+double ReadSize(const int rows, const int cols, const int blocks,
+                const int timesteps) {
+  return static_cast<double>(TimeFolded(timesteps)) *
+         TotalReadMemory(rows, cols, blocks) * sizeof(Memory_t);
+}
+
+/// Bytes written to memory by the kernel
+double WriteSize(const int rows, const int cols, const int timesteps) {
+  return static_cast<double>(TimeFolded(timesteps)) *
+         TotalElementsMemory(rows, cols) * sizeof(Memory_t);
+}
 
-  if (kDimms == 1) {
+/// Prints the performance counters of a launch of a single grid beside the
+/// predictions of the performance model used by Stats: the words transferred
+/// by every bank for the memory processes, and the cycles of the kernel for
+/// the others. The kernel cycles are additionally estimated from the wall time
+/// at the target clock.
+void PrintCounters(std::vector<Counter_t> const &counters,
+                   const int boundaryModes, const int rows, const int cols,
+                   const int blocks, const int timesteps,
+                   const double elapsed) {
+  const long cycles =
+      CyclesRequired(rows, cols, blocks, timesteps, boundaryModes);
+  const double readBeats =
+      ReadSize(rows, cols, blocks, timesteps) / (sizeof(Memory_t) * kDimms);
+  const double writeBeats =
+      WriteSize(rows, cols, timesteps) / (sizeof(Memory_t) * kDimms);
+  std::cout << std::setw(12) << "Process" << std::setw(14) << "Active"
+            << std::setw(14) << "Stalled" << std::setw(14) << "Beats"
+            << std::setw(14) << "Model" << std::endl;
+  const auto print = [&](std::string const &name, const long process,
+                         const double model) {
+    std::cout << std::setw(12) << name;
+    for (int k = kCounterActive; k <= kCounterBeats; ++k) {
+      std::cout << std::setw(14) << counters[CounterIndex(process, k)];
+    }
+    std::cout << std::setw(14) << static_cast<long>(model) << std::endl;
+  };
+  for (int k = 0; k < kDimms; ++k) {
+    print("Read " + std::to_string(k), CounterReadSplit(k), readBeats);
+  }
+  print("Widen", kCounterWiden, cycles);
+  for (int s = 0; s < kDepth; ++s) {
+    print("Compute " + std::to_string(s), CounterCompute(s), cycles);
+  }
+  for (int k = 0; k < kDimms; ++k) {
+    print("Write " + std::to_string(k), CounterWriteSplit(k), writeBeats);
+  }
+  std::cout << "Kernel took " << counters[kCounterCycles] << " cycles, "
+            << cycles << " predicted, "
+            << static_cast<long>(elapsed * 1e6 * kTargetClock)
+            << " from the wall time at " << kTargetClock << " MHz."
+            << std::endl;
+}
 
-    std::vector<Memory_t> host;
+/// Times repeated transfers and executions of the kernel, and writes the
+/// results to <kernel string>_benchmark.<json/csv>. CSV results are appended,
+/// such that results of multiple bitstreams can be collected in one file.
+template <typename CopyIn, typename Execute, typename CopyOut>
+void RunBenchmark(CopyIn const &copyIn, Execute const &execute,
+                  CopyOut const &copyOut, BenchmarkOptions const &options,
+                  const int rows, const int cols, const int blocks,
+                  const int timesteps) {
+  BenchmarkResult result;
+  result.kernel = kKernelString;
+  result.rows = rows;
+  result.cols = cols;
+  result.blocks = blocks;
+  result.timesteps = timesteps;
+  result.warmup = options.warmup;
+  result.iterations = options.iterations;
+  result.bytesKernel = ReadSize(rows, cols, blocks, timesteps) +
+                       WriteSize(rows, cols, timesteps);
+  result.bytesTransfer =
+      2.0 * TotalElementsMemory(rows, cols) * sizeof(Memory_t);
+  result.operations = static_cast<double>(Stencil_t::kOperations) *
+                      timesteps * rows * cols;
+  result.predicted =
+      CyclesRequired(rows, cols, blocks, timesteps) / (1e6 * kTargetClock);
 
-    try {
+  std::cout << "Benchmarking host to device transfers..." << std::flush;
+  result.hostToDevice = Summarize(
+      TimeRepeated(copyIn, options.warmup, options.iterations));
+  std::cout << " Done.\nBenchmarking kernel..." << std::flush;
+  result.execution = Summarize(
+      TimeRepeated(execute, options.warmup, options.iterations));
+  std::cout << " Done.\nBenchmarking device to host transfers..."
+            << std::flush;
+  result.deviceToHost = Summarize(
+      TimeRepeated(copyOut, options.warmup, options.iterations));
+  std::cout << " Done." << std::endl;
 
-      std::cout << "Initializing OpenCL context..." << std::flush;
-      hlslib::ocl::Context context;
-      std::cout << " Done.\n";
+  PrintSummary(std::cout, result);
+  const std::string path =
+      std::string(kKernelString) + "_benchmark." + options.format;
+  if (options.format == "json") {
+    std::ofstream file(path);
+    WriteJson(file, result);
+  } else {
+    const bool exists = std::ifstream(path).good();
+    std::ofstream file(path, std::ios::app);
+    WriteCsv(file, result, !exists);
+  }
+  std::cout << "Wrote results to " << path << "." << std::endl;
+}
 
-      std::cout << "Creating program..." << std::flush;
-      auto program =
-          context.MakeProgram(kKernelString + std::string(".xclbin"));
-      std::cout << " Done." << std::endl;
+/// Reports the time spent in each part of an out-of-core execution, and
+/// compares the throughput against executing the domain in-core
+void PrintOutOfCore(OutOfCoreTiming const &timing,
+                    std::vector<Strip> const &strips, const int rows,
+                    const int cols, const int blocks, const int timesteps) {
+  const double cells = static_cast<double>(rows) * cols * timesteps;
+  long rowsComputed = 0;
+  for (auto const &strip : strips) {
+    rowsComputed += strip.rows;
+  }
+  const double transfers = timing.upload + timing.download;
+  const double hidden =
+      (transfers > 0)
+          ? std::max(0.0, std::min(1.0, (transfers + timing.execute -
+                                         timing.total) /
+                                            transfers))
+          : 1;
+  const double predicted =
+      CyclesRequired(rows, cols, blocks, timesteps) / (1e6 * kTargetClock);
+  std::cout << "Executed " << strips.size() << " strips with halos of "
+            << StripHalo() << " rows, computing "
+            << static_cast<double>(rowsComputed) / rows
+            << "x the rows of the domain.\nUpload:   " << timing.upload
+            << " s\nKernel:   " << timing.execute << " s\nDownload: "
+            << timing.download << " s\nTotal:    " << timing.total
+            << " s\nHidden " << 100 * hidden
+            << "% of the transfer time behind kernel execution.\n"
+            << "Out-of-core:          " << cells / timing.total
+            << " cells/s\nKernel only:          " << cells / timing.execute
+            << " cells/s\nIn-core (predicted):  " << cells / predicted
+            << " cells/s (" << 100 * predicted / timing.total
+            << "% of the out-of-core time)" << std::endl;
+}
 
-      std::cout << "Allocating device memory..." << std::flush;
-      auto device = context.MakeBuffer<Memory_t, hlslib::ocl::Access::readWrite>(
-          hlslib::ocl::MemoryBank::bank0, 2 * kTotalElementsMemory);
-      std::cout << " Done." << std::endl;
+/// Advances a domain that does not need to fit in device memory by streaming
+/// strips of rows through the device, one folded pass per sweep over the
+/// domain. Only two strips reside on the device at any time.
+int RunStrips(int argc, char **argv) {
 
-      if (verify) {
-        std::cout << "Initializing memory..." << std::flush;
-        host = std::vector<Memory_t>(2 * kTotalElementsMemory,
-                                     Memory_t(Kernel_t(static_cast<Data_t>(0))));
-        device.CopyFromHost(host.cbegin());
-        std::cout << " Done." << std::endl;
-      }
+  if (argc != 4 && argc != 8) {
+    std::cerr << "Usage: ./ExecuteKernel outofcore <strip rows> <verify "
+                 "[on/off]> [<rows> <cols> <blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
 
-      std::cout << "Creating kernel..." << std::flush;
-      auto kernel = program.MakeKernel(Jacobi, "Jacobi", device, device);
-      std::cout << " Done." << std::endl;
+  const int stripRows = std::stoi(argv[2]);
+  if (std::string(argv[3]) != "on" && std::string(argv[3]) != "off") {
+    std::cerr << "Verify option must be either \"on\" or \"off\"."
+              << std::endl;
+    return 1;
+  }
+  const bool verify = std::string(argv[3]) == "on";
+  const auto check = [stripRows](Dimensions const &d) {
+    ValidateOutOfCore(d.rows, d.cols, d.blocks, d.timesteps, stripRows,
+                      kBoundaryModesDirichlet);
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 4, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  // Every edge holds the constant boundary value also used for verification
+  const auto boundaryDomain = MakeBoundary(rows, cols);
+  const auto strips = MakeStrips(rows, stripRows);
+  const int stripRowsMax = StripRowsMax(strips);
+  std::vector<HostBuffer_t> stripBoundaries;
+  std::vector<int> stripModes;
+  for (auto const &strip : strips) {
+    const auto stripBoundary = StripBoundary(boundaryDomain, strip);
+    stripBoundaries.emplace_back(
+        PackBoundary(stripBoundary, strip.rows, cols));
+    stripModes.emplace_back(stripBoundary.modes);
+  }
 
-      const auto readSize =
-          static_cast<float>(kTimeFolded) * kTotalInputMemory * sizeof(Memory_t);
-      const auto writeSize = static_cast<float>(kTimeFolded) *
-                             kTotalElementsMemory * sizeof(Memory_t);
-      const auto transferred = readSize + writeSize;
+  // The host holds both grids of the domain, split into banks
+  std::vector<HostBuffer_t> hostBanks;
 
-      std::cout << "Executing kernel..." << std::flush;
-      auto begin = std::chrono::high_resolution_clock::now();
-      kernel.ExecuteTask();
-      auto end = std::chrono::high_resolution_clock::now();
-      double elapsed =
-          1e-9 *
-          std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
-              .count();
-      std::cout << " Done.\nMoved " << 1e-9 * transferred << " GB in " << elapsed
-                << " seconds, bandwidth " << (1e-9 * transferred / elapsed)
-                << " GB/s\nEvaluated " << kTimeTotal * kRows * kCols
-                << " cells in " << elapsed << " seconds, performance "
-                << 4e-9 * (kTimeTotal * kRows * kCols) / elapsed << " GOp/s"
-                << std::endl;
-      if (verify) {
-        std::cout << "Copying back memory..." << std::flush;
-        device.CopyToHost(host.begin());
-        std::cout << " Done." << std::endl;
+  try {
+
+    std::cout << "Loading program..." << std::flush;
+    Runtime runtime;
+    std::cout << " Done." << std::endl;
+
+    // Each of the two slots holds the ping-pong buffer of the largest strip in
+    // every bank, and the values of its boundary
+    std::cout << "Allocating device memory for two strips of up to "
+              << stripRowsMax << " rows..." << std::flush;
+    const DeviceLease_t slots[] = {
+        runtime.Acquire(1, stripRowsMax, cols, kDepth),
+        runtime.Acquire(1, stripRowsMax, cols, kDepth)};
+    std::cout << " Done." << std::endl;
+
+    std::cout << "Initializing memory..." << std::flush;
+    hostBanks = PackBanks({InputGrid(rows, cols)}, rows, cols);
+    std::cout << " Done." << std::endl;
+
+    const auto upload = [&](const int i, const int slot, const int sweep) {
+      const auto transfer =
+          MakeStripTransfer(strips[i], rows, cols, kDimms, sweep);
+      for (int k = 0; k < kDimms; ++k) {
+        slots[slot]->banks[k].CopyFromHost(
+            0, transfer.inputWords,
+            hostBanks[k].cbegin() + transfer.inputHost);
+      }
+      slots[slot]->boundary.CopyFromHost(0, stripBoundaries[i].size(),
+                                         stripBoundaries[i].cbegin());
+    };
+    const auto execute = [&](const int i, const int slot, const int sweep) {
+      runtime
+          .MakeKernel(*slots[slot], stripModes[i], 1, strips[i].rows, cols,
+                      blocks, TimestepsInPass(timesteps, sweep))
+          .ExecuteTask();
+    };
+    const auto download = [&](const int i, const int slot, const int sweep) {
+      const auto transfer =
+          MakeStripTransfer(strips[i], rows, cols, kDimms, sweep);
+      for (int k = 0; k < kDimms; ++k) {
+        slots[slot]->banks[k].CopyToHost(
+            transfer.outputDevice, transfer.outputWords,
+            hostBanks[k].begin() + transfer.outputHost);
       }
+    };
 
-    } catch (std::runtime_error const &err) {
-      std::cerr << "Execution failed with error: \"" << err.what() << "\"."
-                << std::endl;
+    std::cout << "Executing " << strips.size() << " strips in "
+              << TimeFolded(timesteps) << " sweeps..." << std::flush;
+    const auto timing = RunOutOfCore(strips, TimeFolded(timesteps), upload,
+                                     execute, download);
+    std::cout << " Done." << std::endl;
+    PrintOutOfCore(timing, strips, rows, cols, blocks, timesteps);
+
+  } catch (std::runtime_error const &err) {
+    std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+              << std::endl;
+    return 1;
+  }
+
+  if (verify) {
+    const auto host = MergeBanks(hostBanks, rows, cols);
+    std::cout << "Running reference implementation..." << std::flush;
+    const auto reference =
+        Reference(InputGrid(rows, cols), rows, cols, timesteps);
+    std::cout << " Done." << std::endl;
+    std::cout << "Verifying result..." << std::flush;
+    // Sweeps alternate between the halves of the host buffer
+    const long offset =
+        (TimeFolded(timesteps) % 2 == 0) ? 0 : TotalElementsMemory(rows, cols);
+    const auto statistics = CompareResult(reference, host.data() + offset,
+                                          rows, cols, DefaultTolerance());
+    std::cout << " Done." << std::endl;
+    PrintErrorStatistics(std::cout, statistics);
+    std::cout << std::endl;
+    PrintErrorDetails(std::cout, statistics);
+    if (statistics.mismatches == 0) {
+      std::cout << "Verification successful." << std::endl;
+    } else {
+      std::cerr << "Verification failed." << std::endl;
       return 1;
     }
+  }
 
-    // Verification
-    if (verify) {
-      int correct = 0;
-      int mismatches = 0;
-      std::cout << "Running reference implementation..." << std::flush;
-      const auto reference = Reference(std::vector<Data_t>(kRows * kCols, 0));
-      std::cout << " Done." << std::endl;
-      std::cout << "Verifying result..." << std::flush;
-      const int offset = (kTimeFolded % 2 == 0) ? 0 : kTotalElementsMemory;
-      for (int r = 0; r < kRows; ++r) {
-        for (int c = 0; c < kBlockWidthMemory * kBlocks; ++c) {
-          const int index = r * kBlockWidthMemory * kBlocks + c;
-          for (int k = 0; k < kKernelPerMemory; ++k) {
-            const Kernel_t elem = host[offset + index][k];
-            for (int w = 0; w < kKernelWidth; ++w) {
-              const auto expected =
-                  reference[kMemoryWidth * index + kKernelWidth * k + w];
-              const auto actual = elem[w];
-              auto diff = expected - actual;
-              diff = (diff < 0) ? Data_t(-diff) : Data_t(diff);
-              if (diff > 1e-4) {
-                if (mismatches == 0) {
-                  std::cerr << "Mismatch at (" << r << ", "
-                            << c * kMemoryWidth + k * kKernelWidth + w
-                            << "): " << actual << " (should be " << expected << ")"
-                            << std::endl;
-                }
-                ++mismatches;
-              } else {
-                // std::cout << "Correct at (" << r << ", "
-                //           << c * kMemoryWidth + k * kKernelWidth + w
-                //           << "): " << elem[w] << "\n";
-                ++correct;
-              }
-            }
-          }
+  return 0;
+}
+
+/// Measures the throughput of batches of small grids, doubling the batch size
+/// from a single grid up to the given number of grids. Every batch is packed,
+/// copied to the device, advanced in a single launch, copied back and
+/// unpacked, and the launch is timed separately from the round trip.
+int RunBatchBenchmark(int argc, char **argv) {
+
+  if (argc != 4 && argc != 8) {
+    std::cerr << "Usage: ./ExecuteKernel batch <max grids> <iterations> "
+                 "[<rows> <cols> <blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  const int gridsMax = std::stoi(argv[2]);
+  const int iterations = std::stoi(argv[3]);
+  const auto check = [gridsMax, iterations](Dimensions const &) {
+    if (gridsMax < 1 || iterations < 1) {
+      throw std::invalid_argument(
+          "At least one grid and one iteration are required.");
+    }
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 4, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const long totalElementsMemory = TotalElementsMemory(rows, cols);
+  const int boundaryModes = kBoundaryModesDirichlet;
+  const auto boundaryHost =
+      PackBoundary(MakeBoundary(rows, cols, boundaryModes), rows, cols);
+  std::vector<int> batchSizes;
+  for (int grids = 1; grids < gridsMax; grids *= 2) {
+    batchSizes.emplace_back(grids);
+  }
+  batchSizes.emplace_back(gridsMax);
+
+  try {
+
+    std::cout << "Loading program..." << std::flush;
+    Runtime runtime;
+    std::cout << " Done." << std::endl;
+
+    // Every bank holds its rows of all grids of the largest batch, which the
+    // smaller batches use a prefix of
+    std::cout << "Allocating device memory for " << gridsMax << " grids..."
+              << std::flush;
+    const auto device = runtime.Acquire(gridsMax, rows, cols, timesteps);
+    device->boundary.CopyFromHost(0, boundaryHost.size(),
+                                  boundaryHost.cbegin());
+    std::cout << " Done." << std::endl;
+
+    // The speedup is the kernel throughput relative to launching every grid
+    // separately, and the model excludes the latency of the pipeline
+    std::cout << std::setw(8) << "Grids" << std::setw(14) << "Kernel [s]"
+              << std::setw(16) << "Grids/s kernel" << std::setw(16)
+              << "Grids/s total" << std::setw(16) << "Grids/s model"
+              << std::setw(10) << "Speedup" << std::endl;
+    double singleLaunch = 0;
+    for (const int grids : batchSizes) {
+      const std::vector<std::vector<Data_t>> inputs(
+          grids, std::vector<Data_t>(static_cast<long>(rows) * cols, 0));
+      std::vector<HostBuffer_t> hostBanks;
+      const long wordsPerBank = 2 * grids * totalElementsMemory / kDimms;
+      auto kernel = runtime.MakeKernel(*device, boundaryModes, grids, rows,
+                                       cols, blocks, timesteps);
+      const auto copyIn = [&]() {
+        hostBanks = PackBanks(inputs, rows, cols);
+        for (int k = 0; k < kDimms; ++k) {
+          device->banks[k].CopyFromHost(0, wordsPerBank,
+                                        hostBanks[k].cbegin());
         }
+      };
+      const auto copyOut = [&]() {
+        for (int k = 0; k < kDimms; ++k) {
+          device->banks[k].CopyToHost(0, wordsPerBank, hostBanks[k].begin());
+        }
+        return UnpackBanks(hostBanks, rows, cols, timesteps);
+      };
+      copyIn();
+      const auto execution = Summarize(
+          TimeRepeated([&]() { kernel.ExecuteTask(); }, 1, iterations));
+      const auto roundTrip = Summarize(TimeRepeated(
+          [&]() {
+            copyIn();
+            kernel.ExecuteTask();
+            copyOut();
+          },
+          0, iterations));
+      const double predicted =
+          CyclesRequired(rows, cols, blocks, timesteps, boundaryModes, grids) /
+          (1e6 * kTargetClock);
+      if (grids == 1) {
+        singleLaunch = execution.median;
       }
-      std::cout << " Done." << std::endl;
-      std::cout << "Correct: " << correct << "\nMismatches: " << mismatches
-                << std::endl;
-      if (mismatches == 0) {
-        std::cout << "Verification successful." << std::endl;
-      } else {
-        std::cerr << "Verification failed." << std::endl;
-        return 1;
-      }
+      std::cout << std::setw(8) << grids << std::setw(14) << execution.median
+                << std::setw(16) << grids / execution.median << std::setw(16)
+                << grids / roundTrip.median << std::setw(16)
+                << grids / predicted << std::setw(10)
+                << grids * singleLaunch / execution.median << std::endl;
     }
 
-  } else if (kDimms == 2) {
+  } catch (std::runtime_error const &err) {
+    std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+              << std::endl;
+    return 1;
+  }
 
-    std::vector<Memory_t> hostSplit0;
-    std::vector<Memory_t> hostSplit1;
+  return 0;
+}
 
-    try {
+/// Times transfers between every bank of the device and host buffers returned
+/// by the given function, and prints the bandwidth achieved in each direction
+template <typename Allocate>
+void PrintTransfers(std::string const &name, Allocate const &allocate,
+                    DeviceGrids &device, const long words,
+                    const int iterations) {
+  const double bytes = static_cast<double>(words) * kDimms * sizeof(Memory_t);
+  // Allocating includes initializing the buffers and releasing them again
+  const auto allocation =
+      Summarize(TimeRepeated([&]() { allocate(); }, 0, iterations));
+  auto host = allocate();
+  const auto toDevice = Summarize(TimeRepeated(
+      [&]() {
+        for (int k = 0; k < kDimms; ++k) {
+          device.banks[k].CopyFromHost(0, words, host[k].data());
+        }
+      },
+      1, iterations));
+  const auto toHost = Summarize(TimeRepeated(
+      [&]() {
+        for (int k = 0; k < kDimms; ++k) {
+          device.banks[k].CopyToHost(0, words, host[k].data());
+        }
+      },
+      1, iterations));
+  std::cout << std::setw(28) << name << std::setw(16) << allocation.median
+            << std::setw(18) << 1e-9 * bytes / toDevice.median << std::setw(18)
+            << 1e-9 * bytes / toHost.median << std::endl;
+}
 
-      std::cout << "Initializing OpenCL context..." << std::flush;
-      hlslib::ocl::Context context;
-      std::cout << " Done.\n";
+/// Compares the transfer bandwidth of host buffers from the default allocator
+/// against the page-aligned buffers of the host arena, and the bandwidth of
+/// converting a grid between the row-major and device layouts.
+int RunTransferBenchmark(int argc, char **argv) {
 
-      std::cout << "Creating program..." << std::flush;
-      auto program =
-          context.MakeProgram(kKernelString + std::string(".xclbin"));
-      std::cout << " Done.\n";
+  if (argc != 3 && argc != 5) {
+    std::cerr << "Usage: ./ExecuteKernel transfers <iterations> [<rows> "
+                 "<cols>]"
+              << std::endl;
+    return 1;
+  }
 
-      std::cout << "Allocating device memory..." << std::flush;
-      auto device0 =
-          context.MakeBuffer<Memory_t, hlslib::ocl::Access::readWrite>(
-              hlslib::ocl::MemoryBank::bank0, kTotalElementsMemory);
-      auto device1 =
-          context.MakeBuffer<Memory_t, hlslib::ocl::Access::readWrite>(
-              hlslib::ocl::MemoryBank::bank1, kTotalElementsMemory);
-      std::cout << " Done." << std::endl;
+  const int iterations = std::stoi(argv[2]);
+  int rows = kRows;
+  int cols = kCols;
+  if (argc == 5) {
+    rows = std::stoi(argv[3]);
+    cols = std::stoi(argv[4]);
+  }
+  try {
+    if (iterations < 1 || rows < 1 || cols < 1) {
+      throw std::invalid_argument(
+          "Dimensions and iterations must be positive.");
+    }
+    if (rows % kBankGroupRows != 0 || cols % kMemoryWidth != 0) {
+      throw std::invalid_argument(
+          "Rows must be divisable by the rows of a group of every bank, and "
+          "columns by the memory width.");
+    }
+  } catch (std::invalid_argument const &err) {
+    std::cerr << "Invalid dimensions: " << err.what() << std::endl;
+    return 1;
+  }
+  const long words = 2 * TotalElementsMemory(rows, cols) / kDimms;
 
-      if (verify) {
-        std::cout << "Initializing memory..." << std::flush;
-        hostSplit0 = std::vector<Memory_t>(
-            kTotalElementsMemory, Memory_t(Kernel_t(static_cast<Data_t>(0))));
-        hostSplit1 = std::vector<Memory_t>(
-            kTotalElementsMemory, Memory_t(Kernel_t(static_cast<Data_t>(0))));
-        device0.CopyFromHost(hostSplit0.cbegin());
-        device1.CopyFromHost(hostSplit1.cbegin());
-        std::cout << " Done." << std::endl;
-      }
+  try {
 
-      std::cout << "Creating kernel..." << std::flush;
-      auto kernel = program.MakeKernel(JacobiTwoDimms, "JacobiTwoDimms",
-                                       device0, device0, device1, device1);
-      std::cout << " Done." << std::endl;
+    std::cout << "Loading program..." << std::flush;
+    Runtime runtime;
+    std::cout << " Done." << std::endl;
 
-      const auto readSize =
-          static_cast<float>(kTimeFolded) * kTotalInputMemory * sizeof(Memory_t);
-      const auto writeSize = static_cast<float>(kTimeFolded) *
-                             kTotalElementsMemory * sizeof(Memory_t);
-      const auto transferred = readSize + writeSize;
+    std::cout << "Allocating device memory..." << std::flush;
+    const auto device = runtime.Acquire(1, rows, cols, kDepth);
+    std::cout << " Done." << std::endl;
 
-      std::cout << "Executing kernel..." << std::flush;
-      auto begin = std::chrono::high_resolution_clock::now();
-      kernel.ExecuteTask();
-      auto end = std::chrono::high_resolution_clock::now();
-      double elapsed =
-          1e-9 *
-          std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
-              .count();
-      std::cout << " Done.\nMoved " << 1e-9 * transferred << " GB in " << elapsed
-                << " seconds, bandwidth " << (1e-9 * transferred / elapsed)
-                << " GB/s\nEvaluated " << kTimeTotal * kRows * kCols
-                << " cells in " << elapsed << " seconds, performance "
-                << 4e-9 * (kTimeTotal * kRows * kCols) / elapsed << " GOp/s"
-                << std::endl;
-      if (verify) {
-        std::cout << "Copying back memory..." << std::flush;
-        device0.CopyToHost(hostSplit0.begin());
-        device1.CopyToHost(hostSplit1.begin());
-        std::cout << " Done." << std::endl;
+    std::cout << std::setw(28) << "Host buffer" << std::setw(16)
+              << "Allocate [s]" << std::setw(18) << "To device [GB/s]"
+              << std::setw(18) << "To host [GB/s]" << std::endl;
+    PrintTransfers("std::vector",
+                   [&]() {
+                     return std::vector<std::vector<Memory_t>>(
+                         kDimms, std::vector<Memory_t>(words));
+                   },
+                   *device, words, iterations);
+#ifdef STENCIL_HOST_HUGE_PAGES
+    const std::string aligned = "Aligned arena, huge pages";
+#else
+    const std::string aligned = "Aligned arena";
+#endif
+    PrintTransfers(aligned,
+                   [&]() {
+                     return std::vector<HostBuffer_t>(kDimms,
+                                                      HostBuffer_t(words));
+                   },
+                   *device, words, iterations);
+
+    // Converting between row-major grids and the device layout on a single
+    // thread and on every core
+    const auto grids =
+        std::vector<std::vector<Data_t>>(1, InputGrid(rows, cols));
+    auto unpacked = grids;
+    std::vector<HostBuffer_t> single(1, HostBuffer_t(kDimms * words));
+    std::vector<HostBuffer_t> banks(kDimms, HostBuffer_t(words));
+    const auto singleOut = BankPointers(single);
+    const auto banksOut = BankPointers(banks);
+    const std::vector<Memory_t const *> singleIn(singleOut.begin(),
+                                                 singleOut.end());
+    const std::vector<Memory_t const *> banksIn(banksOut.begin(),
+                                                banksOut.end());
+    const double gridBytes =
+        static_cast<double>(rows) * cols * sizeof(Data_t);
+    const double bufferBytes =
+        static_cast<double>(words) * kDimms * sizeof(Memory_t);
+    std::cout << "\n" << std::setw(28) << "Layout conversion"
+              << std::setw(16) << "Threads" << std::setw(18) << "Median [s]"
+              << std::setw(18) << "Bandwidth [GB/s]" << std::endl;
+    const auto printLayout = [&](std::string const &name, const double bytes,
+                                 std::function<void(int)> const &convert) {
+      for (const int threads : {1, 0}) {
+        const auto timing = Summarize(TimeRepeated(
+            [&]() { convert(threads); }, 1, iterations));
+        std::cout << std::setw(28) << name << std::setw(16)
+                  << ((threads > 0) ? std::to_string(threads) : "all")
+                  << std::setw(18) << timing.median << std::setw(18)
+                  << 1e-9 * bytes / timing.median << std::endl;
       }
+    };
+    const std::string nBanks = std::to_string(kDimms) + " banks";
+    printLayout("Pack, single buffer", gridBytes, [&](const int threads) {
+      PackGrids(grids, singleOut, rows, cols, threads);
+    });
+    printLayout("Pack, " + nBanks, gridBytes, [&](const int threads) {
+      PackGrids(grids, banksOut, rows, cols, threads);
+    });
+    printLayout("Unpack, single buffer", gridBytes, [&](const int threads) {
+      UnpackGrids(singleIn, unpacked, rows, cols, 0, threads);
+    });
+    printLayout("Unpack, " + nBanks, gridBytes, [&](const int threads) {
+      UnpackGrids(banksIn, unpacked, rows, cols, 0, threads);
+    });
+    printLayout("Split into " + nBanks, bufferBytes, [&](const int threads) {
+      CopyLayout(singleIn, banksOut, 2 * rows, rows, cols, threads);
+    });
+    printLayout("Merge from " + nBanks, bufferBytes, [&](const int threads) {
+      CopyLayout(banksIn, singleOut, 2 * rows, rows, cols, threads);
+    });
+
+  } catch (std::runtime_error const &err) {
+    std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+
+  if (kTrace) {
+    NameTraceThread("main");
+  }
+  TraceWriter traceWriter(std::string(kKernelString) + "_trace.json");
 
-    } catch (std::runtime_error const &err) {
-      std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+  if (argc > 1 && std::string(argv[1]) == "outofcore") {
+    return RunStrips(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "batch") {
+    return RunBatchBenchmark(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "transfers") {
+    return RunTransferBenchmark(argc, argv);
+  }
+
+  const bool benchmark = argc > 1 && std::string(argv[1]) == "benchmark";
+  const bool solve = argc > 1 && std::string(argv[1]) == "solve";
+  if ((!benchmark && !solve && argc != 1 && argc != 2 && argc != 6) ||
+      ((benchmark || solve) && argc != 5 && argc != 9)) {
+    std::cerr << "Usage: ./ExecuteKernel [<verify [on/off]> [<rows> <cols> "
+                 "<blocks> <timesteps>]]\n"
+                 "       ./ExecuteKernel benchmark <warmup> <iterations> "
+                 "<json/csv> [<rows> <cols> <blocks> <timesteps>]\n"
+                 "       ./ExecuteKernel solve <max/l2> <tolerance> "
+                 "<max launches> [<rows> <cols> <blocks> <timesteps per "
+                 "launch>]\n"
+                 "       ./ExecuteKernel outofcore <strip rows> <verify "
+                 "[on/off]> [<rows> <cols> <blocks> <timesteps>]\n"
+                 "       ./ExecuteKernel batch <max grids> <iterations> "
+                 "[<rows> <cols> <blocks> <timesteps>]\n"
+                 "       ./ExecuteKernel transfers <iterations> [<rows> "
+                 "<cols>]"
+              << std::endl;
+    return 1;
+  }
+
+  bool verify = false;
+  BenchmarkOptions options;
+  SolveOptions solveOptions;
+  if (solve) {
+    solveOptions.norm = argv[2];
+    solveOptions.tolerance = std::stod(argv[3]);
+    solveOptions.maxLaunches = std::stoi(argv[4]);
+    if (solveOptions.norm != "max" && solveOptions.norm != "l2") {
+      std::cerr << "Residual norm must be either \"max\" or \"l2\"."
                 << std::endl;
       return 1;
     }
+    if (solveOptions.tolerance < 0 || solveOptions.maxLaunches < 1) {
+      std::cerr << "Tolerance must be non-negative, and at least one launch "
+                   "is required."
+                << std::endl;
+      return 1;
+    }
+  } else if (benchmark) {
+    options.warmup = std::stoi(argv[2]);
+    options.iterations = std::stoi(argv[3]);
+    options.format = argv[4];
+    if (options.warmup < 0 || options.iterations < 1) {
+      std::cerr << "At least one measured iteration is required." << std::endl;
+      return 1;
+    }
+    if (options.format != "json" && options.format != "csv") {
+      std::cerr << "Benchmark format must be either \"json\" or \"csv\"."
+                << std::endl;
+      return 1;
+    }
+  } else if (argc >= 2) {
+    if (std::string(argv[1]) == "on") {
+      verify = true;
+    } else if (std::string(argv[1]) == "off") {
+      verify = false;
+    } else {
+      std::cerr << "Verify option must be either \"on\" or \"off\"."
+                << std::endl;
+      return 1;
+    }
+  }
 
-    // Verification
-    if (verify) {
-      std::cout << "Reassembling memory..." << std::flush;
-      std::vector<Memory_t> host(kTotalElementsMemory);
-      for (int rIn = 0, rOut = 0; rOut < kRows; ++rIn, rOut += 2) {
-        static constexpr auto kMemoryCols = kCols / kMemoryWidth;
-        const auto iStart = rIn * kMemoryCols;
-        std::copy(hostSplit0.begin() + iStart,
-                  hostSplit0.begin() + iStart + kMemoryCols,
-                  host.begin() + rOut * kMemoryCols);
-        std::copy(hostSplit1.begin() + iStart,
-                  hostSplit1.begin() + iStart + kMemoryCols,
-                  host.begin() + (rOut + 1) * kMemoryCols);
+  // Every launch starts reading from the first half of the ping-pong buffer,
+  // so the result of a launch must end up there as well
+  const auto check = [solve](Dimensions const &d) {
+    if (solve && TimeFolded(d.timesteps) % 2 != 0) {
+      throw std::invalid_argument(
+          "Timesteps per launch must fold into an even number of passes of "
+          "the kernel depth (" + std::to_string(kDepth) + ").");
+    }
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, (benchmark || solve) ? 5 : 2, dimensions,
+                       check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const long totalElementsMemory = TotalElementsMemory(rows, cols);
+  const long timeFolded = TimeFolded(timesteps);
+  // Every edge holds the constant boundary value also used for verification
+  const int boundaryModes = kBoundaryModesDirichlet;
+  const auto boundaryHost =
+      PackBoundary(MakeBoundary(rows, cols, boundaryModes), rows, cols);
+
+  // The host holds both grids of the ping-pong buffer, split into banks
+  std::vector<HostBuffer_t> hostBanks;
+
+  try {
+
+    std::cout << "Loading program..." << std::flush;
+    TraceSpan loadSpan("Create runtime");
+    Runtime runtime;
+    loadSpan.End();
+    std::cout << " Done." << std::endl;
+
+    std::cout << "Allocating device memory..." << std::flush;
+    TraceSpan allocateSpan("Acquire device memory");
+    const auto device = runtime.Acquire(1, rows, cols, timesteps);
+    device->boundary.CopyFromHost(0, boundaryHost.size(),
+                                  boundaryHost.cbegin());
+    allocateSpan.End();
+    std::cout << " Done." << std::endl;
+
+    const auto copyIn = [&]() {
+      TraceSpan span("Copy to device");
+      for (int k = 0; k < kDimms; ++k) {
+        device->banks[k].CopyFromHost(0, hostBanks[k].size(),
+                                      hostBanks[k].cbegin());
       }
-      std::cout << " Done." << std::endl;
-      int correct = 0;
-      int mismatches = 0;
-      std::cout << "Running reference implementation..." << std::flush;
-      const auto reference = Reference(std::vector<Data_t>(kRows * kCols, 0));
-      std::cout << " Done." << std::endl;
-      std::cout << "Verifying result..." << std::flush;
-      const int offset = (kTimeFolded % 2 == 0) ? 0 : kTotalElementsMemory;
-      for (int r = 0; r < kRows; ++r) {
-        for (int c = 0; c < kBlockWidthMemory * kBlocks; ++c) {
-          const int index = r * kBlockWidthMemory * kBlocks + c;
-          for (int k = 0; k < kKernelPerMemory; ++k) {
-            const Kernel_t elem = host[offset + index][k];
-            for (int w = 0; w < kKernelWidth; ++w) {
-              const auto expected =
-                  reference[kMemoryWidth * index + kKernelWidth * k + w];
-              const auto actual = elem[w];
-              auto diff = expected - actual;
-              diff = (diff < 0) ? Data_t(-diff) : Data_t(diff);
-              if (diff > 1e-4) {
-                if (mismatches == 0) {
-                  std::cerr << "Mismatch at (" << r << ", "
-                            << c * kMemoryWidth + k * kKernelWidth + w
-                            << "): " << actual << " (should be " << expected << ")"
-                            << std::endl;
-                }
-                ++mismatches;
-              } else {
-                // std::cout << "Correct at (" << r << ", "
-                //           << c * kMemoryWidth + k * kKernelWidth + w
-                //           << "): " << elem[w] << "\n";
-                ++correct;
-              }
-            }
-          }
-        }
+    };
+    const auto copyOut = [&]() {
+      TraceSpan span("Copy to host");
+      for (int k = 0; k < kDimms; ++k) {
+        device->banks[k].CopyToHost(0, hostBanks[k].size(),
+                                    hostBanks[k].begin());
       }
+    };
+
+    if (verify || benchmark || solve) {
+      std::cout << "Initializing memory..." << std::flush;
+      TraceSpan packSpan("Pack grids");
+      hostBanks = PackBanks({InputGrid(rows, cols)}, rows, cols);
+      packSpan.End();
+      copyIn();
       std::cout << " Done." << std::endl;
-      std::cout << "Correct: " << correct << "\nMismatches: " << mismatches
-                << std::endl;
-      if (mismatches == 0) {
-        std::cout << "Verification successful." << std::endl;
-      } else {
-        std::cerr << "Verification failed." << std::endl;
-        return 1;
-      }
     }
 
-  } else {
-    throw std::runtime_error("Unrecognized number of DIMMs.");
+    std::cout << "Creating kernel..." << std::flush;
+    TraceSpan kernelSpan("Create kernel");
+    auto kernel = runtime.MakeKernel(*device, boundaryModes, 1, rows, cols,
+                                     blocks, timesteps);
+    kernelSpan.End();
+    std::cout << " Done." << std::endl;
+    const auto execute = [&]() {
+      TraceSpan span("Execute kernel");
+      kernel.ExecuteTask();
+    };
+
+    if (solve) {
+      const bool converged = RunSolve(
+          execute,
+          [&](std::vector<Residual_t> &values) {
+            device->residual.CopyToHost(0, values.size(), values.begin());
+          },
+          solveOptions, timesteps);
+      return converged ? 0 : 1;
+    }
+
+    if (benchmark) {
+      RunBenchmark(copyIn, execute, copyOut, options, rows, cols, blocks,
+                   timesteps);
+      return 0;
+    }
+
+    const auto transferred = ReadSize(rows, cols, blocks, timesteps) +
+                             WriteSize(rows, cols, timesteps);
+
+    std::cout << "Executing kernel..." << std::flush;
+    auto begin = std::chrono::high_resolution_clock::now();
+    execute();
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed =
+        1e-9 *
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+            .count();
+    std::cout << " Done.\nMoved " << 1e-9 * transferred << " GB in " << elapsed
+              << " seconds, bandwidth " << (1e-9 * transferred / elapsed)
+              << " GB/s\nEvaluated "
+              << static_cast<long>(timesteps) * rows * cols << " cells in "
+              << elapsed << " seconds, performance "
+              << 1e-9 * Stencil_t::kOperations *
+                     (static_cast<double>(timesteps) * rows * cols) / elapsed
+              << " GOp/s" << std::endl;
+    if (kCounters) {
+      std::vector<Counter_t> counters(kCounterEntries);
+      device->counters.CopyToHost(0, kCounterEntries, counters.begin());
+      PrintCounters(counters, boundaryModes, rows, cols, blocks, timesteps,
+                    elapsed);
+    }
+    if (verify) {
+      std::cout << "Copying back memory..." << std::flush;
+      copyOut();
+      std::cout << " Done." << std::endl;
+    }
+
+  } catch (std::runtime_error const &err) {
+    std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+              << std::endl;
+    return 1;
+  }
+
+  // Verification
+  if (verify) {
+    std::cout << "Reassembling memory..." << std::flush;
+    // Reassemble both halves of the ping-pong buffer, as the result resides in
+    // the second half for an odd number of folded timesteps
+    TraceSpan mergeSpan("Reassemble memory");
+    const auto host = MergeBanks(hostBanks, rows, cols);
+    mergeSpan.End();
+    std::cout << " Done." << std::endl;
+    std::cout << "Running reference implementation..." << std::flush;
+    TraceSpan referenceSpan("Reference");
+    const auto reference =
+        Reference(InputGrid(rows, cols), rows, cols, timesteps);
+    referenceSpan.End();
+    std::cout << " Done." << std::endl;
+    std::cout << "Verifying result..." << std::flush;
+    TraceSpan verifySpan("Verify");
+    const long offset = (timeFolded % 2 == 0) ? 0 : totalElementsMemory;
+    const auto statistics = CompareResult(reference, host.data() + offset,
+                                          rows, cols, DefaultTolerance());
+    verifySpan.End();
+    std::cout << " Done." << std::endl;
+    PrintErrorStatistics(std::cout, statistics);
+    std::cout << std::endl;
+    PrintErrorDetails(std::cout, statistics);
+    if (statistics.mismatches == 0) {
+      std::cout << "Verification successful." << std::endl;
+    } else {
+      std::cerr << "Verification failed." << std::endl;
+      return 1;
+    }
   }
 
   return 0;
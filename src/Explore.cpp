@@ -0,0 +1,321 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Stencil.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// FIFOs of at most this many entries are implemented in shift registers
+constexpr long kShiftRegisterDepth = 32;
+
+// Widest memory port supported by the memory interface in bits
+constexpr long kMaxPortBits = 512;
+
+// Largest kernel width and number of blocks considered
+constexpr long kMaxKernelWidth = 64;
+constexpr long kMaxBlocks = 256;
+
+// Number of configurations to print
+constexpr int kPrintTop = 10;
+
+struct Budget {
+  long bram;
+  long uram;
+  long dsp;
+  double bandwidthPerBank;
+  long banks;
+};
+
+struct Resources {
+  long bram;
+  long uram;
+  long dsp;
+};
+
+struct Candidate {
+  DesignPoint design;
+  Resources resources;
+  double efficiency;
+  double compute;
+  double required;
+  double available;
+  double attainable;
+};
+
+/// DSPs used by one floating point adder and multiplier of the given size,
+/// assuming the default full-DSP operator implementations
+void DspPerOperation(const long dataBytes, long &add, long &mult) {
+  if (dataBytes <= 2) {
+    add = 2;
+    mult = 1;
+  } else if (dataBytes <= 4) {
+    add = 2;
+    mult = 3;
+  } else {
+    add = 3;
+    mult = 11;
+  }
+}
+
+/// DSPs used by one stage of the given kernel width, which instantiates the
+/// full stencil for every lane. The stencil is evaluated in the accumulation
+/// type, which can be wider than the data type.
+long DspPerStage(const long kernelWidth) {
+  long add, mult;
+  DspPerOperation(sizeof(Accumulate_t), add, mult);
+  const long mults = Stencil_t::PointList_t::NonUnitWeights() +
+                     (Stencil_t::IsUnitScale() ? 0 : 1);
+  const long adds = Stencil_t::kPoints - 1;
+  return kernelWidth * (adds * add + mults * mult);
+}
+
+/// Block RAMs (36 Kb, 72 bits wide in simple dual port mode) and UltraRAMs
+/// (288 Kb, 72 bits wide) used to implement a FIFO in either memory type
+long Bram36(const long bits, const long entries) {
+  return (entries <= kShiftRegisterDepth)
+             ? 0
+             : ModelCeilDivide(bits, 72) * ModelCeilDivide(entries, 512);
+}
+
+long Uram(const long bits, const long entries) {
+  return (entries <= kShiftRegisterDepth)
+             ? 0
+             : ModelCeilDivide(bits, 72) * ModelCeilDivide(entries, 4096);
+}
+
+/// Estimates the resources of a design, placing on-chip buffers in block RAM
+/// shallowest first until the budget is exhausted, and in UltraRAM after that.
+/// Returns false if the buffers do not fit.
+bool EstimateResources(DesignPoint const &d, const long cols,
+                       Budget const &budget, Resources &resources) {
+  const long dataBits = 8 * sizeof(Data_t);
+  struct Fifo {
+    long bits;
+    long entries;
+  };
+  std::vector<Fifo> fifos;
+  // Line buffers of each stage, sized for the widest input of that stage
+  for (long stage = 0; stage < d.depth; ++stage) {
+    const long inputWidth =
+        ModelBlockWidthKernel(d, cols) +
+        2 * ModelCeilDivide(kRadius * (d.depth - stage), d.kernelWidth);
+    for (long i = 0; i < Stencil_t::kLineBuffers; ++i) {
+      fifos.push_back({d.kernelWidth * dataBits, inputWidth});
+    }
+  }
+  // Memory buffers of the read and write side of each bank
+  for (long k = 0; k < 2 * d.dimms; ++k) {
+    fifos.push_back(
+        {d.memoryWidth * dataBits, (cols / d.blocks) / d.memoryWidth});
+  }
+  std::sort(fifos.begin(), fifos.end(), [](Fifo const &a, Fifo const &b) {
+    return a.entries < b.entries;
+  });
+  resources.bram = 0;
+  resources.uram = 0;
+  for (auto const &f : fifos) {
+    const long bram = Bram36(f.bits, f.entries);
+    if (resources.bram + bram <= budget.bram) {
+      resources.bram += bram;
+    } else {
+      resources.uram += Uram(f.bits, f.entries);
+    }
+  }
+  resources.dsp = d.depth * DspPerStage(d.kernelWidth);
+  return resources.uram <= budget.uram && resources.dsp <= budget.dsp;
+}
+
+/// Mirrors the constraints checked by the static assertions in Stencil.h and
+/// by ValidateDimensions.
+bool IsValid(DesignPoint const &d, const long rows, const long cols) {
+  const long blockWidth = cols / d.blocks;
+  return d.blocks >= 2 && cols % d.blocks == 0 &&
+         blockWidth % d.memoryWidth == 0 && blockWidth % d.kernelWidth == 0 &&
+         d.memoryWidth % d.kernelWidth == 0 && kRadius <= d.kernelWidth &&
+         rows % d.dimms == 0 &&
+         blockWidth / d.memoryWidth >= ModelHaloMemory(d, kRadius) &&
+         d.memoryWidth * 8 * static_cast<long>(sizeof(Data_t)) <=
+             kMaxPortBits;
+}
+
+bool Dominates(Candidate const &a, Candidate const &b) {
+  return a.attainable >= b.attainable && a.resources.dsp <= b.resources.dsp &&
+         a.resources.bram <= b.resources.bram &&
+         a.resources.uram <= b.resources.uram &&
+         a.design.dimms <= b.design.dimms &&
+         (a.attainable > b.attainable || a.resources.dsp < b.resources.dsp ||
+          a.resources.bram < b.resources.bram ||
+          a.resources.uram < b.resources.uram ||
+          a.design.dimms < b.design.dimms);
+}
+
+} // End anonymous namespace
+
+int main(int argc, char **argv) {
+
+  if (argc != 6 && argc != 9 && argc != 10) {
+    std::cerr << "Usage: ./Explore <BRAM36> <URAM> <DSP> <GB/s per bank> "
+                 "<banks> [<rows> <cols> <timesteps> [<clock MHz>]]"
+              << std::endl;
+    return 1;
+  }
+
+  Budget budget;
+  budget.bram = std::stol(argv[1]);
+  budget.uram = std::stol(argv[2]);
+  budget.dsp = std::stol(argv[3]);
+  budget.bandwidthPerBank = std::stod(argv[4]);
+  budget.banks = std::stol(argv[5]);
+  long rows = kRows;
+  long cols = kCols;
+  long timesteps = kTimeTotal;
+  double clock = kTargetClock;
+  if (argc >= 9) {
+    rows = std::stol(argv[6]);
+    cols = std::stol(argv[7]);
+    timesteps = std::stol(argv[8]);
+  }
+  if (argc == 10) {
+    clock = std::stod(argv[9]);
+  }
+  if (budget.bram < 0 || budget.uram < 0 || budget.dsp < 1 ||
+      budget.bandwidthPerBank <= 0 || budget.banks < 1 || rows < 1 ||
+      cols < 1 || timesteps < 1 || clock <= 0) {
+    std::cerr << "Budget and dimensions must be positive." << std::endl;
+    return 1;
+  }
+
+  // Sweep all valid configurations. The depth is bounded by the number of
+  // DSPs, as every stage instantiates the full stencil for every lane, and by
+  // the timesteps, as deeper pipelines only bypass more stages.
+  std::vector<Candidate> candidates;
+  long evaluated = 0;
+  for (long kw = 1; kw <= kMaxKernelWidth; kw *= 2) {
+    const long maxDepth = std::min(timesteps, budget.dsp / DspPerStage(kw));
+    for (long mw = kw; mw * 8 * static_cast<long>(sizeof(Data_t)) <=
+                       kMaxPortBits;
+         mw *= 2) {
+      for (long blocks = 2; blocks <= std::min(kMaxBlocks, cols); ++blocks) {
+        for (long dimms = 1; dimms <= budget.banks; ++dimms) {
+          for (long depth = 1; depth <= maxDepth; ++depth) {
+            const DesignPoint d{depth, kw, mw, blocks, dimms};
+            if (!IsValid(d, rows, cols)) {
+              continue;
+            }
+            ++evaluated;
+            Candidate c;
+            c.design = d;
+            if (!EstimateResources(d, cols, budget, c.resources)) {
+              continue;
+            }
+            // Useful operations over the modeled cycles of the passes
+            // actually run, which include the halos, the rows streamed
+            // beyond the default Dirichlet edges, and the stages bypassed in
+            // the last pass when the timesteps are not a multiple of the
+            // depth
+            const double opsPerCycle =
+                static_cast<double>(rows) * cols * timesteps *
+                Stencil_t::kOperations /
+                ModelCycles<Stencil_t>(
+                    d, rows, cols, timesteps,
+                    InputRows(rows, kBoundaryModesDirichlet, 0) - rows,
+                    PassBarrier(kBoundaryModesDirichlet));
+            c.efficiency = opsPerCycle / ModelOpsPerCycle<Stencil_t>(d);
+            c.compute = 1e-3 * opsPerCycle * clock;
+            c.required = ModelBandwidthRequired(d, sizeof(Data_t), clock);
+            c.available = dimms * budget.bandwidthPerBank;
+            c.attainable = c.compute * std::min(1.0, c.available / c.required);
+            candidates.emplace_back(c);
+          }
+        }
+      }
+    }
+  }
+
+  // Rank designs by attainable performance, breaking ties by the resources
+  // they consume, then discard dominated designs in a single sweep. A design
+  // can only be dominated by one ranked before it, as it attains at most the
+  // same performance and, if equal, consumes strictly more in total. If that
+  // design is itself dominated, the design dominating it is kept and also
+  // dominates this one, so it suffices to compare against the designs kept.
+  std::sort(candidates.begin(), candidates.end(),
+            [](Candidate const &a, Candidate const &b) {
+              if (a.attainable != b.attainable) {
+                return a.attainable > b.attainable;
+              }
+              if (a.resources.dsp != b.resources.dsp) {
+                return a.resources.dsp < b.resources.dsp;
+              }
+              if (a.resources.bram + 8 * a.resources.uram !=
+                  b.resources.bram + 8 * b.resources.uram) {
+                return a.resources.bram + 8 * a.resources.uram <
+                       b.resources.bram + 8 * b.resources.uram;
+              }
+              return a.resources.bram + a.resources.uram + a.design.dimms <
+                     b.resources.bram + b.resources.uram + b.design.dimms;
+            });
+  std::vector<Candidate> pareto;
+  for (auto const &c : candidates) {
+    if (std::none_of(pareto.begin(), pareto.end(),
+                     [&c](Candidate const &o) { return Dominates(o, c); })) {
+      pareto.emplace_back(c);
+    }
+  }
+
+  std::cout << "Grid:           " << rows << "x" << cols << " / " << timesteps
+            << " timesteps\n";
+  std::cout << "Stencil:        " << Stencil_t::kPoints << " points / "
+            << Stencil_t::kOperations << " Op/cell / " << sizeof(Data_t)
+            << " bytes per element / " << sizeof(Accumulate_t)
+            << " bytes accumulated\n";
+  std::cout << "Budget:         " << budget.bram << " BRAM36 / " << budget.uram
+            << " URAM / " << budget.dsp << " DSP / " << budget.banks << "x "
+            << budget.bandwidthPerBank << " GB/s at " << clock << " MHz\n";
+  std::cout << "Configurations: " << evaluated << " valid / "
+            << candidates.size() << " fit / " << pareto.size()
+            << " not dominated\n\n";
+  if (pareto.empty()) {
+    std::cerr << "No configuration fits the budget." << std::endl;
+    return 1;
+  }
+
+  std::cout << std::setw(6) << "Depth" << std::setw(6) << "KW" << std::setw(6)
+            << "MW" << std::setw(7) << "Blocks" << std::setw(6) << "Dimms"
+            << std::setw(7) << "BRAM" << std::setw(6) << "URAM" << std::setw(7)
+            << "DSP" << std::setw(8) << "Eff." << std::setw(11) << "GOp/s"
+            << std::setw(12) << "Bound" << "\n";
+  for (int i = 0; i < std::min<int>(kPrintTop, pareto.size()); ++i) {
+    auto const &c = pareto[i];
+    std::cout << std::setw(6) << c.design.depth << std::setw(6)
+              << c.design.kernelWidth << std::setw(6) << c.design.memoryWidth
+              << std::setw(7) << c.design.blocks << std::setw(6)
+              << c.design.dimms << std::setw(7) << c.resources.bram
+              << std::setw(6) << c.resources.uram << std::setw(7)
+              << c.resources.dsp << std::setw(7) << std::fixed
+              << std::setprecision(1) << 100 * c.efficiency << "%"
+              << std::setw(11) << std::setprecision(2) << c.attainable
+              << std::setw(12)
+              << ((c.available >= c.required) ? "compute" : "bandwidth")
+              << "\n";
+  }
+
+  auto const &best = pareto.front();
+  std::cout.unsetf(std::ios_base::floatfield);
+  std::cout << std::setprecision(6);
+  std::cout << "\nBest configuration:\n"
+            << "  -DSTENCIL_DEPTH=" << best.design.depth
+            << " -DSTENCIL_KERNEL_WIDTH=" << best.design.kernelWidth
+            << " -DSTENCIL_MEMORY_WIDTH=" << best.design.memoryWidth
+            << " -DSTENCIL_BLOCKS=" << best.design.blocks
+            << " -DSTENCIL_DIMMS=" << best.design.dimms
+            << " -DSTENCIL_ROWS=" << rows << " -DSTENCIL_COLS=" << cols
+            << " -DSTENCIL_TIME=" << timesteps
+            << " -DSTENCIL_TARGET_CLOCK=" << clock << std::endl;
+
+  return 0;
+}
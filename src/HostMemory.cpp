@@ -0,0 +1,109 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "HostMemory.h"
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+
+namespace {
+
+size_t RoundUp(const size_t bytes, const size_t multiple) {
+  return (bytes + multiple - 1) / multiple * multiple;
+}
+
+} // End anonymous namespace
+
+HostArena::HostArena(const bool hugePages, const size_t freeBytesMax)
+    : hugePages_(hugePages), freeBytesMax_(freeBytesMax) {}
+
+HostArena::~HostArena() {
+  for (auto const &block : free_) {
+    std::free(block.second);
+  }
+  for (auto const &block : used_) {
+    std::free(block.first);
+  }
+}
+
+void *HostArena::Allocate(const size_t bytes) {
+  const bool huge = hugePages_ && bytes >= kHostHugePageSize;
+  const size_t size =
+      RoundUp(bytes > 0 ? bytes : 1, huge ? kHostHugePageSize : kHostAlignment);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto reuse = free_.lower_bound(size);
+  if (reuse != free_.end() && reuse->first <= 2 * size) {
+    void *const block = reuse->second;
+    used_.emplace(block, reuse->first);
+    freeBytes_ -= reuse->first;
+    free_.erase(reuse);
+    return block;
+  }
+  void *block = nullptr;
+  if (posix_memalign(&block, huge ? kHostHugePageSize : kHostAlignment,
+                     size) != 0) {
+    throw std::bad_alloc();
+  }
+#ifdef MADV_HUGEPAGE
+  // Only a hint: the kernel falls back to regular pages if transparent huge
+  // pages are disabled
+  if (huge) {
+    madvise(block, size, MADV_HUGEPAGE);
+  }
+#endif
+  used_.emplace(block, size);
+  reserved_ += size;
+  return block;
+}
+
+void HostArena::Deallocate(void *const block) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto used = used_.find(block);
+  if (used == used_.end()) {
+    throw std::invalid_argument(
+        "Block was not allocated by this arena or was already freed.");
+  }
+  free_.emplace(used->second, block);
+  freeBytes_ += used->second;
+  used_.erase(used);
+  // Evicting the largest blocks first frees the most memory with the fewest
+  // calls, and keeps the small blocks that are cheap to hold on to
+  while (freeBytes_ > freeBytesMax_) {
+    const auto largest = std::prev(free_.end());
+    std::free(largest->second);
+    freeBytes_ -= largest->first;
+    reserved_ -= largest->first;
+    free_.erase(largest);
+  }
+}
+
+void HostArena::Trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto const &block : free_) {
+    std::free(block.second);
+    reserved_ -= block.first;
+  }
+  free_.clear();
+  freeBytes_ = 0;
+}
+
+size_t HostArena::BytesReserved() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reserved_;
+}
+
+size_t HostArena::BytesFree() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return freeBytes_;
+}
+
+HostArena &HostArena::Global() {
+#ifdef STENCIL_HOST_HUGE_PAGES
+  static HostArena *arena = new HostArena(true);
+#else
+  static HostArena *arena = new HostArena(false);
+#endif
+  return *arena;
+}
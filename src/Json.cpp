@@ -0,0 +1,30 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Json.h"
+#include <cmath>
+#include <cstdio>
+
+void WriteJsonString(std::ostream &stream, std::string const &value) {
+  stream << '"';
+  for (auto c : value) {
+    if (c == '"' || c == '\\') {
+      stream << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      stream << escaped;
+    } else {
+      stream << c;
+    }
+  }
+  stream << '"';
+}
+
+void WriteJsonNumber(std::ostream &stream, const double value) {
+  if (std::isfinite(value)) {
+    stream << value;
+  } else {
+    stream << "null";
+  }
+}
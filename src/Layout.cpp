@@ -0,0 +1,219 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Layout.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+/// Values converted by every task, which keeps tasks large enough to amortize
+/// distributing them between threads, and small grids on a single thread
+constexpr long kLayoutChunkValues = 1 << 16;
+
+/// Memory words hold kMemoryWidth consecutive values, so unless the words are
+/// padded, a row can be copied as a single contiguous array of values, which
+/// the compiler vectorizes
+constexpr bool kContiguousWords =
+    sizeof(Memory_t) == kMemoryWidth * sizeof(Data_t);
+
+/// Calls the function on consecutive ranges of the given rows, distributed
+/// between the given number of threads, or one per core if 0
+template <typename Function>
+void ParallelRows(const long rows, const long cols, const int threads,
+                  Function const &function) {
+  const long chunkRows = std::max(1L, kLayoutChunkValues / cols);
+  const long chunks = (rows + chunkRows - 1) / chunkRows;
+  const long cores = std::max(1U, std::thread::hardware_concurrency());
+  const long workers =
+      std::max(1L, std::min((threads > 0) ? threads : cores, chunks));
+  std::atomic<long> next(0);
+  auto worker = [&]() {
+    for (long i = next++; i < chunks; i = next++) {
+      const long begin = i * chunkRows;
+      function(begin, std::min(begin + chunkRows, rows));
+    }
+  };
+  std::vector<std::thread> pool;
+  for (long i = 1; i < workers; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+void PackRow(Data_t const *values, Memory_t *words, const long cols) {
+  if (kContiguousWords) {
+    std::copy(values, values + cols, reinterpret_cast<Data_t *>(words));
+    return;
+  }
+  for (long c = 0; c < cols; c += kMemoryWidth, ++words) {
+    for (int k = 0; k < kKernelPerMemory; ++k) {
+      Kernel_t elem;
+      for (int w = 0; w < kKernelWidth; ++w) {
+        elem[w] = values[c + k * kKernelWidth + w];
+      }
+      (*words)[k] = elem;
+    }
+  }
+}
+
+/// Offset in memory words of the given row of a batch of ping-pong buffers
+/// within its bank, where the row counts the halves of every ping-pong buffer
+/// as consecutive grids
+long BankOffset(const long row, const long rows, const long cols,
+                const long banks) {
+  return ((row / rows) * (rows / banks) + BankRow(row % rows, banks)) *
+         (cols / kMemoryWidth);
+}
+
+} // End anonymous namespace
+
+void UnpackValues(Memory_t const *words, Data_t *values, const long count) {
+  if (kContiguousWords) {
+    Data_t const *begin = reinterpret_cast<Data_t const *>(words);
+    std::copy(begin, begin + count, values);
+    return;
+  }
+  for (long i = 0; i < count; ++i) {
+    values[i] = words[i / kMemoryWidth][(i % kMemoryWidth) / kKernelWidth]
+                     [i % kKernelWidth];
+  }
+}
+
+GridView::GridView(std::vector<Memory_t *> const &banks, const long rows,
+                   const long cols, const long grid, const long timesteps)
+    : banks_(banks), rows_(rows), cols_(cols),
+      memoryCols_(cols / kMemoryWidth) {
+  const long rowsSplit = rows / banks.size();
+  offset_ = 2 * grid * rowsSplit +
+            ((TimeFolded(timesteps) % 2 == 0) ? 0 : rowsSplit);
+}
+
+std::vector<Memory_t *> BankPointers(std::vector<HostBuffer_t> &banks) {
+  std::vector<Memory_t *> pointers;
+  for (auto &bank : banks) {
+    pointers.emplace_back(bank.data());
+  }
+  return pointers;
+}
+
+std::vector<Memory_t const *> BankPointers(
+    std::vector<HostBuffer_t> const &banks) {
+  std::vector<Memory_t const *> pointers;
+  for (auto const &bank : banks) {
+    pointers.emplace_back(bank.data());
+  }
+  return pointers;
+}
+
+void PackGrids(std::vector<std::vector<Data_t>> const &grids,
+               std::vector<Memory_t *> const &banks, const long rows,
+               const long cols, const int threads) {
+  const long n = banks.size();
+  ParallelRows(grids.size() * rows, cols, threads,
+               [&](const long begin, const long end) {
+                 for (long i = begin; i < end; ++i) {
+                   const long g = i / rows;
+                   const long r = i % rows;
+                   PackRow(grids[g].data() + r * cols,
+                           banks[RowBank(r, n)] +
+                               BankOffset(2 * g * rows + r, rows, cols, n),
+                           cols);
+                 }
+               });
+}
+
+void UnpackGrids(std::vector<Memory_t const *> const &banks,
+                 std::vector<std::vector<Data_t>> &grids, const long rows,
+                 const long cols, const long timesteps, const int threads) {
+  const long n = banks.size();
+  const long half = (TimeFolded(timesteps) % 2 == 0) ? 0 : rows;
+  ParallelRows(grids.size() * rows, cols, threads,
+               [&](const long begin, const long end) {
+                 for (long i = begin; i < end; ++i) {
+                   const long g = i / rows;
+                   const long r = i % rows;
+                   const auto row =
+                       banks[RowBank(r, n)] +
+                       BankOffset(2 * g * rows + half + r, rows, cols, n);
+                   UnpackValues(row, grids[g].data() + r * cols, cols);
+                 }
+               });
+}
+
+void CopyLayout(std::vector<Memory_t const *> const &from,
+                std::vector<Memory_t *> const &to, const long rowsTotal,
+                const long rows, const long cols, const int threads) {
+  const long memoryCols = cols / kMemoryWidth;
+  const long nFrom = from.size();
+  const long nTo = to.size();
+  ParallelRows(rowsTotal, cols, threads, [&](const long begin, const long end) {
+    for (long i = begin; i < end; ++i) {
+      const auto row =
+          from[RowBank(i % rows, nFrom)] + BankOffset(i, rows, cols, nFrom);
+      std::copy(row, row + memoryCols,
+                to[RowBank(i % rows, nTo)] + BankOffset(i, rows, cols, nTo));
+    }
+  });
+}
+
+std::vector<HostBuffer_t> SplitBanks(HostBuffer_t const &host, const long rows,
+                                     const long cols) {
+  const long memoryCols = cols / kMemoryWidth;
+  const long rowsTotal = host.size() / memoryCols;
+  std::vector<HostBuffer_t> banks(
+      kDimms, HostBuffer_t(rowsTotal / kDimms * memoryCols));
+  CopyLayout({host.data()}, BankPointers(banks), rowsTotal, rows, cols);
+  return banks;
+}
+
+HostBuffer_t MergeBanks(std::vector<HostBuffer_t> const &banks,
+                        const long rows, const long cols) {
+  const long memoryCols = cols / kMemoryWidth;
+  const long rowsTotal = banks[0].size() / memoryCols * kDimms;
+  HostBuffer_t host(rowsTotal * memoryCols);
+  CopyLayout(BankPointers(banks), {host.data()}, rowsTotal, rows, cols);
+  return host;
+}
+
+HostBuffer_t PackBatch(std::vector<std::vector<Data_t>> const &grids,
+                       const long rows, const long cols) {
+  HostBuffer_t packed(2 * grids.size() * TotalElementsMemory(rows, cols));
+  PackGrids(grids, {packed.data()}, rows, cols);
+  return packed;
+}
+
+std::vector<std::vector<Data_t>> UnpackBatch(HostBuffer_t const &packed,
+                                             const long rows, const long cols,
+                                             const long timesteps) {
+  const long grids = packed.size() / (2 * TotalElementsMemory(rows, cols));
+  std::vector<std::vector<Data_t>> unpacked(
+      grids, std::vector<Data_t>(rows * cols));
+  UnpackGrids({packed.data()}, unpacked, rows, cols, timesteps);
+  return unpacked;
+}
+
+std::vector<HostBuffer_t> PackBanks(
+    std::vector<std::vector<Data_t>> const &grids, const long rows,
+    const long cols) {
+  std::vector<HostBuffer_t> banks(
+      kDimms, HostBuffer_t(2 * grids.size() * TotalElementsMemory(rows, cols) /
+                           kDimms));
+  PackGrids(grids, BankPointers(banks), rows, cols);
+  return banks;
+}
+
+std::vector<std::vector<Data_t>> UnpackBanks(
+    std::vector<HostBuffer_t> const &banks, const long rows, const long cols,
+    const long timesteps) {
+  const long grids =
+      kDimms * banks[0].size() / (2 * TotalElementsMemory(rows, cols));
+  std::vector<std::vector<Data_t>> unpacked(
+      grids, std::vector<Data_t>(rows * cols));
+  UnpackGrids(BankPointers(banks), unpacked, rows, cols, timesteps);
+  return unpacked;
+}
@@ -2,79 +2,207 @@
 /// @copyright This software is copyrighted under the BSD 3-Clause License. 
 
 #include "Memory.h"
+#include <algorithm>
 #include <cassert>
-#ifndef STENCIL_SYNTHESIS
-#include <thread>
-#endif
 
-template <int dimms>
-void ReadSplit(Memory_t const *input, hlslib::Stream<Memory_t> &buffer) {
-  static_assert(kRows % dimms == 0, "Uneven memory split");
-  static constexpr long kRowsSplit = kRows / dimms;
-  static constexpr long kTotalElementsSplit = kTotalElementsMemory / dimms;
+/// Number of rows held by the given bank from the first row of a group of
+/// every bank up to, but excluding, the given end row
+template <int banks>
+int BankRowsBetween(const int bank, const int groupBegin, const int end) {
+  const int remainder =
+      (end - groupBegin) % (kBankRows * banks) - bank * kBankRows;
+  return ((end - groupBegin) / (kBankRows * banks)) * kBankRows +
+         ((remainder < 0) ? 0
+                          : ((remainder > kBankRows) ? kBankRows : remainder));
+}
+
+/// Reads the rows held by a single bank. Rows are interleaved between banks
+/// in groups of kBankRows rows, such that bank k holds every row r with
+/// (r / kBankRows) % banks == k, and every row of a group is read from the
+/// same bank before moving on to the next group of the bank.
+///
+/// Periodic edges are streamed with a halo of rows or columns read from the
+/// opposite edge of the domain. The rows and columns of Dirichlet edges are
+/// inserted into the stream later by InsertBoundary. With periodic edges,
+/// the kernel streams every pass on its own, such that the previous pass has
+/// been written before it is read.
+///
+/// With halo reuse, the last 2 * kHaloMemory words of every row of a block,
+/// which are the left halo and the first columns of the next block, are kept
+/// in an on-chip FIFO and replayed at the beginning of the same row of the
+/// next block, so every word is only read from memory once per pass.
+///
+/// The grids of a batch are stored back to back, each in its own ping-pong
+/// buffer, and every pass streams all grids before the next pass begins.
+///
+/// With counters enabled, reports the words read from memory, excluding those
+/// replayed from the reuse FIFO, as beats.
+template <int banks>
+void ReadSplit(Memory_t const *input, Stream_t<Memory_t> &buffer,
+               STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+               const int bank, const int boundaryModes, const int grids,
+               const int rows, const int cols, const int blocks,
+               const int timesteps, const int firstPass) {
+  // The host guarantees that the rows can be evenly split between banks
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const int colsMemory = blockWidth * blocks;
+  const long totalElementsSplit = TotalElementsMemory(rows, cols) / banks;
+  const bool periodicRows =
+      BoundaryMode(boundaryModes, kEdgeTop) == kBoundaryPeriodic;
+  const bool periodicCols =
+      BoundaryMode(boundaryModes, kEdgeLeft) == kBoundaryPeriodic;
+  const int haloRows = periodicRows ? kRadius * kDepth : 0;
+  // Rows are counted from the first group boundary at or above the first
+  // halo row. The rows streamed from this bank per block are the rows of its
+  // groups from the first halo row to the last, skipping the rows of its
+  // groups above the halo.
+  static constexpr int kGroupRows = kBankRows * banks;
+  const int rowBase = -((haloRows + kGroupRows - 1) / kGroupRows) * kGroupRows;
+  const int rowSkip = BankRowsBetween<banks>(bank, rowBase, -haloRows);
+  const int rowsSplit =
+      BankRowsBetween<banks>(bank, rowBase, rows + haloRows) - rowSkip;
+  static constexpr long kReuseDepth =
+      kHaloReuse ? ((kRowsMax + 2 * kRadius * kDepth + kGroupRows - 1) /
+                    kGroupRows) *
+                       kBankRows * 2 * kHaloMemory
+                 : 1;
+  Stream_t<Memory_t, kReuseDepth> reuse("reuse");
+  Counter_t stalled = 0;
+  Counter_t beats = 0;
 ReadTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int p = 0; p < timeFolded * grids; ++p) {
+    const int t = p / grids;
+    const int g = p % grids;
   ReadBlocks:
-    for (int b = 0; b < kBlocks; ++b) {
+    for (int b = 0; b < blocks; ++b) {
     ReadRows:
-      for (int r = 0; r < kRowsSplit; ++r) {
+      for (int r = 0; r < rowsSplit; ++r) {
       ReadCols:
-        for (int c = 0; c < kBlockWidthMemory + 2 * kHaloMemory; ++c) {
+        for (int c = 0; c < blockWidth + 2 * kHaloMemory; ++c) {
           #pragma HLS LOOP_FLATTEN
           #pragma HLS PIPELINE
-          const auto offset = (t % 2 == 1) ? kTotalElementsSplit : 0;
-          const auto shift =
-              (b == 0) ? 0
-                       : ((b == kBlocks - 1) ? (2 * kHaloMemory) : kHaloMemory);
-          const auto index = offset + r * kBlockWidthMemory * kBlocks +
-                             b * kBlockWidthMemory + c - shift;
-          assert(index >= 0);
-          assert(index < 2 * kTotalElementsSplit);
-          const auto read = input[index];
-          if ((b > 0 || c < kBlockWidthMemory + kHaloMemory) &&
-              (b < kBlocks - 1 || c >= kHaloMemory)) {
+          const auto offset =
+              (2 * static_cast<long>(g) + (firstPass + t) % 2) *
+              totalElementsSplit;
+          // Row and column in the domain, wrapped around periodic edges. The
+          // halo never exceeds the rows or the block width.
+          const int groupRow = rowSkip + r;
+          const int row = rowBase + (groupRow / kBankRows) * kGroupRows +
+                          bank * kBankRows + groupRow % kBankRows;
+          const int rowWrapped =
+              (row < 0) ? (row + rows) : ((row >= rows) ? (row - rows) : row);
+          const int col = b * blockWidth + c - kHaloMemory;
+          const int colWrapped =
+              (col < 0) ? (col + colsMemory)
+                        : ((col >= colsMemory) ? (col - colsMemory) : col);
+          const auto index =
+              offset + BankRow(rowWrapped, banks) * colsMemory + colWrapped;
+          const bool left = b > 0 || periodicCols;
+          const bool right = b < blocks - 1 || periodicCols;
+          if ((left || c >= kHaloMemory) &&
+              (right || c < blockWidth + kHaloMemory)) {
+            // Position within the columns of this block including halos
+            const int pos = left ? c : (c - kHaloMemory);
+            const int inputWidth = blockWidth + (left ? kHaloMemory : 0) +
+                                   (right ? kHaloMemory : 0);
+            Memory_t read;
+            if (kHaloReuse && b > 0 && pos < 2 * kHaloMemory) {
+              read = reuse.Pop();
+            } else {
+              assert(index >= 0);
+              assert(index < 2 * grids * totalElementsSplit);
+              read = input[index];
+              ++beats;
+            }
+            if (kHaloReuse && b < blocks - 1 &&
+                pos >= inputWidth - 2 * kHaloMemory) {
+              reuse.Push(read);
+            }
+            if (kCounters && buffer.IsFull()) {
+              ++stalled;
+            }
             buffer.Push(read);
           }
         }
       }
     }
   }
+#ifdef STENCIL_ENABLE_COUNTERS
+  counters.Push(MakeCounters(static_cast<Counter_t>(timeFolded) * grids *
+                                 blocks * rowsSplit *
+                                 (blockWidth + 2 * kHaloMemory),
+                             stalled, beats));
+#endif
 }
 
-// Two DIMM demux
-void DemuxRead(hlslib::Stream<Memory_t> &buffer0,
-               hlslib::Stream<Memory_t> &buffer1,
-               hlslib::Stream<Memory_t> &pipe) {
+/// Merges the rows read from each bank back into a single stream in row order,
+/// moving on to the next bank after every group of kBankRows rows
+template <int banks>
+void DemuxRead(Stream_t<Memory_t> buffers[banks],
+               Stream_t<Memory_t> &pipe, const int boundaryModes,
+               const int grids, const int rows, const int cols,
+               const int blocks, const int timesteps) {
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const bool periodicRows =
+      BoundaryMode(boundaryModes, kEdgeTop) == kBoundaryPeriodic;
+  const bool periodicCols =
+      BoundaryMode(boundaryModes, kEdgeLeft) == kBoundaryPeriodic;
+  const int haloRows = periodicRows ? kRadius * kDepth : 0;
+  const int inputRows = rows + 2 * haloRows;
+  const long totalInput =
+      static_cast<long>(inputRows) *
+      (blocks * (blockWidth + 2 * kHaloMemory) -
+       (periodicCols ? 0 : 2 * kHaloMemory));
+  // Bank of the first row of every block, which is the first halo row for
+  // periodic rows, and the position of that row within its group
+  const int groupsAbove = (haloRows + kBankRows - 1) / kBankRows;
+  const int bankBegin = (banks - groupsAbove % banks) % banks;
+  const int groupRowBegin = groupsAbove * kBankRows - haloRows;
   int b = 0;
   int r = 0;
   int c = 0;
+  int bank = bankBegin;
+  int groupRow = groupRowBegin;
 DemuxTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int t = 0; t < timeFolded * grids; ++t) {
   DemuxSpace:
-    for (int i = 0; i < kTotalInputMemory; ++i) {
+    for (long i = 0; i < totalInput; ++i) {
       #pragma HLS LOOP_FLATTEN
       #pragma HLS PIPELINE
-      if (r % 2 == 0) {
-        pipe.Push(buffer0.Pop());
-      } else {
-        pipe.Push(buffer1.Pop());
+      Memory_t read;
+    DemuxBanks:
+      for (int k = 0; k < banks; ++k) {
+        #pragma HLS UNROLL
+        if (k == bank) {
+          read = buffers[k].Pop();
+        }
       }
-      const bool lastCol = ((b == 0 || b == kBlocks - 1) &&
-                            c == kBlockWidthMemory + kHaloMemory - 1) ||
-                           ((b > 0 && b < kBlocks - 1) &&
-                            c == kBlockWidthMemory + 2 * kHaloMemory - 1);
+      pipe.Push(read);
+      const int inputWidth =
+          blockWidth + ((b > 0 || periodicCols) ? kHaloMemory : 0) +
+          ((b < blocks - 1 || periodicCols) ? kHaloMemory : 0);
       // We need nasty index calculations due to the irregular loop structure
-      if (lastCol) {
+      if (c == inputWidth - 1) {
         c = 0;
-        if (r == kRows - 1) {
+        if (r == inputRows - 1) {
           r = 0;
-          if (b == kBlocks - 1) {
+          bank = bankBegin;
+          groupRow = groupRowBegin;
+          if (b == blocks - 1) {
             b = 0;
           } else {
             ++b;
           }
         } else {
           ++r;
+          if (groupRow == kBankRows - 1) {
+            groupRow = 0;
+            bank = (bank == banks - 1) ? 0 : (bank + 1);
+          } else {
+            ++groupRow;
+          }
         }
       } else {
         ++c;
@@ -83,21 +211,115 @@ DemuxTime:
   }
 }
 
-/// Convert from memory width to kernel width
-void Widen(hlslib::Stream<Memory_t> &in, hlslib::Stream<Kernel_t> &out) {
+/// Inserts the rows and columns beyond Dirichlet edges into the stream read
+/// from memory, taking their values from the boundary buffer. Columns beyond
+/// a Dirichlet edge take the value of the edge in their row, where rows beyond
+/// the top and bottom wrap around for periodic edges and are clamped to the
+/// domain otherwise. Rows beyond a Dirichlet edge take the value of the edge
+/// in their column. Every grid of a batch shares the same boundary.
+void InsertBoundary(Stream_t<Memory_t> &in, Memory_t const *boundary,
+                    Stream_t<Memory_t> &out, const int boundaryModes,
+                    const int grids, const int rows, const int cols,
+                    const int blocks, const int timesteps) {
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const int colsMemory = blockWidth * blocks;
+  const int modeTop = BoundaryMode(boundaryModes, kEdgeTop);
+  const int modeBottom = BoundaryMode(boundaryModes, kEdgeBottom);
+  const int modeLeft = BoundaryMode(boundaryModes, kEdgeLeft);
+  const int modeRight = BoundaryMode(boundaryModes, kEdgeRight);
+  const int rowsTop = BoundaryRows(modeTop, 0);
+  const int inputRows = InputRows(rows, boundaryModes, 0);
+  const bool colsLeft = BoundaryCols(modeLeft);
+  const bool colsRight = BoundaryCols(modeRight);
+InsertTime:
+  for (int t = 0; t < timeFolded * grids; ++t) {
+  InsertBlocks:
+    for (int b = 0; b < blocks; ++b) {
+    InsertRows:
+      for (int r = 0; r < inputRows; ++r) {
+      InsertCols:
+        for (int c = 0; c < blockWidth + 2 * kHaloMemory; ++c) {
+          #pragma HLS LOOP_FLATTEN
+          #pragma HLS PIPELINE
+          if ((b > 0 || colsLeft || c >= kHaloMemory) &&
+              (b < blocks - 1 || colsRight || c < blockWidth + kHaloMemory)) {
+            const int row = r - rowsTop;
+            const int col = b * blockWidth + c - kHaloMemory;
+            const bool dirichletCol =
+                (col < 0 && modeLeft == kBoundaryDirichlet) ||
+                (col >= colsMemory && modeRight == kBoundaryDirichlet);
+            const bool dirichletRow =
+                (row < 0 && modeTop == kBoundaryDirichlet) ||
+                (row >= rows && modeBottom == kBoundaryDirichlet);
+            Memory_t read;
+            if (dirichletCol) {
+              const int rowClamped =
+                  (row < 0)
+                      ? ((modeTop == kBoundaryPeriodic) ? (row + rows) : 0)
+                      : ((row >= rows) ? ((modeBottom == kBoundaryPeriodic)
+                                              ? (row - rows)
+                                              : (rows - 1))
+                                       : row);
+              const long index =
+                  BoundaryOffset((col < 0) ? kEdgeLeft : kEdgeRight, rows,
+                                 cols) +
+                  rowClamped / kMemoryWidth;
+              const Memory_t word = boundary[index];
+              const Kernel_t elem =
+                  word[(rowClamped % kMemoryWidth) / kKernelWidth];
+              read = Memory_t(Kernel_t(elem[rowClamped % kKernelWidth]));
+            } else if (dirichletRow) {
+              const int colWrapped =
+                  (col < 0) ? (col + colsMemory)
+                            : ((col >= colsMemory) ? (col - colsMemory) : col);
+              read = boundary[BoundaryOffset((row < 0) ? kEdgeTop : kEdgeBottom,
+                                             rows, cols) +
+                              colWrapped];
+            } else {
+              read = in.Pop();
+            }
+            out.Push(read);
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Convert from memory width to kernel width. Each pass streams all blocks,
+/// which each consist of the given number of rows including their halos. The
+/// first and last block only stream the halo at the edge of the domain if the
+/// corresponding flag is set. Reports its counters if instantiated with count,
+/// which is only the case for the two-dimensional kernel.
+template <bool count>
+void Widen(Stream_t<Memory_t> &in, Stream_t<Kernel_t> &out,
+           STENCIL_COUNTERS(Stream_t<Counters_t> &counters,) const int passes,
+           const int rows, const int cols, const int blocks,
+           const bool haloLeft, const bool haloRight) {
+  const int blockWidth = BlockWidthKernel(cols, blocks);
+  const long totalInput =
+      static_cast<long>(rows) *
+      (blocks * (blockWidth + 2 * kHaloKernel) - (haloLeft ? 0 : kHaloKernel) -
+       (haloRight ? 0 : kHaloKernel));
   Memory_t memoryBlock;
   bool readNext = true;
-  unsigned char memIndex = 0;
+  unsigned char memIndex = haloLeft ? kAlignmentGap : 0;
   int b = 0;
   int r = 0;
   int c = 0;
+  Counter_t stalled = 0;
 WidenTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int t = 0; t < passes; ++t) {
   WidenSpace:
-    for (int i = 0; i < kTotalInputKernel; ++i) {
+    for (long i = 0; i < totalInput; ++i) {
       #pragma HLS LOOP_FLATTEN
       #pragma HLS PIPELINE
 
+      if (count && ((readNext && in.IsEmpty()) || out.IsFull())) {
+        ++stalled;
+      }
+
       if (readNext) {
         memoryBlock = in.Pop();
       }
@@ -105,21 +327,23 @@ WidenTime:
       const Kernel_t elem = memoryBlock[memIndex];
       out.Push(elem);
 
-      const bool lastCol = ((b == 0 || b == kBlocks - 1) &&
-                            c == kBlockWidthKernel + kHaloKernel - 1) ||
-                           ((b > 0 && b < kBlocks - 1) &&
-                            c == kBlockWidthKernel + 2 * kHaloKernel - 1);
-      const bool nextAligned =
-          (b == 0 && r < kRows - 1) || (b == kBlocks - 1 && r == kRows - 1);
+      const int inputWidth = blockWidth +
+                             ((b > 0 || haloLeft) ? kHaloKernel : 0) +
+                             ((b < blocks - 1 || haloRight) ? kHaloKernel : 0);
+      // The next row starts at a memory word boundary unless its block has a
+      // left halo, of which only the last kHaloKernel vectors are used
+      const int bNext =
+          (r < rows - 1) ? b : ((b == blocks - 1) ? 0 : (b + 1));
+      const bool nextAligned = bNext == 0 && !haloLeft;
 
       // We need nasty index calculations due to the irregular loop structure
-      if (lastCol) {
+      if (c == inputWidth - 1) {
         c = 0;
         readNext = true;
         memIndex = nextAligned ? 0 : kAlignmentGap;  
-        if (r == kRows - 1) {
+        if (r == rows - 1) {
           r = 0;
-          if (b == kBlocks - 1) {
+          if (b == blocks - 1) {
             b = 0;
           } else {
             ++b;
@@ -134,54 +358,93 @@ WidenTime:
       }
     }
   }
+#ifdef STENCIL_ENABLE_COUNTERS
+  if (count) {
+    counters.Push(
+        MakeCounters(static_cast<Counter_t>(passes) * totalInput, stalled, 0));
+  }
+#endif
 }
 
-template <int dimms>
-void WriteSplit(hlslib::Stream<Memory_t> &buffer, Memory_t *output) {
-  static_assert(kRows % dimms == 0, "Uneven memory split");
-  static constexpr long kRowsSplit = kRows / dimms;
-  static constexpr long kTotalElementsSplit = kTotalElementsMemory / dimms;
+/// Writes the rows held by a single bank, interleaved in groups like in
+/// ReadSplit, such that the rows of the bank are consecutive in memory
+template <int banks>
+void WriteSplit(Stream_t<Memory_t> &buffer, Memory_t *output,
+                STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+                const int grids, const int rows, const int cols,
+                const int blocks, const int timesteps, const int firstPass) {
+  // The host guarantees that the rows can be evenly split between banks
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const int rowsSplit = rows / banks;
+  const long totalElementsSplit = TotalElementsMemory(rows, cols) / banks;
+  Counter_t stalled = 0;
 WriteTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int p = 0; p < timeFolded * grids; ++p) {
+    const int t = p / grids;
+    const int g = p % grids;
   WriteBlocks:
-    for (int b = 0; b < kBlocks; ++b) {
+    for (int b = 0; b < blocks; ++b) {
     WriteRows:
-      for (int r = 0; r < kRowsSplit; ++r) {
+      for (int r = 0; r < rowsSplit; ++r) {
       WriteCols:
-        for (int c = 0; c < kBlockWidthMemory; ++c) {
+        for (int c = 0; c < blockWidth; ++c) {
           #pragma HLS LOOP_FLATTEN
           #pragma HLS PIPELINE
-          const auto offset = (t % 2 == 0) ? kTotalElementsSplit : 0;
+          const auto offset =
+              ((firstPass + t) % 2 == 0) ? totalElementsSplit : 0;
+          if (kCounters && buffer.IsEmpty()) {
+            ++stalled;
+          }
           const auto read = buffer.Pop();
-          const auto index = (offset + r * kBlockWidthMemory * kBlocks +
-                              b * kBlockWidthMemory + c) %
-                             (2 * kTotalElementsSplit);
+          // The offset selects the half of the ping-pong buffer, and never
+          // wraps around it
+          const auto index = 2 * static_cast<long>(g) * totalElementsSplit +
+                             offset +
+                             static_cast<long>(r) * blockWidth * blocks +
+                             b * blockWidth + c;
           assert(index >= 0);
-          assert(index < 2 * kTotalElementsSplit);
+          assert(index < 2 * grids * totalElementsSplit);
           output[index] = read;
         }
       }
     }
   }
+#ifdef STENCIL_ENABLE_COUNTERS
+  // Every iteration writes one word
+  const Counter_t active =
+      static_cast<Counter_t>(timeFolded) * grids * blocks * rowsSplit *
+      blockWidth;
+  counters.Push(MakeCounters(active, stalled, active));
+#endif
 }
 
-void MuxWrite(hlslib::Stream<Memory_t> &pipe, hlslib::Stream<Memory_t> &buffer0,
-              hlslib::Stream<Memory_t> &buffer1) {
+/// Distributes the rows of the output stream between banks, sending every
+/// group of kBankRows rows to the same bank
+template <int banks>
+void MuxWrite(Stream_t<Memory_t> &pipe,
+              Stream_t<Memory_t> buffers[banks], const int grids,
+              const int rows, const int cols, const int blocks,
+              const int timesteps) {
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
 MuxTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int t = 0; t < timeFolded * grids; ++t) {
   MuxBlocks:
-    for (int b = 0; b < kBlocks; ++b) {
+    for (int b = 0; b < blocks; ++b) {
     MuxRows:
-      for (int r = 0; r < kRows; ++r) {
+      for (int r = 0; r < rows; ++r) {
       MuxCols:
-        for (int c = 0; c < kBlockWidthMemory; ++c) {
+        for (int c = 0; c < blockWidth; ++c) {
           #pragma HLS LOOP_FLATTEN
           #pragma HLS PIPELINE
           const auto read = pipe.Pop();
-          if (r % 2 == 0) {
-            buffer0.Push(read);
-          } else {
-            buffer1.Push(read);
+        MuxBanks:
+          for (int k = 0; k < banks; ++k) {
+            #pragma HLS UNROLL
+            if (k == RowBank(r, banks)) {
+              buffers[k].Push(read);
+            }
           }
         }
       }
@@ -189,17 +452,21 @@ MuxTime:
   }
 }
 
-/// Convert from kernel width to memory width
-void Narrow(hlslib::Stream<Kernel_t> &in, hlslib::Stream<Memory_t> &out) {
+/// Convert from kernel width to memory width. Each pass streams all blocks,
+/// which each consist of the given number of rows.
+void Narrow(Stream_t<Kernel_t> &in, Stream_t<Memory_t> &out,
+            const int passes, const int rows, const int cols,
+            const int blocks) {
+  const int blockWidth = BlockWidthKernel(cols, blocks);
   Memory_t memoryBlock;
 NarrowTime:
-  for (int t = 0; t < kTimeFolded; ++t) {
+  for (int t = 0; t < passes; ++t) {
   NarrowBlocks:
-    for (int b = 0; b < kBlocks; ++b) {
+    for (int b = 0; b < blocks; ++b) {
     NarrowRows:
-      for (int r = 0; r < kRows; ++r) {
+      for (int r = 0; r < rows; ++r) {
       NarrowCol:
-        for (int c = 0; c < kBlockWidthKernel; ++c) {
+        for (int c = 0; c < blockWidth; ++c) {
           #pragma HLS LOOP_FLATTEN
           #pragma HLS PIPELINE
           const auto read = in.Pop();
@@ -214,95 +481,501 @@ NarrowTime:
   }
 }
 
+/// Writes the residual of every folded pass of every grid. The residuals
+/// arrive pass by pass, and are stored grid by grid.
+void WriteResidualMemory(Stream_t<Residual_t> &in, Residual_t *residual,
+                         const int grids, const int timesteps,
+                         const int firstPass, const int passes) {
+  const int timeFolded = TimeFolded(timesteps);
+WriteResidual:
+  for (int p = 0; p < timeFolded * grids; ++p) {
+    #pragma HLS PIPELINE
+    residual[(p % grids) * passes + firstPass + p / grids] = in.Pop();
+  }
+}
+
+#ifdef STENCIL_ENABLE_COUNTERS
+
+/// Takes the counters of a process once it has reported them. In hardware the
+/// streams are polled, such that the caller can count cycles in the meantime.
+void PollCounters(Stream_t<Counters_t> &in, Counters_t &report,
+                  bool &reported) {
+  #pragma HLS INLINE
+#ifdef STENCIL_SYNTHESIS
+  if (!reported && !in.IsEmpty()) {
+    report = in.Pop();
+    reported = true;
+  }
+#else
+  if (!reported) {
+    report = in.Pop();
+    reported = true;
+  }
+#endif
+}
+
+/// Collects the counters reported by every instrumented process at its end,
+/// and writes them to the counter buffer together with the cycles taken by
+/// the kernel, leaving the counters of banks that are not used at zero. In
+/// hardware, cycles are counted until every process has reported. In
+/// simulation, which has no notion of cycles, the kernel takes as many cycles
+/// as its busiest process was active or stalled. When the passes of a kernel
+/// are streamed one at a time, every pass but the first adds its counters to
+/// those already written.
+void WriteCountersMemory(Stream_t<Counters_t> readCounters[kDimms],
+                         Stream_t<Counters_t> &widenCounters,
+                         Stream_t<Counters_t> computeCounters[kDepth],
+                         Stream_t<Counters_t> writeCounters[kDimms],
+                         Counter_t *memory, const int banks,
+                         const int firstPass) {
+  Counters_t reports[kCounterProcesses];
+  #pragma HLS ARRAY_PARTITION variable=reports complete
+  bool reported[kCounterProcesses];
+  #pragma HLS ARRAY_PARTITION variable=reported complete
+CountersInitialize:
+  for (int p = 0; p < kCounterProcesses; ++p) {
+    #pragma HLS UNROLL
+    reports[p] = MakeCounters(0, 0, 0);
+    reported[p] = (p >= CounterReadSplit(banks) && p < kCounterWiden) ||
+                  p >= CounterWriteSplit(banks);
+  }
+  Counter_t cycles = 0;
+  bool done = false;
+CountersCycles:
+  while (!done) {
+    #pragma HLS PIPELINE II=1
+    ++cycles;
+  CountersBanks:
+    for (int k = 0; k < kDimms; ++k) {
+      #pragma HLS UNROLL
+      PollCounters(readCounters[k], reports[CounterReadSplit(k)],
+                   reported[CounterReadSplit(k)]);
+      PollCounters(writeCounters[k], reports[CounterWriteSplit(k)],
+                   reported[CounterWriteSplit(k)]);
+    }
+    PollCounters(widenCounters, reports[kCounterWiden],
+                 reported[kCounterWiden]);
+  CountersStages:
+    for (int s = 0; s < kDepth; ++s) {
+      #pragma HLS UNROLL
+      PollCounters(computeCounters[s], reports[CounterCompute(s)],
+                   reported[CounterCompute(s)]);
+    }
+    done = true;
+  CountersDone:
+    for (int p = 0; p < kCounterProcesses; ++p) {
+      #pragma HLS UNROLL
+      done = done && reported[p];
+    }
+  }
+#ifndef STENCIL_SYNTHESIS
+  cycles = 0;
+  for (int p = 0; p < kCounterProcesses; ++p) {
+    cycles = std::max<Counter_t>(cycles, reports[p][kCounterActive] +
+                                             reports[p][kCounterStalled]);
+  }
+#endif
+  const bool accumulate = firstPass > 0;
+  memory[kCounterCycles] = (accumulate ? memory[kCounterCycles] : 0) + cycles;
+CountersWrite:
+  for (int p = 0; p < kCounterProcesses; ++p) {
+    for (int k = 0; k < 3; ++k) {
+      #pragma HLS PIPELINE
+      const int index = CounterIndex(p, k);
+      memory[index] = (accumulate ? memory[index] : 0) + reports[p][k];
+    }
+  }
+}
+
+#endif
+
+/// Reads tiles of the three-dimensional domain, streaming each tile plane by
+/// plane with a halo of rows on either side. Halo rows outside the domain are
+/// not read from memory, but filled with the boundary value to keep the
+/// stream regular.
+void ReadSplit3D(Memory_t const *input, Stream_t<Memory_t> &buffer,
+                 const int planes, const int rows, const int cols,
+                 const int rowBlocks, const int blocks, const int timesteps) {
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const int tileRows = TileRows(rows, rowBlocks);
+  const int inputRows = TileInputRows(rows, rowBlocks);
+  const long totalElements = TotalElementsMemory3D(planes, rows, cols);
+ReadTime:
+  for (int t = 0; t < timeFolded; ++t) {
+  ReadRowBlocks:
+    for (int tb = 0; tb < rowBlocks; ++tb) {
+    ReadBlocks:
+      for (int b = 0; b < blocks; ++b) {
+      ReadPlanes:
+        for (int z = 0; z < planes; ++z) {
+        ReadRows:
+          for (int r = 0; r < inputRows; ++r) {
+          ReadCols:
+            for (int c = 0; c < blockWidth + 2 * kHaloMemory; ++c) {
+              #pragma HLS LOOP_FLATTEN
+              #pragma HLS PIPELINE
+              const auto offset = (t % 2 == 1) ? totalElements : 0;
+              const auto shift =
+                  (b == 0) ? 0
+                           : ((b == blocks - 1) ? (2 * kHaloMemory)
+                                                : kHaloMemory);
+              const int rGlobal = tb * tileRows + r - kRadius3D * kDepth;
+              const bool inDomain = rGlobal >= 0 && rGlobal < rows;
+              const auto index =
+                  offset +
+                  (static_cast<long>(z) * rows + rGlobal) * blockWidth * blocks +
+                  b * blockWidth + c - shift;
+              if ((b > 0 || c < blockWidth + kHaloMemory) &&
+                  (b < blocks - 1 || c >= kHaloMemory)) {
+                auto read = Memory_t(Kernel_t(kBoundary));
+                if (inDomain) {
+                  assert(index >= 0);
+                  assert(index < 2 * totalElements);
+                  read = input[index];
+                }
+                buffer.Push(read);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Writes the inner rows of each tile of the three-dimensional domain.
+void WriteSplit3D(Stream_t<Memory_t> &buffer, Memory_t *output,
+                  const int planes, const int rows, const int cols,
+                  const int rowBlocks, const int blocks, const int timesteps) {
+  const int timeFolded = TimeFolded(timesteps);
+  const int blockWidth = BlockWidthMemory(cols, blocks);
+  const int tileRows = TileRows(rows, rowBlocks);
+  const long totalElements = TotalElementsMemory3D(planes, rows, cols);
+WriteTime:
+  for (int t = 0; t < timeFolded; ++t) {
+  WriteRowBlocks:
+    for (int tb = 0; tb < rowBlocks; ++tb) {
+    WriteBlocks:
+      for (int b = 0; b < blocks; ++b) {
+      WritePlanes:
+        for (int z = 0; z < planes; ++z) {
+        WriteRows:
+          for (int r = 0; r < tileRows; ++r) {
+          WriteCols:
+            for (int c = 0; c < blockWidth; ++c) {
+              #pragma HLS LOOP_FLATTEN
+              #pragma HLS PIPELINE
+              const auto offset = (t % 2 == 0) ? totalElements : 0;
+              const auto read = buffer.Pop();
+              const auto index =
+                  offset +
+                  (static_cast<long>(z) * rows + tb * tileRows + r) *
+                      blockWidth * blocks +
+                  b * blockWidth + c;
+              assert(index >= 0);
+              assert(index < 2 * totalElements);
+              output[index] = read;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 #ifndef STENCIL_SYNTHESIS
 
 // Single DIMM read
-void Read(Memory_t const *memory, hlslib::Stream<Kernel_t> &toKernel,
-          std::vector<std::thread> &threads) {
+void Read(Memory_t const *memory, Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &readCounters,
+                           Stream_t<Counters_t> &widenCounters,)
+          const int boundaryModes, const int grids, const int rows,
+          const int cols, const int blocks, const int timesteps,
+          const int firstPass, Dataflow &dataflow) {
   #pragma HLS INLINE
-  static hlslib::Stream<Memory_t> readBuffer("readBuffer");
-  threads.emplace_back(ReadSplit<1>, memory, std::ref(readBuffer));
-  threads.emplace_back(Widen, std::ref(readBuffer), std::ref(toKernel));
+  auto &readBuffer = dataflow.MakeStream<Stream_t<Memory_t>>("readBuffer");
+  auto &boundaryPipe = dataflow.MakeStream<Stream_t<Memory_t>>("boundaryPipe");
+  dataflow.Add(ReadSplit<1>, memory, std::ref(readBuffer),
+               STENCIL_COUNTERS(std::ref(readCounters),) 0, boundaryModes,
+               grids, rows, cols, blocks, timesteps, firstPass);
+  dataflow.Add(InsertBoundary, std::ref(readBuffer), boundary,
+               std::ref(boundaryPipe), boundaryModes, grids, rows, cols,
+               blocks, timesteps);
+  dataflow.Add(Widen<kCounters>, std::ref(boundaryPipe), std::ref(toKernel),
+               STENCIL_COUNTERS(std::ref(widenCounters),)
+               TimeFolded(timesteps) * grids,
+               InputRows(rows, boundaryModes, 0), cols, blocks,
+               BoundaryCols(BoundaryMode(boundaryModes, kEdgeLeft)),
+               BoundaryCols(BoundaryMode(boundaryModes, kEdgeRight)));
 }
 
-// Dual DIMM read
-void Read(Memory_t const *memory0, Memory_t const *memory1,
-          hlslib::Stream<Kernel_t> &toKernel,
-          std::vector<std::thread> &threads) {
-  static hlslib::Stream<Memory_t> readBuffer0("readBuffer0");
-  static hlslib::Stream<Memory_t> readBuffer1("readBuffer1");
-  static hlslib::Stream<Memory_t> demuxPipe;
-  threads.emplace_back(ReadSplit<2>, memory0, std::ref(readBuffer0));
-  threads.emplace_back(ReadSplit<2>, memory1, std::ref(readBuffer1));
-  threads.emplace_back(DemuxRead, std::ref(readBuffer0), std::ref(readBuffer1),
-                       std::ref(demuxPipe));
-  threads.emplace_back(Widen, std::ref(demuxPipe), std::ref(toKernel));
+// Multi-bank read of a single bank
+void ReadBank(Memory_t const *memory, Stream_t<Memory_t> &toMerge,
+              STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+              const int bank, const int boundaryModes, const int grids,
+              const int rows, const int cols, const int blocks,
+              const int timesteps, const int firstPass, Dataflow &dataflow) {
+  dataflow.Add(ReadSplit<kDimms>, memory, std::ref(toMerge),
+               STENCIL_COUNTERS(std::ref(counters),) bank, boundaryModes,
+               grids, rows, cols, blocks, timesteps, firstPass);
+}
+
+// Multi-bank read
+void Read(Stream_t<Memory_t> fromBanks[kDimms], Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &widenCounters,)
+          const int boundaryModes, const int grids, const int rows,
+          const int cols, const int blocks, const int timesteps,
+          Dataflow &dataflow) {
+  auto &demuxPipe = dataflow.MakeStream<Stream_t<Memory_t>>("demuxPipe");
+  auto &boundaryPipe = dataflow.MakeStream<Stream_t<Memory_t>>("boundaryPipe");
+  dataflow.Add(DemuxRead<kDimms>, fromBanks, std::ref(demuxPipe),
+               boundaryModes, grids, rows, cols, blocks, timesteps);
+  dataflow.Add(InsertBoundary, std::ref(demuxPipe), boundary,
+               std::ref(boundaryPipe), boundaryModes, grids, rows, cols,
+               blocks, timesteps);
+  dataflow.Add(Widen<kCounters>, std::ref(boundaryPipe), std::ref(toKernel),
+               STENCIL_COUNTERS(std::ref(widenCounters),)
+               TimeFolded(timesteps) * grids,
+               InputRows(rows, boundaryModes, 0), cols, blocks,
+               BoundaryCols(BoundaryMode(boundaryModes, kEdgeLeft)),
+               BoundaryCols(BoundaryMode(boundaryModes, kEdgeRight)));
 }
 
 // Single DIMM write
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory,
-           std::vector<std::thread> &threads) {
+void Write(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+           STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+           const int grids, const int rows, const int cols, const int blocks,
+           const int timesteps, const int firstPass, Dataflow &dataflow) {
   #pragma HLS INLINE
-  static hlslib::Stream<Memory_t> writeBuffer("writeBuffer");
-  threads.emplace_back(Narrow, std::ref(fromKernel), std::ref(writeBuffer));
-  threads.emplace_back(WriteSplit<1>, std::ref(writeBuffer), memory);
+  auto &writeBuffer = dataflow.MakeStream<Stream_t<Memory_t>>("writeBuffer");
+  dataflow.Add(Narrow, std::ref(fromKernel), std::ref(writeBuffer),
+               TimeFolded(timesteps) * grids, rows, cols, blocks);
+  dataflow.Add(WriteSplit<1>, std::ref(writeBuffer), memory,
+               STENCIL_COUNTERS(std::ref(counters),) grids, rows, cols,
+               blocks, timesteps, firstPass);
 }
 
-// Dual DIMM write
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory0,
-           Memory_t *memory1, std::vector<std::thread> &threads) {
-  static hlslib::Stream<Memory_t> writeBuffer0("writeBuffer0");
-  static hlslib::Stream<Memory_t> writeBuffer1("writeBuffer1");
-  static hlslib::Stream<Memory_t> muxPipe("muxPipe");
-  threads.emplace_back(Narrow, std::ref(fromKernel), std::ref(muxPipe));
-  threads.emplace_back(MuxWrite, std::ref(muxPipe), std::ref(writeBuffer0),
-                       std::ref(writeBuffer1));
-  threads.emplace_back(WriteSplit<2>, std::ref(writeBuffer0), memory0);
-  threads.emplace_back(WriteSplit<2>, std::ref(writeBuffer1), memory1);
+// Multi-bank write
+void Write(Stream_t<Kernel_t> &fromKernel,
+           Stream_t<Memory_t> toBanks[kDimms], const int grids,
+           const int rows, const int cols, const int blocks,
+           const int timesteps, Dataflow &dataflow) {
+  auto &muxPipe = dataflow.MakeStream<Stream_t<Memory_t>>("muxPipe");
+  dataflow.Add(Narrow, std::ref(fromKernel), std::ref(muxPipe),
+               TimeFolded(timesteps) * grids, rows, cols, blocks);
+  dataflow.Add(MuxWrite<kDimms>, std::ref(muxPipe), toBanks, grids, rows,
+               cols, blocks, timesteps);
+}
+
+// Multi-bank write of a single bank
+void WriteBank(Stream_t<Memory_t> &fromMux, Memory_t *memory,
+               STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+               const int grids, const int rows, const int cols,
+               const int blocks, const int timesteps, const int firstPass, Dataflow &dataflow) {
+  dataflow.Add(WriteSplit<kDimms>, std::ref(fromMux), memory,
+               STENCIL_COUNTERS(std::ref(counters),) grids, rows, cols,
+               blocks, timesteps, firstPass);
+}
+
+// Residual
+void WriteResidual(Stream_t<Residual_t> &fromKernel, Residual_t *memory,
+                   const int grids, const int timesteps, const int firstPass,
+                   const int passes, Dataflow &dataflow) {
+  dataflow.Add(WriteResidualMemory, std::ref(fromKernel), memory, grids,
+               timesteps, firstPass, passes);
+}
+
+#ifdef STENCIL_ENABLE_COUNTERS
+// Counters
+void WriteCounters(Stream_t<Counters_t> readCounters[kDimms],
+                   Stream_t<Counters_t> &widenCounters,
+                   Stream_t<Counters_t> computeCounters[kDepth],
+                   Stream_t<Counters_t> writeCounters[kDimms],
+                   Counter_t *memory, const int banks, const int firstPass,
+                   Dataflow &dataflow) {
+  dataflow.Add(WriteCountersMemory, readCounters, std::ref(widenCounters),
+               computeCounters, writeCounters, memory, banks, firstPass);
+}
+#endif
+
+// Three-dimensional read
+void Read3D(Memory_t const *memory, Stream_t<Kernel_t> &toKernel,
+            const int planes, const int rows, const int cols,
+            const int rowBlocks, const int blocks, const int timesteps,
+            Dataflow &dataflow) {
+  auto &readBuffer3D = dataflow.MakeStream<Stream_t<Memory_t>>("readBuffer3D");
+#ifdef STENCIL_ENABLE_COUNTERS
+  // Widen never reports counters for the three-dimensional kernel
+  auto &widenCounters3D =
+      dataflow.MakeStream<Stream_t<Counters_t>>("widenCounters3D");
+#endif
+  dataflow.Add(ReadSplit3D, memory, std::ref(readBuffer3D), planes,
+               rows, cols, rowBlocks, blocks, timesteps);
+  dataflow.Add(Widen<false>, std::ref(readBuffer3D), std::ref(toKernel),
+               STENCIL_COUNTERS(std::ref(widenCounters3D),)
+               TimeFolded(timesteps) * rowBlocks,
+               planes * TileInputRows(rows, rowBlocks), cols, blocks, false,
+               false);
+}
+
+// Three-dimensional write
+void Write3D(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+             const int planes, const int rows, const int cols,
+             const int rowBlocks, const int blocks, const int timesteps,
+             Dataflow &dataflow) {
+  auto &writeBuffer3D =
+      dataflow.MakeStream<Stream_t<Memory_t>>("writeBuffer3D");
+  dataflow.Add(Narrow, std::ref(fromKernel), std::ref(writeBuffer3D),
+               TimeFolded(timesteps) * rowBlocks,
+               planes * TileRows(rows, rowBlocks), cols, blocks);
+  dataflow.Add(WriteSplit3D, std::ref(writeBuffer3D), memory, planes,
+               rows, cols, rowBlocks, blocks, timesteps);
 }
 
 #else
 
 // Single DIMM read
-void Read(Memory_t const *memory, hlslib::Stream<Kernel_t> &toKernel) {
+void Read(Memory_t const *memory, Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &readCounters,
+                           Stream_t<Counters_t> &widenCounters,)
+          const int boundaryModes, const int grids, const int rows,
+          const int cols, const int blocks, const int timesteps,
+          const int firstPass) {
   #pragma HLS INLINE
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> readBuffer("readBuffer");
-  ReadSplit<1>(memory, readBuffer);
-  Widen(readBuffer, toKernel);
+  Stream_t<Memory_t, kMemoryBufferDepth> readBuffer("readBuffer");
+  Stream_t<Memory_t, kPipeDepth> boundaryPipe("boundaryPipe");
+  ReadSplit<1>(memory, readBuffer, STENCIL_COUNTERS(readCounters,) 0,
+               boundaryModes, grids, rows, cols, blocks, timesteps, firstPass);
+  InsertBoundary(readBuffer, boundary, boundaryPipe, boundaryModes, grids,
+                 rows, cols, blocks, timesteps);
+  Widen<kCounters>(boundaryPipe, toKernel, STENCIL_COUNTERS(widenCounters,)
+                   TimeFolded(timesteps) * grids,
+                   InputRows(rows, boundaryModes, 0), cols, blocks,
+                   BoundaryCols(BoundaryMode(boundaryModes, kEdgeLeft)),
+                   BoundaryCols(BoundaryMode(boundaryModes, kEdgeRight)));
 }
 
-// Dual DIMM read
-void Read(Memory_t const *memory0, Memory_t const *memory1,
-          hlslib::Stream<Kernel_t> &toKernel) {
+// Multi-bank read of a single bank
+void ReadBank(Memory_t const *memory, Stream_t<Memory_t> &toMerge,
+              STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+              const int bank, const int boundaryModes, const int grids,
+              const int rows, const int cols, const int blocks,
+              const int timesteps, const int firstPass) {
   #pragma HLS INLINE
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> readBuffer0("readBuffer0");
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> readBuffer1("readBuffer1");
-  hlslib::Stream<Memory_t, kPipeDepth> demuxPipe("demuxPipe");
-  ReadSplit<2>(memory0, readBuffer0);
-  ReadSplit<2>(memory1, readBuffer1);
-  DemuxRead(readBuffer0, readBuffer1, demuxPipe);
-  Widen(demuxPipe, toKernel);
+  ReadSplit<kDimms>(memory, toMerge, STENCIL_COUNTERS(counters,) bank,
+                    boundaryModes, grids, rows, cols, blocks, timesteps,
+                    firstPass);
+}
+
+// Multi-bank read
+void Read(Stream_t<Memory_t> fromBanks[kDimms], Memory_t const *boundary,
+          Stream_t<Kernel_t> &toKernel,
+          STENCIL_COUNTERS(Stream_t<Counters_t> &widenCounters,)
+          const int boundaryModes, const int grids, const int rows,
+          const int cols, const int blocks, const int timesteps) {
+  #pragma HLS INLINE
+  Stream_t<Memory_t, kPipeDepth> demuxPipe("demuxPipe");
+  Stream_t<Memory_t, kPipeDepth> boundaryPipe("boundaryPipe");
+  DemuxRead<kDimms>(fromBanks, demuxPipe, boundaryModes, grids, rows, cols,
+                    blocks, timesteps);
+  InsertBoundary(demuxPipe, boundary, boundaryPipe, boundaryModes, grids,
+                 rows, cols, blocks, timesteps);
+  Widen<kCounters>(boundaryPipe, toKernel, STENCIL_COUNTERS(widenCounters,)
+                   TimeFolded(timesteps) * grids,
+                   InputRows(rows, boundaryModes, 0), cols, blocks,
+                   BoundaryCols(BoundaryMode(boundaryModes, kEdgeLeft)),
+                   BoundaryCols(BoundaryMode(boundaryModes, kEdgeRight)));
 }
 
 // Single DIMM write
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory) {
+void Write(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+           STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+           const int grids, const int rows, const int cols, const int blocks,
+           const int timesteps, const int firstPass) {
+  #pragma HLS INLINE
+  Stream_t<Memory_t, kMemoryBufferDepth> writeBuffer("writeBuffer");
+  Narrow(fromKernel, writeBuffer, TimeFolded(timesteps) * grids, rows, cols,
+         blocks);
+  WriteSplit<1>(writeBuffer, memory, STENCIL_COUNTERS(counters,) grids, rows,
+                cols, blocks, timesteps, firstPass);
+}
+
+// Multi-bank write
+void Write(Stream_t<Kernel_t> &fromKernel,
+           Stream_t<Memory_t> toBanks[kDimms], const int grids,
+           const int rows, const int cols, const int blocks,
+           const int timesteps) {
   #pragma HLS INLINE
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> writeBuffer("writeBuffer");
-  Narrow(fromKernel, writeBuffer);
-  WriteSplit<1>(writeBuffer, memory);
+  Stream_t<Memory_t, kPipeDepth> muxPipe("muxPipe");
+  Narrow(fromKernel, muxPipe, TimeFolded(timesteps) * grids, rows, cols,
+         blocks);
+  MuxWrite<kDimms>(muxPipe, toBanks, grids, rows, cols, blocks, timesteps);
+}
+
+// Multi-bank write of a single bank
+void WriteBank(Stream_t<Memory_t> &fromMux, Memory_t *memory,
+               STENCIL_COUNTERS(Stream_t<Counters_t> &counters,)
+               const int grids, const int rows, const int cols,
+               const int blocks, const int timesteps, const int firstPass) {
+  #pragma HLS INLINE
+  WriteSplit<kDimms>(fromMux, memory, STENCIL_COUNTERS(counters,) grids,
+                     rows, cols, blocks, timesteps, firstPass);
+}
+
+// Residual
+void WriteResidual(Stream_t<Residual_t> &fromKernel, Residual_t *memory,
+                   const int grids, const int timesteps, const int firstPass,
+                   const int passes) {
+  #pragma HLS INLINE
+  WriteResidualMemory(fromKernel, memory, grids, timesteps, firstPass, passes);
+}
+
+#ifdef STENCIL_ENABLE_COUNTERS
+// Counters
+void WriteCounters(Stream_t<Counters_t> readCounters[kDimms],
+                   Stream_t<Counters_t> &widenCounters,
+                   Stream_t<Counters_t> computeCounters[kDepth],
+                   Stream_t<Counters_t> writeCounters[kDimms],
+                   Counter_t *memory, const int banks,
+                   const int firstPass) {
+  #pragma HLS INLINE
+  WriteCountersMemory(readCounters, widenCounters, computeCounters,
+                      writeCounters, memory, banks, firstPass);
+}
+#endif
+
+// Three-dimensional read
+void Read3D(Memory_t const *memory, Stream_t<Kernel_t> &toKernel,
+            const int planes, const int rows, const int cols,
+            const int rowBlocks, const int blocks, const int timesteps) {
+  #pragma HLS INLINE
+  Stream_t<Memory_t, kMemoryBufferDepth> readBuffer3D("readBuffer3D");
+#ifdef STENCIL_ENABLE_COUNTERS
+  // Widen never reports counters for the three-dimensional kernel
+  Stream_t<Counters_t, 1> widenCounters3D("widenCounters3D");
+#endif
+  ReadSplit3D(memory, readBuffer3D, planes, rows, cols, rowBlocks, blocks,
+              timesteps);
+  Widen<false>(readBuffer3D, toKernel, STENCIL_COUNTERS(widenCounters3D,)
+               TimeFolded(timesteps) * rowBlocks,
+               planes * TileInputRows(rows, rowBlocks), cols, blocks, false,
+               false);
 }
 
-// Dual DIMM write
-void Write(hlslib::Stream<Kernel_t> &fromKernel, Memory_t *memory0,
-           Memory_t *memory1) {
+// Three-dimensional write
+void Write3D(Stream_t<Kernel_t> &fromKernel, Memory_t *memory,
+             const int planes, const int rows, const int cols,
+             const int rowBlocks, const int blocks, const int timesteps) {
   #pragma HLS INLINE
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> writeBuffer0("writeBuffer0");
-  hlslib::Stream<Memory_t, kMemoryBufferDepth> writeBuffer1("writeBuffer1");
-  hlslib::Stream<Memory_t, kPipeDepth> muxPipe("muxPipe");
-  Narrow(fromKernel, muxPipe);
-  MuxWrite(muxPipe, writeBuffer0, writeBuffer1);
-  WriteSplit<2>(writeBuffer0, memory0);
-  WriteSplit<2>(writeBuffer1, memory1);
+  Stream_t<Memory_t, kMemoryBufferDepth> writeBuffer3D("writeBuffer3D");
+  Narrow(fromKernel, writeBuffer3D, TimeFolded(timesteps) * rowBlocks,
+         planes * TileRows(rows, rowBlocks), cols, blocks);
+  WriteSplit3D(writeBuffer3D, memory, planes, rows, cols, rowBlocks, blocks,
+               timesteps);
 }
 
 #endif
@@ -0,0 +1,104 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "OutOfCore.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+int StripHalo() {
+  const int halo = kRadius * kDepth;
+  return kBankGroupRows * ((halo + kBankGroupRows - 1) / kBankGroupRows);
+}
+
+std::vector<Strip> MakeStrips(const int rows, const int stripRows) {
+  const int halo = StripHalo();
+  std::vector<Strip> strips;
+  for (int inner = 0; inner < rows; inner += stripRows) {
+    const int innerEnd = std::min(inner + stripRows, rows);
+    const int begin = std::max(inner - halo, 0);
+    const int end = std::min(innerEnd + halo, rows);
+    strips.push_back(
+        Strip{begin, end - begin, inner - begin, innerEnd - inner});
+  }
+  return strips;
+}
+
+int StripRowsMax(std::vector<Strip> const &strips) {
+  int rowsMax = 0;
+  for (auto const &strip : strips) {
+    rowsMax = std::max(rowsMax, strip.rows);
+  }
+  return rowsMax;
+}
+
+void ValidateOutOfCore(const int rows, const int cols, const int blocks,
+                       const int timesteps, const int stripRows,
+                       const int boundaryModes) {
+  ValidateDimensions(rows, cols, blocks, timesteps);
+  if (stripRows < 1 || stripRows % kBankGroupRows != 0) {
+    throw std::invalid_argument(
+        "Strip rows must be a positive multiple of the number of banks times "
+        "the rows per bank group (" +
+        std::to_string(kBankGroupRows) + ").");
+  }
+  // The halo of a periodic edge would have to be taken from the strip at the
+  // opposite edge of the domain
+  if (BoundaryMode(boundaryModes, kEdgeTop) == kBoundaryPeriodic ||
+      BoundaryMode(boundaryModes, kEdgeBottom) == kBoundaryPeriodic) {
+    throw std::invalid_argument(
+        "Strips do not support periodic top and bottom edges.");
+  }
+  for (auto const &strip : MakeStrips(rows, stripRows)) {
+    ValidateDimensions(strip.rows, cols, blocks, kDepth);
+    if (strip.rows < kRadius) {
+      throw std::invalid_argument(
+          "Strips must span at least the stencil radius.");
+    }
+  }
+}
+
+Boundary StripBoundary(Boundary const &boundary, Strip const &strip) {
+  const int cols = boundary.top.size();
+  const bool top = strip.begin == 0;
+  const bool bottom =
+      strip.begin + strip.rows == static_cast<int>(boundary.left.size());
+  const int modes = BoundaryModes(
+      top ? BoundaryMode(boundary.modes, kEdgeTop) : kBoundaryDirichlet,
+      bottom ? BoundaryMode(boundary.modes, kEdgeBottom) : kBoundaryDirichlet,
+      BoundaryMode(boundary.modes, kEdgeLeft),
+      BoundaryMode(boundary.modes, kEdgeRight));
+  auto stripBoundary = MakeBoundary(strip.rows, cols, modes);
+  if (top) {
+    stripBoundary.top = boundary.top;
+  }
+  if (bottom) {
+    stripBoundary.bottom = boundary.bottom;
+  }
+  std::copy(boundary.left.begin() + strip.begin,
+            boundary.left.begin() + strip.begin + strip.rows,
+            stripBoundary.left.begin());
+  std::copy(boundary.right.begin() + strip.begin,
+            boundary.right.begin() + strip.begin + strip.rows,
+            stripBoundary.right.begin());
+  return stripBoundary;
+}
+
+StripTransfer MakeStripTransfer(Strip const &strip, const int rows,
+                                const int cols, const int banks,
+                                const int sweep) {
+  // Strips and halos span whole groups of rows of every bank, so each bank
+  // holds a contiguous range of the rows of every strip
+  const long rowWords = cols / kMemoryWidth;
+  const long inputHalf = static_cast<long>(sweep % 2) * rows;
+  const long outputHalf = static_cast<long>((sweep + 1) % 2) * rows;
+  StripTransfer transfer;
+  transfer.inputHost = (inputHalf + strip.begin) / banks * rowWords;
+  transfer.inputWords = strip.rows / banks * rowWords;
+  transfer.outputDevice =
+      (strip.rows + strip.innerBegin) / banks * rowWords;
+  transfer.outputHost =
+      (outputHalf + strip.begin + strip.innerBegin) / banks * rowWords;
+  transfer.outputWords = strip.innerRows / banks * rowWords;
+  return transfer;
+}
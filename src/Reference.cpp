@@ -2,26 +2,565 @@
 /// @copyright This software is copyrighted under the BSD 3-Clause License. 
 
 #include "Reference.h"
+#include "Layout.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// Tile dimensions of the temporal blocking. Each tile is extended by a halo of
+// the stencil radius per timestep on every side, mirroring the halos of the
+// kernel, and is advanced up to kDepth timesteps in a private buffer that fits
+// in cache.
+constexpr int kTileRows = 64;
+constexpr int kTileCols = 512;
+
+/// Wraps a row or column beyond a periodic edge around to the opposite edge
+inline int Wrap(const int i, const int n) {
+  return ((i % n) + n) % n;
+}
+
+/// Mirrors a row or column beyond a Neumann edge across the edge
+inline int Mirror(const int i, const int n) {
+  return (i < 0) ? std::min(-i - 1, n - 1) : std::max(2 * n - i - 1, 0);
+}
+
+/// Advances a single tile by the given number of timesteps and writes the
+/// inner region to the output grid.
+void ComputeTile(Data_t const *input, Data_t *output, const int rows,
+                 const int cols, Boundary const &boundary, const int r0,
+                 const int c0, const int timesteps,
+                 std::vector<Data_t> &buffer0, std::vector<Data_t> &buffer1) {
+
+  const int tileRows = std::min(kTileRows, rows - r0);
+  const int tileCols = std::min(kTileCols, cols - c0);
+  const int halo = kRadius * timesteps;
+  const int height = tileRows + 2 * halo;
+  const int width = tileCols + 2 * halo;
+  // Top left corner of the local buffer in global coordinates
+  const int rBegin = r0 - halo;
+  const int cBegin = c0 - halo;
+
+  const int modeTop = BoundaryMode(boundary.modes, kEdgeTop);
+  const int modeBottom = BoundaryMode(boundary.modes, kEdgeBottom);
+  const int modeLeft = BoundaryMode(boundary.modes, kEdgeLeft);
+  const int modeRight = BoundaryMode(boundary.modes, kEdgeRight);
+
+  // Populate both buffers with the input, and with the values of the edges
+  // outside the domain, following the same rules as the kernel. Cells beyond
+  // Dirichlet edges are never updated, so they keep their value in both
+  // buffers throughout. Cells beyond periodic edges are initialized from the
+  // opposite edge and updated like the domain, and cells beyond Neumann edges
+  // are mirrored from the domain before every timestep.
+  for (int r = 0; r < height; ++r) {
+    Data_t *row0 = &buffer0[r * width];
+    Data_t *row1 = &buffer1[r * width];
+    const int rGlobal = rBegin + r;
+    const int modeRow = (rGlobal < 0) ? modeTop : modeBottom;
+    const bool rowOutside = rGlobal < 0 || rGlobal >= rows;
+    for (int c = 0; c < width; ++c) {
+      const int cGlobal = cBegin + c;
+      const int modeCol = (cGlobal < 0) ? modeLeft : modeRight;
+      const bool colOutside = cGlobal < 0 || cGlobal >= cols;
+      const int rSource =
+          !rowOutside ? rGlobal
+                      : ((modeRow == kBoundaryPeriodic) ? Wrap(rGlobal, rows)
+                                                        : Mirror(rGlobal, rows));
+      const int cSource =
+          !colOutside ? cGlobal
+                      : ((modeCol == kBoundaryPeriodic) ? Wrap(cGlobal, cols)
+                                                        : Mirror(cGlobal, cols));
+      if (colOutside && modeCol == kBoundaryDirichlet) {
+        // Rows beyond non-periodic edges are clamped to the domain
+        const int rClamped =
+            (rowOutside && modeRow != kBoundaryPeriodic)
+                ? std::min(std::max(rGlobal, 0), rows - 1)
+                : rSource;
+        row0[c] = (cGlobal < 0) ? boundary.left[rClamped]
+                                : boundary.right[rClamped];
+      } else if (rowOutside && modeRow == kBoundaryDirichlet) {
+        row0[c] = (rGlobal < 0) ? boundary.top[cSource]
+                                : boundary.bottom[cSource];
+      } else {
+        row0[c] = input[static_cast<long>(rSource) * cols + cSource];
+      }
+    }
+    std::copy(row0, row0 + width, row1);
+  }
+
+  // Updates are restricted to the part of the local buffer that is both
+  // inside the domain, or beyond a periodic edge, and inside the region that
+  // is still valid after each timestep. Computing the bounds per row keeps
+  // the inner loop branch-free.
+  const int rDomainBegin = std::max(0, -rBegin);
+  const int rDomainEnd = std::min(height, rows - rBegin);
+  const int cDomainBegin = std::max(0, -cBegin);
+  const int cDomainEnd = std::min(width, cols - cBegin);
+  const int rUpdateBegin = (modeTop == kBoundaryPeriodic) ? 0 : rDomainBegin;
+  const int rUpdateEnd =
+      (modeBottom == kBoundaryPeriodic) ? height : rDomainEnd;
+  const int cUpdateBegin = (modeLeft == kBoundaryPeriodic) ? 0 : cDomainBegin;
+  const int cUpdateEnd = (modeRight == kBoundaryPeriodic) ? width : cDomainEnd;
+
+  // Cannot be constexpr due to half precision
+  Accumulate_t weights[Stencil_t::kPoints];
+  for (int p = 0; p < Stencil_t::kPoints; ++p) {
+    weights[p] = Stencil_t::Weight(p);
+  }
+  const Accumulate_t factor = Stencil_t::ScaleValue();
+
+  Data_t *src = buffer0.data();
+  Data_t *dst = buffer1.data();
+  for (int t = 1; t <= timesteps; ++t) {
+
+    // Mirror the domain across Neumann edges, first along the columns of
+    // every row, then along the rows, such that corners are mirrored twice
+    for (int r = 0; r < height; ++r) {
+      Data_t *row = src + r * width;
+      if (modeLeft == kBoundaryNeumann) {
+        for (int c = 0; c < cDomainBegin; ++c) {
+          row[c] = row[Mirror(cBegin + c, cols) - cBegin];
+        }
+      }
+      if (modeRight == kBoundaryNeumann) {
+        for (int c = cDomainEnd; c < width; ++c) {
+          row[c] = row[Mirror(cBegin + c, cols) - cBegin];
+        }
+      }
+    }
+    if (modeTop == kBoundaryNeumann) {
+      for (int r = 0; r < rDomainBegin; ++r) {
+        const int rSource = Mirror(rBegin + r, rows) - rBegin;
+        std::copy(src + rSource * width, src + (rSource + 1) * width,
+                  src + r * width);
+      }
+    }
+    if (modeBottom == kBoundaryNeumann) {
+      for (int r = rDomainEnd; r < height; ++r) {
+        const int rSource = Mirror(rBegin + r, rows) - rBegin;
+        std::copy(src + rSource * width, src + (rSource + 1) * width,
+                  src + r * width);
+      }
+    }
+
+    const int shrink = kRadius * t;
+    const int rLo = std::max(shrink, rUpdateBegin);
+    const int rHi = std::min(height - shrink, rUpdateEnd);
+    const int cLo = std::max(shrink, cUpdateBegin);
+    const int cHi = std::min(width - shrink, cUpdateEnd);
+    for (int r = rLo; r < rHi; ++r) {
+      Data_t const *__restrict points[Stencil_t::kPoints];
+      for (int p = 0; p < Stencil_t::kPoints; ++p) {
+        points[p] = src + (r + Stencil_t::RowOffset(p)) * width +
+                    Stencil_t::ColOffset(p);
+      }
+      Data_t *__restrict out = dst + r * width;
+      for (int c = cLo; c < cHi; ++c) {
+        // Same order of operations and types as the kernel
+        Accumulate_t acc = static_cast<Accumulate_t>(points[0][c]);
+        if (!Stencil_t::IsUnitWeight(0)) {
+          acc = Accumulate_t(weights[0] * acc);
+        }
+        for (int p = 1; p < Stencil_t::kPoints; ++p) {
+          const Accumulate_t value = static_cast<Accumulate_t>(points[p][c]);
+          const Accumulate_t term = Stencil_t::IsUnitWeight(p)
+                                        ? value
+                                        : Accumulate_t(weights[p] * value);
+          acc = Accumulate_t(acc + term);
+        }
+        if (!Stencil_t::IsUnitScale()) {
+          acc = Accumulate_t(factor * acc);
+        }
+        out[c] = static_cast<Data_t>(acc);
+      }
+    }
+    std::swap(src, dst);
+  }
+
+  for (int r = 0; r < tileRows; ++r) {
+    Data_t const *row = src + (halo + r) * width + halo;
+    std::copy(row, row + tileCols,
+              output + static_cast<long>(r0 + r) * cols + c0);
+  }
+}
+
+/// Cells compared by every task of the verifier. A multiple of the memory
+/// width, such that every task starts at the first value of a memory word.
+constexpr long kCompareChunkCells = 4096 * kMemoryWidth;
+
+/// Spacing of the values representable by Data_t around the given magnitude.
+/// Fixed point values are evenly spaced.
+double UnitInLastPlace(const double magnitude, const double epsilon,
+                       const bool fixedPoint) {
+  if (fixedPoint) {
+    return epsilon;
+  }
+  int exponent;
+  std::frexp(magnitude, &exponent);
+  return std::ldexp(epsilon, exponent - 1);
+}
+
+int UlpBucket(const double ulps) {
+  if (ulps == 0) {
+    return 0;
+  }
+  // Also catches NaNs
+  if (!(ulps <= std::ldexp(1.0, kUlpBuckets - 3))) {
+    return kUlpBuckets - 1;
+  }
+  return (ulps <= 1) ? 1 : 1 + static_cast<int>(std::ceil(std::log2(ulps)));
+}
+
+/// Orders errors from largest to smallest, with NaNs first and ties broken by
+/// position
+bool WorseThan(ErrorLocation const &a, ErrorLocation const &b) {
+  const double inf = std::numeric_limits<double>::infinity();
+  const double rankA = std::isnan(a.error) ? inf : a.error;
+  const double rankB = std::isnan(b.error) ? inf : b.error;
+  if (rankA != rankB) {
+    return rankA > rankB;
+  }
+  return (a.row != b.row) ? a.row < b.row : a.col < b.col;
+}
+
+/// Keeps the kWorstCells worst cells, sorted by WorseThan
+void KeepWorst(std::vector<ErrorLocation> &worst,
+               ErrorLocation const &location) {
+  if (static_cast<int>(worst.size()) == kWorstCells &&
+      !WorseThan(location, worst.back())) {
+    return;
+  }
+  worst.insert(
+      std::upper_bound(worst.begin(), worst.end(), location, WorseThan),
+      location);
+  if (static_cast<int>(worst.size()) > kWorstCells) {
+    worst.pop_back();
+  }
+}
+
+} // End anonymous namespace
+
+std::vector<Data_t> Reference(std::vector<Data_t> const &input, const int rows,
+                              const int cols, const int timesteps) {
+  return Reference(input, rows, cols, timesteps, MakeBoundary(rows, cols));
+}
+
+std::vector<Data_t> Reference(std::vector<Data_t> const &input, const int rows,
+                              const int cols, const int timesteps,
+                              Boundary const &boundary) {
 
-std::vector<Data_t> Reference(std::vector<Data_t> const &input) {
   std::vector<Data_t> domain(input);
-  std::vector<Data_t> buffer(input);
-  for (int t = 0; t < kTimeTotal; ++t) {
-    for (int r = 0; r < kRows; ++r) {
-      for (int c = 0; c < kCols; ++c) {
-        const Data_t west =
-            (c == 0) ? Data_t(1) : domain[r * kCols + c - 1];
-        const Data_t east =
-            (c == kCols - 1) ? Data_t(1) : domain[r * kCols + c + 1];
-        const Data_t north =
-            (r == 0) ? Data_t(1) : domain[(r - 1) * kCols + c];
-        const Data_t south =
-            (r == kRows - 1) ? Data_t(1) : domain[(r + 1) * kCols + c];
-        buffer[r * kCols + c] =
-            Data_t(0.25) * (north + west + east + south);
+  if (timesteps == 0) {
+    return domain;
+  }
+  std::vector<Data_t> buffer(domain.size());
+
+  const int tilesRows = (rows + kTileRows - 1) / kTileRows;
+  const int tilesCols = (cols + kTileCols - 1) / kTileCols;
+  const int tiles = tilesRows * tilesCols;
+  const int threads = std::max(
+      1, std::min<int>(std::thread::hardware_concurrency(), tiles));
+  const int maxSize = (kTileRows + 2 * kRadius * kDepth) *
+                      (kTileCols + 2 * kRadius * kDepth);
+
+  // Advance the domain by up to kDepth timesteps per pass, like the kernel
+  for (int t = 0; t < timesteps; t += kDepth) {
+    const int steps = std::min<int>(kDepth, timesteps - t);
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+      std::vector<Data_t> buffer0(maxSize);
+      std::vector<Data_t> buffer1(maxSize);
+      for (int i = next++; i < tiles; i = next++) {
+        ComputeTile(domain.data(), buffer.data(), rows, cols, boundary,
+                    (i / tilesCols) * kTileRows, (i % tilesCols) * kTileCols,
+                    steps, buffer0, buffer1);
       }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : pool) {
+      thread.join();
     }
     domain.swap(buffer);
   }
+
   return domain;
 }
+
+std::vector<Data_t> Reference3D(std::vector<Data_t> const &input,
+                                const int planes, const int rows,
+                                const int cols, const int timesteps) {
+
+  // Pad the domain by the stencil radius on every side, such that cells
+  // outside the domain hold the boundary value and the inner loop is
+  // branch-free
+  const long paddedCols = cols + 2 * kRadius3D;
+  const long paddedRows = rows + 2 * kRadius3D;
+  const long planeSize = paddedRows * paddedCols;
+  std::vector<Data_t> src((planes + 2 * kRadius3D) * planeSize, kBoundary);
+  for (long z = 0; z < planes; ++z) {
+    for (long r = 0; r < rows; ++r) {
+      std::copy(input.begin() + (z * rows + r) * cols,
+                input.begin() + (z * rows + r + 1) * cols,
+                src.begin() + (z + kRadius3D) * planeSize +
+                    (r + kRadius3D) * paddedCols + kRadius3D);
+    }
+  }
+  std::vector<Data_t> dst(src);
+
+  // Cannot be constexpr due to half precision
+  Accumulate_t weights[Stencil3D_t::kPoints];
+  long offsets[Stencil3D_t::kPoints];
+  for (int p = 0; p < Stencil3D_t::kPoints; ++p) {
+    weights[p] = Stencil3D_t::Weight(p);
+    offsets[p] = Stencil3D_t::PlaneOffset(p) * planeSize +
+                 Stencil3D_t::RowOffset(p) * paddedCols +
+                 Stencil3D_t::ColOffset(p);
+  }
+  const Accumulate_t factor = Stencil3D_t::ScaleValue();
+
+  const int threads = std::max(
+      1, std::min<int>(std::thread::hardware_concurrency(), planes));
+  for (int t = 0; t < timesteps; ++t) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+      for (int z = next++; z < planes; z = next++) {
+        for (int r = 0; r < rows; ++r) {
+          const long begin = (z + kRadius3D) * planeSize +
+                             (r + kRadius3D) * paddedCols + kRadius3D;
+          Data_t const *__restrict in = src.data() + begin;
+          Data_t *__restrict out = dst.data() + begin;
+          for (int c = 0; c < cols; ++c) {
+            // Same order of operations and types as the kernel
+            Accumulate_t acc = static_cast<Accumulate_t>(in[c + offsets[0]]);
+            if (!Stencil3D_t::IsUnitWeight(0)) {
+              acc = Accumulate_t(weights[0] * acc);
+            }
+            for (int p = 1; p < Stencil3D_t::kPoints; ++p) {
+              const Accumulate_t value =
+                  static_cast<Accumulate_t>(in[c + offsets[p]]);
+              const Accumulate_t term = Stencil3D_t::IsUnitWeight(p)
+                                            ? value
+                                            : Accumulate_t(weights[p] * value);
+              acc = Accumulate_t(acc + term);
+            }
+            if (!Stencil3D_t::IsUnitScale()) {
+              acc = Accumulate_t(factor * acc);
+            }
+            out[c] = static_cast<Data_t>(acc);
+          }
+        }
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : pool) {
+      thread.join();
+    }
+    src.swap(dst);
+  }
+
+  std::vector<Data_t> domain(static_cast<long>(planes) * rows * cols);
+  for (long z = 0; z < planes; ++z) {
+    for (long r = 0; r < rows; ++r) {
+      const auto row = src.begin() + (z + kRadius3D) * planeSize +
+                       (r + kRadius3D) * paddedCols + kRadius3D;
+      std::copy(row, row + cols, domain.begin() + (z * rows + r) * cols);
+    }
+  }
+  return domain;
+}
+
+double DataEpsilon() {
+  double epsilon = 1;
+  while (static_cast<double>(Data_t(1 + epsilon / 2)) != 1) {
+    epsilon /= 2;
+  }
+  return epsilon;
+}
+
+double AccumulationResolution() {
+  double resolution = 1;
+  while (static_cast<double>(Accumulate_t(resolution / 2)) != 0) {
+    resolution /= 2;
+  }
+  return resolution;
+}
+
+double VerifyTolerance() {
+#ifdef STENCIL_VERIFY_ABSOLUTE
+  return STENCIL_VERIFY_ABSOLUTE;
+#else
+  return std::max(1e-4, 4 * DataEpsilon());
+#endif
+}
+
+Tolerance DefaultTolerance() {
+  return Tolerance(VerifyTolerance(), STENCIL_VERIFY_RELATIVE,
+                   STENCIL_VERIFY_ULPS);
+}
+
+ErrorStatistics CompareResult(std::vector<Data_t> const &reference,
+                              Memory_t const *result, const int rows,
+                              const int cols, Tolerance const &tolerance) {
+  const long cells = static_cast<long>(rows) * cols;
+  const double epsilon = DataEpsilon();
+  // Values below the resolution of a fixed point type round to zero
+  const bool fixedPoint = static_cast<double>(Data_t(epsilon / 4)) == 0;
+  const long chunks = (cells + kCompareChunkCells - 1) / kCompareChunkCells;
+  const int threads = std::max(
+      1, std::min<int>(std::thread::hardware_concurrency(), chunks));
+
+  // Every thread accumulates its own statistics, which are merged at the end
+  std::vector<ErrorStatistics> partial(
+      threads, ErrorStatistics{0, 0, 0, 0, 0, 0, -1, tolerance, {}, {}});
+  std::vector<double> sumSquares(threads, 0);
+  std::atomic<long> next(0);
+  auto worker = [&](const int t) {
+    auto &statistics = partial[t];
+    std::vector<Data_t> values(kCompareChunkCells);
+    std::vector<double> errors(kCompareChunkCells);
+    for (long i = next++; i < chunks; i = next++) {
+      const long begin = i * kCompareChunkCells;
+      const long count = std::min(kCompareChunkCells, cells - begin);
+      UnpackValues(result + begin / kMemoryWidth, values.data(), count);
+      Data_t const *expected = reference.data() + begin;
+
+      // Reductions without branches, which the compiler vectorizes
+      double maxAbsolute = statistics.maxAbsolute;
+      double maxRelative = statistics.maxRelative;
+      double sum = 0;
+      for (long c = 0; c < count; ++c) {
+        const double e = static_cast<double>(expected[c]);
+        const double error = std::fabs(static_cast<double>(values[c]) - e);
+        errors[c] = error;
+        maxAbsolute = std::max(maxAbsolute, error);
+        maxRelative =
+            std::max(maxRelative, (e != 0) ? error / std::fabs(e) : 0.0);
+        sum += error * error;
+      }
+      statistics.maxAbsolute = maxAbsolute;
+      statistics.maxRelative = maxRelative;
+      sumSquares[t] += sum;
+
+      for (long c = 0; c < count; ++c) {
+        const double e = static_cast<double>(expected[c]);
+        const double actual = static_cast<double>(values[c]);
+        const double error = errors[c];
+        const double ulps =
+            (error == 0)
+                ? 0
+                : error / UnitInLastPlace(
+                              std::max(std::fabs(e), std::fabs(actual)),
+                              epsilon, fixedPoint);
+        statistics.maxUlps = std::max(statistics.maxUlps, ulps);
+        ++statistics.ulpHistogram[UlpBucket(ulps)];
+        const long index = begin + c;
+        // Also catches NaNs
+        const double accepted =
+            tolerance.absolute + tolerance.relative * std::fabs(e);
+        if (!(error <= accepted) &&
+            !(tolerance.ulps > 0 && ulps <= tolerance.ulps)) {
+          if (statistics.mismatches == 0 ||
+              index < statistics.firstMismatch) {
+            statistics.firstMismatch = index;
+          }
+          ++statistics.mismatches;
+        }
+        if (error != 0) {
+          KeepWorst(statistics.worst,
+                    ErrorLocation{static_cast<int>(index / cols),
+                                  static_cast<int>(index % cols), e, actual,
+                                  error});
+        }
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  ErrorStatistics statistics{cells, 0, 0, 0, 0, 0, -1, tolerance, {}, {}};
+  double sumSquaresTotal = 0;
+  for (int t = 0; t < threads; ++t) {
+    auto const &p = partial[t];
+    statistics.maxAbsolute = std::max(statistics.maxAbsolute, p.maxAbsolute);
+    statistics.maxRelative = std::max(statistics.maxRelative, p.maxRelative);
+    statistics.maxUlps = std::max(statistics.maxUlps, p.maxUlps);
+    if (p.mismatches > 0 && (statistics.mismatches == 0 ||
+                             p.firstMismatch < statistics.firstMismatch)) {
+      statistics.firstMismatch = p.firstMismatch;
+    }
+    statistics.mismatches += p.mismatches;
+    for (int b = 0; b < kUlpBuckets; ++b) {
+      statistics.ulpHistogram[b] += p.ulpHistogram[b];
+    }
+    for (auto const &location : p.worst) {
+      KeepWorst(statistics.worst, location);
+    }
+    sumSquaresTotal += sumSquares[t];
+  }
+  statistics.rms = std::sqrt(sumSquaresTotal / cells);
+  return statistics;
+}
+
+void PrintErrorStatistics(std::ostream &stream,
+                          ErrorStatistics const &statistics) {
+  stream << "max abs error " << statistics.maxAbsolute << ", max rel error "
+         << statistics.maxRelative << ", RMS error " << statistics.rms
+         << ", max ulps " << statistics.maxUlps << ", "
+         << statistics.mismatches << " / " << statistics.cells
+         << " cells above tolerance (abs " << statistics.tolerance.absolute;
+  if (statistics.tolerance.relative > 0) {
+    stream << ", rel " << statistics.tolerance.relative;
+  }
+  if (statistics.tolerance.ulps > 0) {
+    stream << ", " << statistics.tolerance.ulps << " ulps";
+  }
+  stream << ")";
+}
+
+void PrintErrorDetails(std::ostream &stream,
+                       ErrorStatistics const &statistics) {
+  stream << "Distance in ulps:";
+  for (int b = 0; b < kUlpBuckets; ++b) {
+    if (statistics.ulpHistogram[b] == 0) {
+      continue;
+    }
+    stream << "\n  ";
+    if (b == 0) {
+      stream << "0";
+    } else if (b == kUlpBuckets - 1) {
+      stream << "> " << (1L << (b - 2));
+    } else {
+      stream << "<= " << (1L << (b - 1));
+    }
+    stream << ": " << statistics.ulpHistogram[b];
+  }
+  if (!statistics.worst.empty()) {
+    stream << "\nLargest errors:";
+  }
+  // Enough digits to tell apart values one ulp apart
+  const auto precision = stream.precision(10);
+  for (auto const &location : statistics.worst) {
+    stream << "\n  (" << location.row << ", " << location.col
+           << "): " << location.actual << " (should be " << location.expected
+           << "), error " << location.error;
+  }
+  stream.precision(precision);
+  stream << "\n";
+}
@@ -0,0 +1,61 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Stencil.h"
+#include "Reference.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+
+  if (argc != 1 && argc != 4 && argc != 5) {
+    std::cerr
+        << "Usage: ./ReferenceBenchmark [<rows> <cols> <timesteps> [<repetitions>]]"
+        << std::endl;
+    return 1;
+  }
+
+  int rows = kRows;
+  int cols = kCols;
+  int timesteps = kTimeTotal;
+  int repetitions = 3;
+  if (argc >= 4) {
+    rows = std::stoi(argv[1]);
+    cols = std::stoi(argv[2]);
+    timesteps = std::stoi(argv[3]);
+  }
+  if (argc == 5) {
+    repetitions = std::stoi(argv[4]);
+  }
+
+  std::cout << "Running " << repetitions << " repetitions of " << rows << "x"
+            << cols << " for " << timesteps << " timesteps on "
+            << std::thread::hardware_concurrency() << " threads..."
+            << std::flush;
+  const std::vector<Data_t> input(static_cast<long>(rows) * cols, 0);
+  double best = 0;
+  for (int i = 0; i < repetitions; ++i) {
+    auto begin = std::chrono::high_resolution_clock::now();
+    const auto result = Reference(input, rows, cols, timesteps);
+    auto end = std::chrono::high_resolution_clock::now();
+    const double elapsed =
+        1e-9 *
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+            .count();
+    best = (i == 0) ? elapsed : std::min(best, elapsed);
+  }
+  std::cout << " Done.\n";
+
+  // Same units as ExecuteKernel and Stats
+  const double cells = static_cast<double>(timesteps) * rows * cols;
+  std::cout << "Evaluated " << static_cast<long>(cells) << " cells in " << best
+            << " seconds, performance " << 1e-9 * Stencil_t::kOperations * cells / best
+            << " GOp/s"
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Runtime.h"
+#include "Stencil.h"
+#include "Arguments.h"
+#include "Layout.h"
+#include "Reference.h"
+#include "Benchmark.h"
+#include "Trace.h"
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Jobs kept in the queue of the runtime ahead of the job being waited for,
+/// such that the kernel never waits for the driver, while bounding the memory
+/// held by pending jobs
+constexpr int kJobsInFlight = 4;
+
+/// Input of a grid of a job, which differs between jobs
+std::vector<Data_t> JobInput(const long job, const int grid, const int rows,
+                             const int cols) {
+  std::vector<Data_t> input(static_cast<long>(rows) * cols);
+  for (long i = 0; i < static_cast<long>(input.size()); ++i) {
+    input[i] =
+        Data_t(0.125 * ((job + grid + i / cols) % 7 + 3 * ((i % cols) % 5)));
+  }
+  return input;
+}
+
+/// Prints the latency statistics of the jobs completed since the last report
+void PrintReport(const long completed, std::vector<JobTiming> const &timings,
+                 const double elapsed) {
+  std::vector<double> latency, queued, execute;
+  for (auto const &timing : timings) {
+    latency.emplace_back(timing.latency);
+    queued.emplace_back(timing.queued);
+    execute.emplace_back(timing.execute);
+  }
+  const auto latencyStats = Summarize(latency);
+  std::cout << std::setw(10) << completed << std::setw(12)
+            << timings.size() / elapsed << std::setw(16)
+            << latencyStats.median << std::setw(16) << latencyStats.p95
+            << std::setw(16) << Summarize(queued).median << std::setw(16)
+            << Summarize(execute).median << std::endl;
+}
+
+} // End anonymous namespace
+
+/// Long-running driver that streams jobs through a single runtime, keeping
+/// the program loaded and reusing device memory between jobs, and
+/// periodically reports the latency of the completed jobs.
+int main(int argc, char **argv) {
+
+  if (kTrace) {
+    NameTraceThread("main");
+  }
+  TraceWriter traceWriter(std::string(kKernelString) + "_jobs_trace.json");
+
+  if (argc != 5 && argc != 9) {
+    std::cerr << "Usage: ./RunJobs <jobs (0 runs until interrupted)> <grids "
+                 "per job> <report interval> <verify [on/off]> [<rows> <cols> "
+                 "<blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  const long jobs = std::stol(argv[1]);
+  const int grids = std::stoi(argv[2]);
+  const int interval = std::stoi(argv[3]);
+  if (std::string(argv[4]) != "on" && std::string(argv[4]) != "off") {
+    std::cerr << "Verify option must be either \"on\" or \"off\"."
+              << std::endl;
+    return 1;
+  }
+  const bool verify = std::string(argv[4]) == "on";
+  const auto check = [jobs, grids, interval](Dimensions const &) {
+    if (jobs < 0 || grids < 1 || interval < 1) {
+      throw std::invalid_argument(
+          "Jobs must be non-negative, and grids per job and the report "
+          "interval positive.");
+    }
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 5, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  // Every edge holds the constant boundary value also used for verification
+  const auto boundary = MakeBoundary(rows, cols);
+
+  try {
+
+    std::cout << "Loading program..." << std::flush;
+    Runtime runtime;
+    std::cout << " Done." << std::endl;
+
+    std::cout << std::setw(10) << "Jobs" << std::setw(12) << "Jobs/s"
+              << std::setw(16) << "Latency [s]" << std::setw(16)
+              << "Latency p95" << std::setw(16) << "Queued [s]"
+              << std::setw(16) << "Kernel [s]" << std::endl;
+    std::deque<std::pair<long, std::future<JobResult>>> inFlight;
+    long submitted = 0;
+    long completed = 0;
+    std::vector<JobTiming> timings;
+    auto reportBegin = std::chrono::steady_clock::now();
+    while (jobs == 0 || completed < jobs) {
+      while ((jobs == 0 || submitted < jobs) &&
+             static_cast<int>(inFlight.size()) < kJobsInFlight) {
+        Job job{{}, boundary, rows, cols, blocks, timesteps};
+        for (int g = 0; g < grids; ++g) {
+          job.grids.emplace_back(JobInput(submitted, g, rows, cols));
+        }
+        inFlight.emplace_back(submitted, runtime.Submit(std::move(job)));
+        ++submitted;
+      }
+      const long id = inFlight.front().first;
+      const auto result = inFlight.front().second.get();
+      inFlight.pop_front();
+      if (verify) {
+        for (int g = 0; g < grids; ++g) {
+          const auto reference =
+              Reference(JobInput(id, g, rows, cols), rows, cols, timesteps);
+          const auto statistics = CompareResult(
+              reference, PackBatch({result.grids[g]}, rows, cols).data(),
+              rows, cols, DefaultTolerance());
+          if (statistics.mismatches != 0) {
+            std::cerr << "Verification of grid " << g << " of job " << id
+                      << " failed: ";
+            PrintErrorStatistics(std::cerr, statistics);
+            std::cerr << std::endl;
+            PrintErrorDetails(std::cerr, statistics);
+            return 1;
+          }
+        }
+      }
+      timings.emplace_back(result.timing);
+      ++completed;
+      if (static_cast<int>(timings.size()) == interval ||
+          completed == jobs) {
+        const auto reportEnd = std::chrono::steady_clock::now();
+        PrintReport(
+            completed, timings,
+            std::chrono::duration<double>(reportEnd - reportBegin).count());
+        timings.clear();
+        reportBegin = reportEnd;
+      }
+    }
+    std::cout << "Completed " << completed << " jobs with "
+              << runtime.Allocations() << " device memory allocations."
+              << std::endl;
+    if (verify) {
+      std::cout << "Verification successful." << std::endl;
+    }
+
+  } catch (std::runtime_error const &err) {
+    std::cerr << "Execution failed with error: \"" << err.what() << "\"."
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,309 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Runtime.h"
+#include "Layout.h"
+#include "Trace.h"
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/// Buffer in the given bank, or in the default bank of the single-bank kernel
+template <typename T>
+hlslib::ocl::Buffer<T, hlslib::ocl::Access::readWrite> MakeBankBuffer(
+    hlslib::ocl::Context &context, const int bank, const long size) {
+  if (kDimms == 1) {
+    return context.MakeBuffer<T, hlslib::ocl::Access::readWrite>(
+        hlslib::ocl::MemoryBank::bank0, size);
+  }
+  return context.MakeBuffer<T, hlslib::ocl::Access::readWrite>(
+      kMemoryHbm ? hlslib::ocl::StorageType::HBM
+                 : hlslib::ocl::StorageType::DDR,
+      bank, size);
+}
+
+long BankWords(const int grids, const int rows, const int cols) {
+  return 2 * static_cast<long>(grids) * TotalElementsMemory(rows, cols) /
+         kDimms;
+}
+
+double Seconds(std::chrono::steady_clock::time_point const &begin,
+               std::chrono::steady_clock::time_point const &end) {
+  return std::chrono::duration<double>(end - begin).count();
+}
+
+} // End anonymous namespace
+
+Runtime::Runtime(std::string const &path)
+    : program_([this, &path]() {
+        TraceSpan span("Make program");
+        return context_.MakeProgram(path);
+      }()) {
+  executor_ = std::thread([this]() {
+    if (kTrace) {
+      NameTraceThread("runtime kernel");
+    }
+    ExecuteJobs();
+  });
+  worker_ = std::thread([this]() {
+    if (kTrace) {
+      NameTraceThread("runtime");
+    }
+    Work();
+  });
+}
+
+Runtime::~Runtime() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    stopping_ = true;
+  }
+  queueCondition_.notify_all();
+  worker_.join();
+  {
+    std::lock_guard<std::mutex> lock(executeMutex_);
+    executorStopping_ = true;
+  }
+  executeCondition_.notify_all();
+  executor_.join();
+}
+
+DeviceLease_t Runtime::Acquire(const int grids, const int rows,
+                               const int cols, const int timesteps) {
+  const long bankWords = BankWords(grids, rows, cols);
+  const long residuals = static_cast<long>(grids) * TimeFolded(timesteps);
+  const long boundaryWords = TotalBoundaryMemory(rows, cols);
+  const auto Release = [this](DeviceGrids *device) {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    pool_.emplace_back(device);
+  };
+  {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    for (auto i = pool_.begin(); i != pool_.end(); ++i) {
+      if ((*i)->bankWords >= bankWords && (*i)->residuals >= residuals &&
+          (*i)->boundaryWords >= boundaryWords) {
+        DeviceLease_t device((*i).release(), Release);
+        pool_.erase(i);
+        return device;
+      }
+    }
+    ++allocations_;
+  }
+  // Buffers that are too small stay in the pool, as they can still serve
+  // smaller launches
+  TraceSpan span("Allocate device memory");
+  std::unique_ptr<DeviceGrids> device(new DeviceGrids{
+      {},
+      MakeBankBuffer<Residual_t>(context_, 0, residuals),
+      MakeBankBuffer<Counter_t>(context_, 0, kCounterEntries),
+      MakeBankBuffer<Memory_t>(context_, 0, boundaryWords),
+      bankWords,
+      residuals,
+      boundaryWords});
+  for (int k = 0; k < kDimms; ++k) {
+    device->banks.emplace_back(
+        MakeBankBuffer<Memory_t>(context_, k, bankWords));
+  }
+  return DeviceLease_t(device.release(), Release);
+}
+
+hlslib::ocl::Kernel Runtime::MakeKernel(DeviceGrids &device,
+                                        const int boundaryModes,
+                                        const int grids, const int rows,
+                                        const int cols, const int blocks,
+                                        const int timesteps) {
+  if (device.bankWords < BankWords(grids, rows, cols) ||
+      device.residuals < static_cast<long>(grids) * TimeFolded(timesteps) ||
+      device.boundaryWords < TotalBoundaryMemory(rows, cols)) {
+    throw std::invalid_argument("Device memory is too small for the launch.");
+  }
+  if (kDimms == 1) {
+    return program_.MakeKernel(Jacobi, "Jacobi", device.banks[0],
+                               device.banks[0], device.residual,
+                               STENCIL_COUNTERS(device.counters,)
+                               device.boundary, boundaryModes, grids, rows,
+                               cols, blocks, timesteps);
+  }
+  return program_.MakeKernel(
+      JacobiBanks, "JacobiBanks",
+      STENCIL_BANK_ARGUMENTS(device.banks, device.banks), device.residual,
+      STENCIL_COUNTERS(device.counters,) device.boundary, boundaryModes, grids,
+      rows, cols, blocks, timesteps);
+}
+
+std::future<JobResult> Runtime::Submit(Job job) {
+  if (job.grids.empty()) {
+    throw std::invalid_argument("Jobs must contain at least one grid.");
+  }
+  ValidateDimensions(job.rows, job.cols, job.blocks, job.timesteps);
+  ValidateBoundary(job.boundary, job.rows, job.cols);
+  for (auto const &grid : job.grids) {
+    if (static_cast<long>(grid.size()) !=
+        static_cast<long>(job.rows) * job.cols) {
+      throw std::invalid_argument("Grids must hold rows x cols values.");
+    }
+  }
+  Pending pending{std::move(job), std::promise<JobResult>(), Clock::now()};
+  auto future = pending.promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    queue_.emplace_back(std::move(pending));
+  }
+  queueCondition_.notify_one();
+  return future;
+}
+
+int Runtime::Allocations() const {
+  std::lock_guard<std::mutex> lock(poolMutex_);
+  return allocations_;
+}
+
+std::unique_ptr<Runtime::Staged> Runtime::Next(const bool wait) {
+  std::unique_lock<std::mutex> lock(queueMutex_);
+  if (wait) {
+    queueCondition_.wait(lock,
+                         [this]() { return stopping_ || !queue_.empty(); });
+  }
+  if (queue_.empty()) {
+    return nullptr;
+  }
+  std::unique_ptr<Staged> staged(new Staged);
+  staged->pending = std::move(queue_.front());
+  queue_.pop_front();
+  return staged;
+}
+
+void Runtime::Upload(Staged &staged) {
+  TraceSpan span("Upload job");
+  const auto begin = Clock::now();
+  auto const &job = staged.pending.job;
+  staged.result.timing.queued = Seconds(staged.pending.submitted, begin);
+  try {
+    staged.device =
+        Acquire(job.grids.size(), job.rows, job.cols, job.timesteps);
+    staged.hostBanks = PackBanks(job.grids, job.rows, job.cols);
+    for (int k = 0; k < kDimms; ++k) {
+      staged.device->banks[k].CopyFromHost(0, staged.hostBanks[k].size(),
+                                           staged.hostBanks[k].cbegin());
+    }
+    const auto boundary = PackBoundary(job.boundary, job.rows, job.cols);
+    staged.device->boundary.CopyFromHost(0, boundary.size(),
+                                         boundary.cbegin());
+  } catch (...) {
+    staged.error = std::current_exception();
+  }
+  staged.result.timing.upload = Seconds(begin, Clock::now());
+}
+
+void Runtime::Execute(Staged &staged) {
+  TraceSpan span("Execute job");
+  const auto begin = Clock::now();
+  if (!staged.error) {
+    auto const &job = staged.pending.job;
+    try {
+      MakeKernel(*staged.device, job.boundary.modes, job.grids.size(),
+                 job.rows, job.cols, job.blocks, job.timesteps)
+          .ExecuteTask();
+    } catch (...) {
+      staged.error = std::current_exception();
+    }
+  }
+  staged.result.timing.execute = Seconds(begin, Clock::now());
+}
+
+void Runtime::Complete(Staged &staged) {
+  TraceSpan span("Complete job");
+  const auto begin = Clock::now();
+  if (!staged.error) {
+    auto const &job = staged.pending.job;
+    try {
+      for (int k = 0; k < kDimms; ++k) {
+        staged.device->banks[k].CopyToHost(0, staged.hostBanks[k].size(),
+                                           staged.hostBanks[k].begin());
+      }
+      staged.result.residual.resize(job.grids.size() *
+                                    TimeFolded(job.timesteps));
+      staged.device->residual.CopyToHost(0, staged.result.residual.size(),
+                                         staged.result.residual.begin());
+      if (kCounters) {
+        staged.result.counters.resize(kCounterEntries);
+        staged.device->counters.CopyToHost(0, kCounterEntries,
+                                           staged.result.counters.begin());
+      }
+      staged.result.grids = UnpackBanks(staged.hostBanks, job.rows, job.cols,
+                                        job.timesteps);
+    } catch (...) {
+      staged.error = std::current_exception();
+    }
+  }
+  // Return the device memory to the pool before the job is reported as done
+  staged.device.reset();
+  const auto end = Clock::now();
+  staged.result.timing.download = Seconds(begin, end);
+  staged.result.timing.latency = Seconds(staged.pending.submitted, end);
+  if (staged.error) {
+    staged.pending.promise.set_exception(staged.error);
+  } else {
+    staged.pending.promise.set_value(std::move(staged.result));
+  }
+}
+
+void Runtime::Work() {
+  std::unique_ptr<Staged> previous;
+  auto current = Next(true);
+  if (current) {
+    Upload(*current);
+  }
+  while (current) {
+    // The transfers of the previous and next job only touch their own device
+    // memory, so they can proceed alongside the kernel
+    {
+      std::lock_guard<std::mutex> lock(executeMutex_);
+      executing_ = current.get();
+    }
+    executeCondition_.notify_all();
+    if (previous) {
+      Complete(*previous);
+    }
+    auto next = Next(false);
+    if (next) {
+      Upload(*next);
+    }
+    {
+      std::unique_lock<std::mutex> lock(executeMutex_);
+      executeCondition_.wait(lock, [this]() { return executing_ == nullptr; });
+    }
+    previous = std::move(current);
+    if (!next) {
+      // Nothing to overlap the download with, so complete the job right away
+      // instead of holding it back until another job is submitted
+      Complete(*previous);
+      previous.reset();
+      next = Next(true);
+      if (next) {
+        Upload(*next);
+      }
+    }
+    current = std::move(next);
+  }
+}
+
+void Runtime::ExecuteJobs() {
+  std::unique_lock<std::mutex> lock(executeMutex_);
+  while (true) {
+    executeCondition_.wait(lock, [this]() {
+      return executorStopping_ || executing_ != nullptr;
+    });
+    if (executing_ == nullptr) {
+      return;
+    }
+    Staged *staged = executing_;
+    lock.unlock();
+    // Execute reports errors through the job rather than throwing
+    Execute(*staged);
+    lock.lock();
+    executing_ = nullptr;
+    executeCondition_.notify_all();
+  }
+}
@@ -3,23 +3,64 @@
 
 #include "Stencil.h"
 
+constexpr DesignPoint kDesign{kDepth, kKernelWidth, kMemoryWidth, kBlocks,
+                              kDimms};
+
 constexpr unsigned long BufferSpace() {
-  return (kBlocks == 1) ? (kDepth * 2 * kBlockWidthKernel * kBlocks * kKernelWidth)
-                        : (2 * kDepth * kBlockWidthKernel * kKernelWidth +
-                           2 * kDepth * kDepth + 2 * kDepth);
+  return ModelBufferSpace<Stencil_t>(kDesign, kCols);
 }
 
-constexpr unsigned long CyclesRequired() {
-  return (kBlockWidthKernel + 2 * kHaloKernel) * kRows * kBlocks * kTimeFolded;
+constexpr float Efficiency() {
+  return ModelEfficiency<Stencil_t>(kDesign, kCols);
 }
 
-constexpr float Efficiency() {
-  return (kBlocks == 1)
-             ? 1
-             : kBlockWidthKernel / static_cast<float>(kBlockWidthKernel + 2 * kHaloKernel);
+constexpr int OpsPerCycle() {
+  return ModelOpsPerCycle<Stencil_t>(kDesign);
+}
+
+/// Cells moved per byte of memory bandwidth relative to single precision, which
+/// is the factor by which the kernel width can grow with a narrower data type
+/// at the same memory bandwidth
+constexpr double TypeGain() {
+  return static_cast<double>(sizeof(float)) / sizeof(Data_t);
 }
 
-constexpr int OpsPerCycle() { return kDepth * kKernelWidth * 4; }
+/// Bytes read and written per cycle, averaged over a full pass
+constexpr double MemoryBytesPerCycle() {
+  return static_cast<double>(kTotalReadMemory + kTotalElementsMemory) *
+         sizeof(Memory_t) * kTimeFolded /
+         CyclesRequired(kRows, kCols, kBlocks, kTimeTotal);
+}
+
+// Plane and line buffers of the three-dimensional kernel. Each stage delays
+// its input by two planes of its tile including halos, which shrink by one row
+// and column on either side per stage.
+constexpr unsigned long BufferSpace3D() {
+  unsigned long space = 0;
+  for (long stage = 0; stage < kDepth; ++stage) {
+    const long width =
+        kBlockWidthKernel +
+        2 * ((kRadius * (kDepth - stage) + kKernelWidth - 1) / kKernelWidth);
+    const long height = kTileRows3D + 2 * kRadius3D * (kDepth - stage);
+    space += 2 * height * width * kKernelWidth;
+  }
+  return space;
+}
+
+constexpr unsigned long CyclesRequired3D() {
+  return (kBlockWidthKernel + 2 * kHaloKernel) *
+         TileInputRows(kRows, kRowBlocks) * kPlanes * kRowBlocks * kBlocks *
+         kTimeFolded;
+}
+
+constexpr float Efficiency3D() {
+  return Efficiency() * kTileRows3D /
+         static_cast<float>(TileInputRows(kRows, kRowBlocks));
+}
+
+constexpr int OpsPerCycle3D() {
+  return kDepth * kKernelWidth * Stencil3D_t::kOperations;
+}
 
 int main(int argc, char **argv) {
   float clock = kTargetClock;
@@ -31,9 +72,21 @@ int main(int argc, char **argv) {
   std::cout << "Total elements: " << kRows * kCols << "\n";
   std::cout << "Data width:     " << kKernelWidth << " elements / "
             << sizeof(Kernel_t) << " bytes\n";
+  std::cout << "Data type:      " << kDataTypeString << " / "
+            << sizeof(Data_t) << " bytes, accumulated in "
+            << kAccumulationTypeString << "\n";
+  std::cout << "Gain over float: " << TypeGain()
+            << "x cells per byte of bandwidth (same bandwidth as a float "
+               "kernel of width "
+            << kKernelWidth / TypeGain() << ")\n";
   std::cout << "Total bursts:   " << kTotalElementsKernel << " / "
             << kTotalInputKernel << " with halos\n";
+  std::cout << "Memory reads:   " << kTotalReadMemory << " / "
+            << kTotalInputMemory << " words per pass"
+            << (kHaloReuse ? " (halos reused on chip)\n" : "\n");
   std::cout << "Burst requests: " << kBlocks * kRows * kTimeFolded << "\n";
+  std::cout << "Stencil:        " << Stencil_t::kPoints << " points / radius "
+            << kRadius << " / " << Stencil_t::kOperations << " Op/cell\n";
   std::cout << "Depth:          " << kDepth << "\n";
   std::cout << "Blocks:         " << kBlocks << "\n";
   std::cout << "Block size:     " << kBlockWidthKernel << " bursts / "
@@ -44,8 +97,12 @@ int main(int argc, char **argv) {
             << BufferSpace() * sizeof(Data_t) << " bytes\n";
   std::cout << "Timesteps:      " << kTimeTotal << " / " << kTimeFolded
             << " folded\n";
-  std::cout << "Total cycles:   " << CyclesRequired() << " (plus latency)\n";
-  std::cout << "Expected time:  " << CyclesRequired() / (1e6 * clock)
+  std::cout << "Total cycles:   "
+            << CyclesRequired(kRows, kCols, kBlocks, kTimeTotal)
+            << " (plus latency)\n";
+  std::cout << "Expected time:  "
+            << CyclesRequired(kRows, kCols, kBlocks, kTimeTotal) /
+                   (1e6 * clock)
             << " seconds.\n";
   std::cout << "Clock rate:     " << clock << " MHz";
   if (clock != kTargetClock) {
@@ -61,4 +118,27 @@ int main(int argc, char **argv) {
             << (Efficiency() * OpsPerCycle() * clock) / 1000 << " GOp/s\n";
   std::cout << "Bandwidth required to saturate: " << 2 * sizeof(Kernel_t) * 1e-3 * clock
             << " GB/s\n";
+  std::cout << "Bandwidth used at effective perf: "
+            << MemoryBytesPerCycle() * 1e-3 * clock << " GB/s\n";
+  std::cout << "Memory banks:   " << kDimms << " "
+            << (kMemoryHbm ? "HBM" : "DDR") << " / "
+            << 2 * sizeof(Kernel_t) * 1e-3 * clock / kDimms
+            << " GB/s per bank\n";
+  std::cout << "\n3D kernel:\n";
+  std::cout << "Planes:         " << kPlanes << "\n";
+  std::cout << "Row blocks:     " << kRowBlocks << "\n";
+  std::cout << "Tile size:      " << kTileRows3D << " rows / "
+            << TileInputRows(kRows, kRowBlocks) << " with halos\n";
+  std::cout << "Stencil:        " << Stencil3D_t::kPoints << " points / "
+            << Stencil3D_t::kOperations << " Op/cell\n";
+  std::cout << "Efficiency:     " << 100 * Efficiency3D() << "%\n";
+  std::cout << "Buffer space:   " << BufferSpace3D() << " elements / "
+            << BufferSpace3D() * sizeof(Data_t) << " bytes\n";
+  std::cout << "Total cycles:   " << CyclesRequired3D() << " (plus latency)\n";
+  std::cout << "Expected time:  " << CyclesRequired3D() / (1e6 * clock)
+            << " seconds.\n";
+  std::cout << "Instantiated Op/Cycle: " << OpsPerCycle3D() << "\n";
+  std::cout << "Effective Perf:        " << std::setprecision(4)
+            << (Efficiency3D() * OpsPerCycle3D() * clock) / 1000
+            << " GOp/s\n";
 }
@@ -2,62 +2,150 @@
 /// @copyright This software is copyrighted under the BSD 3-Clause License. 
 
 #include "Compute.h"
+#include "Compute3D.h"
 #include "Memory.h"
 
-void Jacobi(Memory_t const *in, Memory_t *out) {
-  #pragma HLS INTERFACE m_axi port=in offset=slave bundle=gmem0
-  #pragma HLS INTERFACE m_axi port=out offset=slave bundle=gmem1
-  #pragma HLS INTERFACE s_axilite port=in     bundle=control 
-  #pragma HLS INTERFACE s_axilite port=out    bundle=control 
-  #pragma HLS INTERFACE s_axilite port=return bundle=control 
+namespace {
+
+/// Streams every pass of the given timesteps through a single dataflow
+/// region, starting from the half of the ping-pong buffer of the first pass.
+void JacobiDataflow(Memory_t const *in, Memory_t *out, Residual_t *residual,
+                    STENCIL_COUNTERS(Counter_t *counters,)
+                    Memory_t const *boundary, const int boundaryModes,
+                    const int grids, const int rows, const int cols,
+                    const int blocks, const int timesteps, const int firstPass,
+                    const int passes) {
+  #pragma HLS INLINE off
   #pragma HLS DATAFLOW
 #ifndef STENCIL_SYNTHESIS
-  std::vector<std::thread> threads;
-  hlslib::Stream<Kernel_t> toKernel("toKernel");
-  hlslib::Stream<Kernel_t> fromKernel("fromKernel");
-  Read(in, toKernel, threads);
-  UnrollCompute<kDepth>(toKernel, fromKernel, threads);
-  Write(fromKernel, out, threads);
-  for (auto &t : threads) {
-    t.join();
-  }
+  Dataflow dataflow;
+  Stream_t<Kernel_t> toKernel("toKernel");
+  Stream_t<Kernel_t> fromKernel("fromKernel");
+  Stream_t<Residual_t> residualPipe("residualPipe");
+#ifdef STENCIL_ENABLE_COUNTERS
+  Stream_t<Counters_t> readCounters[kDimms];
+  Stream_t<Counters_t> widenCounters("widenCounters");
+  Stream_t<Counters_t> computeCounters[kDepth];
+  Stream_t<Counters_t> writeCounters[kDimms];
+  NameStreams(readCounters, "readCounters");
+  NameStreams(computeCounters, "computeCounters");
+  NameStreams(writeCounters, "writeCounters");
+#endif
+  Read(in, boundary, toKernel,
+       STENCIL_COUNTERS(readCounters[0], widenCounters,) boundaryModes, grids,
+       rows, cols, blocks, timesteps, firstPass, dataflow);
+  UnrollCompute<kDepth>(toKernel, fromKernel, residualPipe,
+                        STENCIL_COUNTERS(computeCounters,) boundaryModes,
+                        grids, rows, cols, blocks, timesteps, dataflow);
+  Write(fromKernel, out, STENCIL_COUNTERS(writeCounters[0],) grids, rows,
+        cols, blocks, timesteps, firstPass, dataflow);
+  WriteResidual(residualPipe, residual, grids, timesteps, firstPass, passes,
+                dataflow);
+#ifdef STENCIL_ENABLE_COUNTERS
+  WriteCounters(readCounters, widenCounters, computeCounters, writeCounters,
+                counters, 1, firstPass, dataflow);
+#endif
+  dataflow.Run();
 #else
-  hlslib::Stream<Kernel_t, kPipeDepth> toKernel("toKernel");
-  hlslib::Stream<Kernel_t, kPipeDepth> fromKernel("fromKernel");
-  Read(in, toKernel);
-  UnrollCompute<kDepth>(toKernel, fromKernel);
-  Write(fromKernel, out);
+  Stream_t<Kernel_t, kPipeDepth> toKernel("toKernel");
+  Stream_t<Kernel_t, kPipeDepth> fromKernel("fromKernel");
+  Stream_t<Residual_t, kPipeDepth> residualPipe("residualPipe");
+#ifdef STENCIL_ENABLE_COUNTERS
+  Stream_t<Counters_t, 1> readCounters[kDimms];
+  Stream_t<Counters_t, 1> widenCounters("widenCounters");
+  Stream_t<Counters_t, 1> computeCounters[kDepth];
+  Stream_t<Counters_t, 1> writeCounters[kDimms];
+#endif
+  Read(in, boundary, toKernel,
+       STENCIL_COUNTERS(readCounters[0], widenCounters,) boundaryModes, grids,
+       rows, cols, blocks, timesteps, firstPass);
+  UnrollCompute<kDepth>(toKernel, fromKernel, residualPipe,
+                        STENCIL_COUNTERS(computeCounters,) boundaryModes,
+                        grids, rows, cols, blocks, timesteps);
+  Write(fromKernel, out, STENCIL_COUNTERS(writeCounters[0],) grids, rows,
+        cols, blocks, timesteps, firstPass);
+  WriteResidual(residualPipe, residual, grids, timesteps, firstPass, passes);
+#ifdef STENCIL_ENABLE_COUNTERS
+  WriteCounters(readCounters, widenCounters, computeCounters, writeCounters,
+                counters, 1, firstPass);
+#endif
+#endif
+}
+
+} // End anonymous namespace
+
+void Jacobi(Memory_t const *in, Memory_t *out, Residual_t *residual,
+            STENCIL_COUNTERS(Counter_t *counters,) Memory_t const *boundary,
+            const int boundaryModes, const int grids, const int rows,
+            const int cols, const int blocks, const int timesteps) {
+  #pragma HLS INTERFACE m_axi port=in offset=slave bundle=gmem0
+  #pragma HLS INTERFACE m_axi port=out offset=slave bundle=gmem1
+  #pragma HLS INTERFACE m_axi port=residual offset=slave bundle=gmem1
+#ifdef STENCIL_ENABLE_COUNTERS
+  #pragma HLS INTERFACE m_axi port=counters offset=slave bundle=gmem1
+#endif
+  #pragma HLS INTERFACE m_axi port=boundary offset=slave bundle=gmem0
+  #pragma HLS INTERFACE s_axilite port=in        bundle=control 
+  #pragma HLS INTERFACE s_axilite port=out       bundle=control 
+  #pragma HLS INTERFACE s_axilite port=residual  bundle=control 
+#ifdef STENCIL_ENABLE_COUNTERS
+  #pragma HLS INTERFACE s_axilite port=counters  bundle=control 
 #endif
+  #pragma HLS INTERFACE s_axilite port=boundary  bundle=control 
+  #pragma HLS INTERFACE s_axilite port=boundaryModes bundle=control 
+  #pragma HLS INTERFACE s_axilite port=grids     bundle=control 
+  #pragma HLS INTERFACE s_axilite port=rows      bundle=control 
+  #pragma HLS INTERFACE s_axilite port=cols      bundle=control 
+  #pragma HLS INTERFACE s_axilite port=blocks    bundle=control 
+  #pragma HLS INTERFACE s_axilite port=timesteps bundle=control 
+  #pragma HLS INTERFACE s_axilite port=return    bundle=control 
+  // With periodic edges, every pass reads halos written at the end of the
+  // previous pass. Every pass then runs as its own dataflow region, which
+  // drains before the next one starts, rather than the writer signalling the
+  // reader, which would be a cycle in the dataflow graph.
+  const int passes = TimeFolded(timesteps);
+  const bool barrier = PassBarrier(boundaryModes);
+JacobiPasses:
+  for (int t = 0; t < (barrier ? passes : 1); ++t) {
+    JacobiDataflow(in, out, residual, STENCIL_COUNTERS(counters,) boundary,
+                   boundaryModes, grids, rows, cols, blocks,
+                   barrier ? TimestepsInPass(timesteps, t) : timesteps, t,
+                   passes);
+  }
 }
 
-void JacobiTwoDimms(Memory_t const *in0, Memory_t *out0,
-                    Memory_t const *in1, Memory_t *out1) {
-  #pragma HLS INTERFACE m_axi port=in0  offset=slave bundle=gmem0
-  #pragma HLS INTERFACE m_axi port=out0 offset=slave bundle=gmem0
-  #pragma HLS INTERFACE m_axi port=in1  offset=slave bundle=gmem1
-  #pragma HLS INTERFACE m_axi port=out1 offset=slave bundle=gmem1
-  #pragma HLS INTERFACE s_axilite port=in0    bundle=control 
-  #pragma HLS INTERFACE s_axilite port=out0   bundle=control 
-  #pragma HLS INTERFACE s_axilite port=in1    bundle=control 
-  #pragma HLS INTERFACE s_axilite port=out1   bundle=control 
-  #pragma HLS INTERFACE s_axilite port=return bundle=control 
+void Jacobi3D(Memory_t const *in, Memory_t *out, const int planes,
+              const int rows, const int cols, const int rowBlocks,
+              const int blocks, const int timesteps) {
+  #pragma HLS INTERFACE m_axi port=in offset=slave bundle=gmem0
+  #pragma HLS INTERFACE m_axi port=out offset=slave bundle=gmem1
+  #pragma HLS INTERFACE s_axilite port=in        bundle=control 
+  #pragma HLS INTERFACE s_axilite port=out       bundle=control 
+  #pragma HLS INTERFACE s_axilite port=planes    bundle=control 
+  #pragma HLS INTERFACE s_axilite port=rows      bundle=control 
+  #pragma HLS INTERFACE s_axilite port=cols      bundle=control 
+  #pragma HLS INTERFACE s_axilite port=rowBlocks bundle=control 
+  #pragma HLS INTERFACE s_axilite port=blocks    bundle=control 
+  #pragma HLS INTERFACE s_axilite port=timesteps bundle=control 
+  #pragma HLS INTERFACE s_axilite port=return    bundle=control 
   #pragma HLS DATAFLOW
 #ifndef STENCIL_SYNTHESIS
-  std::vector<std::thread> threads;
-  hlslib::Stream<Kernel_t> toKernel("toKernel");
-  hlslib::Stream<Kernel_t> fromKernel("fromKernel");
-  Read(in0, in1, toKernel, threads);
-  UnrollCompute<kDepth>(toKernel, fromKernel, threads);
-  Write(fromKernel, out0, out1, threads);
-  for (auto &t : threads) {
-    t.join();
-  }
+  Dataflow dataflow;
+  Stream_t<Kernel_t> toKernel("toKernel");
+  Stream_t<Kernel_t> fromKernel("fromKernel");
+  Read3D(in, toKernel, planes, rows, cols, rowBlocks, blocks, timesteps,
+         dataflow);
+  UnrollCompute3D<kDepth>(toKernel, fromKernel, planes, rows, cols, rowBlocks,
+                          blocks, timesteps, dataflow);
+  Write3D(fromKernel, out, planes, rows, cols, rowBlocks, blocks, timesteps,
+          dataflow);
+  dataflow.Run();
 #else
-  hlslib::Stream<Kernel_t, kPipeDepth> toKernel("toKernel");
-  hlslib::Stream<Kernel_t, kPipeDepth> fromKernel("fromKernel");
-  Read(in0, in1, toKernel);
-  UnrollCompute<kDepth>(toKernel, fromKernel);
-  Write(fromKernel, out0, out1);
+  Stream_t<Kernel_t, kPipeDepth> toKernel("toKernel");
+  Stream_t<Kernel_t, kPipeDepth> fromKernel("fromKernel");
+  Read3D(in, toKernel, planes, rows, cols, rowBlocks, blocks, timesteps);
+  UnrollCompute3D<kDepth>(toKernel, fromKernel, planes, rows, cols, rowBlocks,
+                          blocks, timesteps);
+  Write3D(fromKernel, out, planes, rows, cols, rowBlocks, blocks, timesteps);
 #endif
 }
-
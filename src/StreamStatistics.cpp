@@ -0,0 +1,134 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "StreamStatistics.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+namespace {
+
+std::mutex &StatisticsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::map<std::string, StreamStatistics> &Statistics() {
+  static std::map<std::string, StreamStatistics> statistics;
+  return statistics;
+}
+
+std::map<std::string, size_t> &Depths() {
+  static std::map<std::string, size_t> depths;
+  return depths;
+}
+
+} // End anonymous namespace
+
+size_t StreamHistogramBucket(const size_t occupancy) {
+  size_t bucket = 0;
+  while ((size_t(1) << bucket) < occupancy) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+void RecordStreamStatistics(StreamStatistics const &statistics) {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  auto &all = Statistics();
+  auto found = all.find(statistics.name);
+  if (found == all.end()) {
+    all.emplace(statistics.name, statistics);
+    return;
+  }
+  auto &merged = found->second;
+  merged.depth = std::max(merged.depth, statistics.depth);
+  merged.streams += statistics.streams;
+  merged.pushes += statistics.pushes;
+  merged.highWater = std::max(merged.highWater, statistics.highWater);
+  merged.fullStalls += statistics.fullStalls;
+  merged.emptyStalls += statistics.emptyStalls;
+  if (merged.histogram.size() < statistics.histogram.size()) {
+    merged.histogram.resize(statistics.histogram.size(), 0);
+  }
+  for (size_t b = 0; b < statistics.histogram.size(); ++b) {
+    merged.histogram[b] += statistics.histogram[b];
+  }
+}
+
+std::vector<StreamStatistics> CollectStreamStatistics() {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  std::vector<StreamStatistics> collected;
+  for (auto const &statistics : Statistics()) {
+    collected.emplace_back(statistics.second);
+  }
+  return collected;
+}
+
+void ResetStreamStatistics() {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  Statistics().clear();
+}
+
+void SetStreamDepth(std::string const &name, const size_t depth) {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  if (depth == 0) {
+    Depths().erase(name);
+  } else {
+    Depths()[name] = depth;
+  }
+}
+
+void SetStreamDepths(std::map<std::string, size_t> const &depths) {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  Depths() = depths;
+}
+
+size_t StreamDepth(std::string const &name) {
+  std::lock_guard<std::mutex> lock(StatisticsMutex());
+  auto const found = Depths().find(name);
+  return (found == Depths().end()) ? 0 : found->second;
+}
+
+void PrintStreamStatistics(std::ostream &stream,
+                           std::vector<StreamStatistics> const &statistics,
+                           std::map<std::string, size_t> const &recommended) {
+  stream << std::left << std::setw(16) << "Stream" << std::right
+         << std::setw(8) << "Count" << std::setw(8) << "Depth"
+         << std::setw(12) << "High water" << std::setw(14) << "Full stalls"
+         << std::setw(14) << "Empty stalls";
+  if (!recommended.empty()) {
+    stream << std::setw(13) << "Recommended";
+  }
+  stream << "\n";
+  for (auto const &s : statistics) {
+    stream << std::left << std::setw(16) << s.name << std::right
+           << std::setw(8) << s.streams << std::setw(8) << s.depth
+           << std::setw(12) << s.highWater << std::setw(14) << s.fullStalls
+           << std::setw(14) << s.emptyStalls;
+    auto const found = recommended.find(s.name);
+    if (found != recommended.end()) {
+      stream << std::setw(13) << found->second;
+    }
+    stream << "\n";
+  }
+  // Share of pushes by occupancy, skipping streams that were never used
+  const auto precision = stream.precision();
+  stream << "\nOccupancy after push [% of pushes]:\n";
+  for (auto const &s : statistics) {
+    if (s.pushes == 0) {
+      continue;
+    }
+    stream << std::left << std::setw(16) << s.name << std::right;
+    for (size_t b = 0; b < s.histogram.size(); ++b) {
+      if (s.histogram[b] == 0) {
+        continue;
+      }
+      stream << " <=" << (size_t(1) << b) << ": " << std::fixed
+             << std::setprecision(1) << 100.0 * s.histogram[b] / s.pushes
+             << std::defaultfloat;
+    }
+    stream << "\n";
+  }
+  stream << std::setprecision(precision) << std::flush;
+}
@@ -2,100 +2,1204 @@
 /// @copyright This software is copyrighted under the BSD 3-Clause License. 
 
 #include "Stencil.h"
+#include "Arguments.h"
+#include "Dataflow.h"
+#include "Layout.h"
+#include "OutOfCore.h"
 #include "Reference.h"
-#include <algorithm> // std::copy
+#include "SpscStream.h"
+#include "StreamStatistics.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>     // std::fabs
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
-bool Verify(std::vector<Data_t> const &reference,
-            std::vector<Memory_t> const &test) {
-  const int offset = (kTimeFolded % 2 == 0) ? 0 : kTotalElementsMemory;
-  // int correct = 0;
-  // int mismatches = 0;
-  for (int r = 0; r < kRows; ++r) {
-    for (int c = 0; c < kBlockWidthMemory * kBlocks; ++c) {
-      const int index = r * kBlockWidthMemory * kBlocks + c;
-      for (int k = 0; k < kKernelPerMemory; ++k) {
-        const Kernel_t elem = test[offset + index][k];
-        for (int w = 0; w < kKernelWidth; ++w) {
-          const auto expected =
-              reference[kMemoryWidth * index + kKernelWidth * k + w];
-          const auto actual = elem[w];
-          auto diff = expected - actual;
-          diff = (diff < 0) ? Data_t(-diff) : Data_t(diff);
-          if (diff > 1e-4) {
-            std::cerr << "Mismatch at (" << r << ", "
-                      << c * kMemoryWidth + k * kKernelWidth + w
-                      << "): " << actual << " (should be " << expected << ")"
-                      << std::endl;
-            // ++mismatches;
-            return false;
-          } else {
-            // std::cout << "Correct at (" << r << ", "
-            //           << c * kMemoryWidth + k * kKernelWidth + w
-            //           << "): " << elem[w] << "\n";
-            // ++correct;
-          }
-        }
-      }
+/// Compares the result against the reference and prints the error statistics.
+/// Fails if any cell differs by more than the tolerance of the data type.
+bool Verify(std::vector<Data_t> const &reference, HostBuffer_t const &test,
+            const int rows, const int cols, const int timesteps) {
+  const long offset =
+      (TimeFolded(timesteps) % 2 == 0) ? 0 : TotalElementsMemory(rows, cols);
+  const auto statistics = CompareResult(reference, test.data() + offset, rows,
+                                        cols, DefaultTolerance());
+  if (statistics.mismatches > 0) {
+    const long i = statistics.firstMismatch;
+    std::cerr << "First mismatch at (" << i / cols << ", " << i % cols
+              << "), ";
+    PrintErrorStatistics(std::cerr, statistics);
+    std::cerr << std::endl;
+    PrintErrorDetails(std::cerr, statistics);
+    return false;
+  }
+  std::cout << " (";
+  PrintErrorStatistics(std::cout, statistics);
+  std::cout << ")";
+  return true;
+}
+
+/// Checks the residual of the last folded pass against the difference between
+/// the reference after the last two timesteps
+bool VerifyResidual(std::vector<Data_t> const &reference,
+                    std::vector<Data_t> const &referencePrevious,
+                    std::vector<Residual_t> const &residual) {
+  double expectedMax = 0;
+  double expectedSumSquares = 0;
+  for (size_t i = 0; i < reference.size(); ++i) {
+    const double diff = std::fabs(static_cast<double>(reference[i]) -
+                                  static_cast<double>(referencePrevious[i]));
+    expectedMax = std::max(expectedMax, diff);
+    expectedSumSquares += diff * diff;
+  }
+  const double actualMax =
+      static_cast<double>(residual.back()[kResidualMax]);
+  const double actualSumSquares =
+      static_cast<double>(residual.back()[kResidualSumSquares]);
+  // The sum of squares is accumulated in a different order than here, and
+  // every square is rounded to Accumulate_t
+  const double relative = std::max(1e-3, 4 * DataEpsilon());
+  const double absolute = reference.size() * AccumulationResolution() + 1e-6;
+  if (std::fabs(actualMax - expectedMax) > VerifyTolerance() ||
+      std::fabs(actualSumSquares - expectedSumSquares) >
+          relative * expectedSumSquares + absolute) {
+    std::cerr << "Mismatch in residual: " << actualMax << " / "
+              << actualSumSquares << " (should be " << expectedMax << " / "
+              << expectedSumSquares << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/// Checks the performance counters of a single grid against the words that
+/// must be transferred per bank and the cycles predicted by the model
+bool VerifyCounters(std::vector<Counter_t> const &counters, const int banks,
+                    const int rows, const int cols, const int blocks,
+                    const int timesteps) {
+  const long timeFolded = TimeFolded(timesteps);
+  Counter_t readBeats = 0;
+  for (int k = 0; k < banks; ++k) {
+    readBeats += counters[CounterIndex(CounterReadSplit(k), kCounterBeats)];
+    const Counter_t writeBeats =
+        counters[CounterIndex(CounterWriteSplit(k), kCounterBeats)];
+    if (writeBeats != timeFolded * TotalElementsMemory(rows, cols) / banks) {
+      std::cerr << "Mismatch in write beats of bank " << k << ": "
+                << writeBeats << " (should be "
+                << timeFolded * TotalElementsMemory(rows, cols) / banks << ")"
+                << std::endl;
+      return false;
     }
   }
-  // std::cout << "Correct: " << correct << "\nMismatches: " << mismatches
-  //           << std::endl;
+  if (readBeats != timeFolded * TotalReadMemory(rows, cols, blocks)) {
+    std::cerr << "Mismatch in read beats: " << readBeats << " (should be "
+              << timeFolded * TotalReadMemory(rows, cols, blocks) << ")"
+              << std::endl;
+    return false;
+  }
+  if (counters[kCounterCycles] < CyclesRequired(rows, cols, blocks,
+                                                timesteps)) {
+    std::cerr << "Kernel took " << counters[kCounterCycles]
+              << " cycles, which is less than the "
+              << CyclesRequired(rows, cols, blocks, timesteps)
+              << " cycles predicted." << std::endl;
+    return false;
+  }
   return true;
 }
 
-int main() {
+/// Runs the given kernel invocation and reports the rate of simulated cell
+/// updates, which is dominated by the stream implementation used to connect
+/// the processes of the dataflow
+template <typename F>
+void RunTimed(F const &run, const long cells) {
+  const auto start = std::chrono::steady_clock::now();
+  run();
+  const auto end = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << " Done (" << seconds << " s, " << cells / seconds
+            << " cells/s)." << std::endl;
+}
+
+/// Domain whose values vary along both rows and columns
+std::vector<Data_t> VaryingInput(const int rows, const int cols) {
+  std::vector<Data_t> input(static_cast<long>(rows) * cols);
+  for (long i = 0; i < static_cast<long>(input.size()); ++i) {
+    input[i] = Data_t(0.125 * ((i / cols) % 7 + 3 * ((i % cols) % 5)));
+  }
+  return input;
+}
+
+/// Boundary with the given modes, whose Dirichlet values vary along every edge
+Boundary VaryingBoundary(const int rows, const int cols, const int modes) {
+  auto boundary = MakeBoundary(rows, cols, modes);
+  for (int c = 0; c < cols; ++c) {
+    boundary.top[c] = Data_t(1 + 0.25 * (c % 3));
+    boundary.bottom[c] = Data_t(2 - 0.25 * (c % 5));
+  }
+  for (int r = 0; r < rows; ++r) {
+    boundary.left[r] = Data_t(0.5 + 0.125 * (r % 6));
+    boundary.right[r] = Data_t(1.5 - 0.125 * (r % 4));
+  }
+  return boundary;
+}
+
+int RunThreeDimensional(int argc, char **argv) {
+
+  if (argc != 2 && argc != 8) {
+    std::cerr << "Usage: ./Testbench 3d [<planes> <rows> <cols> <row blocks> "
+                 "<blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  int planes = kPlanes;
+  int rows = kRows;
+  int cols = kCols;
+  int rowBlocks = kRowBlocks;
+  int blocks = kBlocks;
+  int timesteps = kTimeTotal;
+  if (argc == 8) {
+    planes = std::stoi(argv[2]);
+    rows = std::stoi(argv[3]);
+    cols = std::stoi(argv[4]);
+    rowBlocks = std::stoi(argv[5]);
+    blocks = std::stoi(argv[6]);
+    timesteps = std::stoi(argv[7]);
+  }
+  try {
+    ValidateDimensions3D(planes, rows, cols, rowBlocks, blocks, timesteps);
+  } catch (std::invalid_argument const &err) {
+    std::cerr << "Invalid dimensions: " << err.what() << std::endl;
+    return 1;
+  }
+
+  // Planes are stored consecutively, so the domain is initialized as a
+  // single grid of planes * rows rows, which varies across planes as well
+  const auto input = VaryingInput(planes * rows, cols);
+
+  std::cout << "Running 3D reference implementation..." << std::flush;
+  const auto reference = Reference3D(input, planes, rows, cols, timesteps);
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Initializing memory..." << std::flush;
+  auto memory = PackBatch({input}, planes * rows, cols);
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Running 3D implementation..." << std::flush;
+  RunTimed(
+      [&]() {
+        Jacobi3D(memory.data(), memory.data(), planes, rows, cols, rowBlocks,
+                 blocks, timesteps);
+      },
+      static_cast<long>(planes) * rows * cols * timesteps);
+
+  std::cout << "Verifying 3D implementation..." << std::flush;
+  if (!Verify(reference, memory, planes * rows, cols, timesteps)) {
+    return 1;
+  }
+  std::cout << " Done." << std::endl;
+
+  return 0;
+}
+
+int RunConcurrent(int argc, char **argv) {
+
+  if (argc != 3 && argc != 7) {
+    std::cerr << "Usage: ./Testbench concurrent <instances> [<rows> <cols> "
+                 "<blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  const int instances = std::stoi(argv[2]);
+  const auto check = [instances](Dimensions const &) {
+    if (instances < 1) {
+      throw std::invalid_argument("At least one instance is required.");
+    }
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 3, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const long totalElementsMemory = TotalElementsMemory(rows, cols);
 
+  // Every instance starts from a different constant domain, such that
+  // instances interfering with each other produce the wrong result
   std::cout << "Running reference implementation..." << std::flush;
-  const auto reference = Reference(std::vector<Data_t>(kRows * kCols, 0));
+  std::vector<std::vector<Data_t>> references;
+  for (int i = 0; i < instances; ++i) {
+    references.emplace_back(Reference(
+        std::vector<Data_t>(static_cast<long>(rows) * cols, Data_t(i)), rows,
+        cols, timesteps));
+  }
   std::cout << " Done." << std::endl;
 
   std::cout << "Initializing memory..." << std::flush;
-  std::vector<Memory_t> memory(2 * kTotalElementsMemory,
-                               Kernel_t(Data_t(static_cast<Data_t>(0))));
-  std::vector<Memory_t> memorySplit(2 * kTotalElementsMemory,
-                                    Kernel_t(Data_t(static_cast<Data_t>(0))));
-  std::vector<Memory_t> memorySplit0(kTotalElementsMemory,
-                                     Kernel_t(Data_t(static_cast<Data_t>(0))));
-  std::vector<Memory_t> memorySplit1(kTotalElementsMemory,
-                                     Kernel_t(Data_t(static_cast<Data_t>(0))));
+  const auto boundary = PackBoundary(MakeBoundary(rows, cols), rows, cols);
+  std::vector<HostBuffer_t> memories;
+  std::vector<std::vector<HostBuffer_t>> memoryBanks;
+  std::vector<std::vector<Residual_t>> residuals;
+  std::vector<std::vector<Counter_t>> counters(
+      instances, std::vector<Counter_t>(kCounterEntries));
+  for (int i = 0; i < instances; ++i) {
+    memories.emplace_back(2 * totalElementsMemory, Kernel_t(Data_t(i)));
+    memoryBanks.emplace_back(SplitBanks(memories.back(), rows, cols));
+    residuals.emplace_back(TimeFolded(timesteps));
+  }
   std::cout << " Done." << std::endl;
 
-  std::cout << "Running single memory implementation..." << std::flush;
-  Jacobi(memory.data(), memory.data());
+  // Alternate between the single memory and multi-bank kernels, which share
+  // most of their processes
+  std::cout << "Running " << instances << " instances concurrently..."
+            << std::flush;
+  RunTimed(
+      [&]() {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < instances; ++i) {
+          threads.emplace_back([&, i]() {
+            if (i % 2 == 0) {
+              Jacobi(memories[i].data(), memories[i].data(),
+                     residuals[i].data(),
+                     STENCIL_COUNTERS(counters[i].data(),) boundary.data(),
+                     kBoundaryModesDirichlet, 1, rows, cols, blocks,
+                     timesteps);
+            } else {
+              Memory_t *banks[kDimms];
+              for (int k = 0; k < kDimms; ++k) {
+                banks[k] = memoryBanks[i][k].data();
+              }
+              JacobiBanks(STENCIL_BANK_ARGUMENTS(banks, banks),
+                          residuals[i].data(),
+                          STENCIL_COUNTERS(counters[i].data(),)
+                          boundary.data(),
+                          kBoundaryModesDirichlet, 1, rows, cols, blocks,
+                          timesteps);
+            }
+          });
+        }
+        for (auto &t : threads) {
+          t.join();
+        }
+      },
+      instances * static_cast<long>(rows) * cols * timesteps);
+
+  for (int i = 0; i < instances; ++i) {
+    std::cout << "Verifying instance " << i << "..." << std::flush;
+    const auto memory = (i % 2 == 0)
+                            ? memories[i]
+                            : MergeBanks(memoryBanks[i], rows, cols);
+    if (!Verify(references[i], memory, rows, cols, timesteps)) {
+      return 1;
+    }
+    std::cout << " Done." << std::endl;
+  }
+
+  return 0;
+}
+
+int RunBoundary(int argc, char **argv) {
+
+  if (argc != 2 && argc != 6) {
+    std::cerr << "Usage: ./Testbench boundary [<rows> <cols> <blocks> "
+                 "<timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 2, dimensions)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+
+  // A varying domain and varying Dirichlet values, such that values taken
+  // from the wrong row, column or edge produce the wrong result
+  const auto input = VaryingInput(rows, cols);
+  const auto initial = PackBatch({input}, rows, cols);
+
+  // Every mode on every edge, and combinations of modes across edges
+  const int d = kBoundaryDirichlet;
+  const int n = kBoundaryNeumann;
+  const int p = kBoundaryPeriodic;
+  const std::vector<std::pair<std::string, int>> configurations = {
+      {"Dirichlet", BoundaryModes(d, d, d, d)},
+      {"Neumann", BoundaryModes(n, n, n, n)},
+      {"periodic", BoundaryModes(p, p, p, p)},
+      {"Dirichlet/Neumann rows, periodic columns", BoundaryModes(d, n, p, p)},
+      {"periodic rows, Neumann/Dirichlet columns", BoundaryModes(p, p, n, d)},
+      {"Neumann rows, Dirichlet columns", BoundaryModes(n, n, d, d)}};
+
+  for (auto const &configuration : configurations) {
+    const auto boundary = VaryingBoundary(rows, cols, configuration.second);
+    try {
+      ValidateBoundary(boundary, rows, cols);
+    } catch (std::invalid_argument const &err) {
+      std::cerr << "Invalid boundary: " << err.what() << std::endl;
+      return 1;
+    }
+    const auto packed = PackBoundary(boundary, rows, cols);
+
+    std::cout << "Running " << configuration.first << " boundary..."
+              << std::flush;
+    const auto reference = Reference(input, rows, cols, timesteps, boundary);
+    const auto referencePrevious =
+        Reference(input, rows, cols, timesteps - 1, boundary);
+    auto memory = initial;
+    auto memoryBanks = SplitBanks(memory, rows, cols);
+    std::vector<Residual_t> residual(TimeFolded(timesteps));
+    std::vector<Residual_t> residualSplit(TimeFolded(timesteps));
+    std::vector<Counter_t> counters(kCounterEntries);
+    Memory_t *banks[kDimms];
+    for (int k = 0; k < kDimms; ++k) {
+      banks[k] = memoryBanks[k].data();
+    }
+    Jacobi(memory.data(), memory.data(), residual.data(),
+           STENCIL_COUNTERS(counters.data(),) packed.data(), boundary.modes, 1,
+           rows, cols, blocks, timesteps);
+    JacobiBanks(STENCIL_BANK_ARGUMENTS(banks, banks), residualSplit.data(),
+                STENCIL_COUNTERS(counters.data(),) packed.data(),
+                boundary.modes, 1, rows, cols, blocks, timesteps);
+    if (!Verify(reference, memory, rows, cols, timesteps) ||
+        !Verify(reference, MergeBanks(memoryBanks, rows, cols), rows, cols,
+                timesteps) ||
+        !VerifyResidual(reference, referencePrevious, residual) ||
+        !VerifyResidual(reference, referencePrevious, residualSplit)) {
+      return 1;
+    }
+    std::cout << " Done." << std::endl;
+  }
+
+  return 0;
+}
+
+int RunStrips(int argc, char **argv) {
+
+  if (argc != 3 && argc != 7) {
+    std::cerr << "Usage: ./Testbench outofcore <strip rows> [<rows> <cols> "
+                 "<blocks> <timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  const int stripRows = std::stoi(argv[2]);
+  // Different modes at the top and bottom, and varying values along the
+  // edges, such that strips taking the wrong edges produce the wrong result
+  const int modes =
+      BoundaryModes(kBoundaryDirichlet, kBoundaryNeumann, kBoundaryDirichlet,
+                    kBoundaryDirichlet);
+  const auto check = [stripRows, modes](Dimensions const &d) {
+    ValidateOutOfCore(d.rows, d.cols, d.blocks, d.timesteps, stripRows, modes);
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 3, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const auto boundary = VaryingBoundary(rows, cols, modes);
+  const auto strips = MakeStrips(rows, stripRows);
+  const long slotElements = 2 * TotalElementsMemory(StripRowsMax(strips), cols);
+  std::vector<HostBuffer_t> stripBoundaries;
+  std::vector<int> stripModes;
+  for (auto const &strip : strips) {
+    const auto stripBoundary = StripBoundary(boundary, strip);
+    stripBoundaries.emplace_back(
+        PackBoundary(stripBoundary, strip.rows, cols));
+    stripModes.emplace_back(stripBoundary.modes);
+  }
+  const auto input = VaryingInput(rows, cols);
+
+  std::cout << "Running reference implementation..." << std::flush;
+  const auto reference = Reference(input, rows, cols, timesteps, boundary);
   std::cout << " Done." << std::endl;
 
-  std::cout << "Running dual memory implementation..." << std::flush;
-  JacobiTwoDimms(memorySplit0.data(), memorySplit0.data(), memorySplit1.data(),
-                 memorySplit1.data());
+  // The single memory kernel sees the domain as a single bank
+  std::vector<int> bankCounts = {1};
+  if (kDimms > 1) {
+    bankCounts.emplace_back(kDimms);
+  }
+  for (const int banks : bankCounts) {
+    auto host = (banks == 1)
+                    ? std::vector<HostBuffer_t>(1,
+                                                PackBatch({input}, rows, cols))
+                    : SplitBanks(PackBatch({input}, rows, cols), rows, cols);
+    std::vector<HostBuffer_t> slots[2];
+    for (auto &slot : slots) {
+      slot.assign(banks, HostBuffer_t(slotElements / banks));
+    }
+    std::vector<Residual_t> residual(TimeFolded(kDepth));
+    std::vector<Counter_t> counters(kCounterEntries);
+    const auto upload = [&](const int i, const int slot, const int sweep) {
+      const auto transfer =
+          MakeStripTransfer(strips[i], rows, cols, banks, sweep);
+      for (int k = 0; k < banks; ++k) {
+        std::copy(host[k].begin() + transfer.inputHost,
+                  host[k].begin() + transfer.inputHost + transfer.inputWords,
+                  slots[slot][k].begin());
+      }
+    };
+    const auto execute = [&](const int i, const int slot, const int sweep) {
+      Strip const &strip = strips[i];
+      const int modes = stripModes[i];
+      const int steps = TimestepsInPass(timesteps, sweep);
+      if (banks == 1) {
+        Jacobi(slots[slot][0].data(), slots[slot][0].data(), residual.data(),
+               STENCIL_COUNTERS(counters.data(),) stripBoundaries[i].data(),
+               modes, 1, strip.rows, cols, blocks, steps);
+      } else {
+        Memory_t *pointers[kDimms];
+        for (int k = 0; k < kDimms; ++k) {
+          pointers[k] = slots[slot][k].data();
+        }
+        JacobiBanks(STENCIL_BANK_ARGUMENTS(pointers, pointers),
+                    residual.data(), STENCIL_COUNTERS(counters.data(),)
+                    stripBoundaries[i].data(), modes, 1, strip.rows, cols,
+                    blocks, steps);
+      }
+    };
+    const auto download = [&](const int i, const int slot, const int sweep) {
+      const auto transfer =
+          MakeStripTransfer(strips[i], rows, cols, banks, sweep);
+      for (int k = 0; k < banks; ++k) {
+        std::copy(slots[slot][k].begin() + transfer.outputDevice,
+                  slots[slot][k].begin() + transfer.outputDevice +
+                      transfer.outputWords,
+                  host[k].begin() + transfer.outputHost);
+      }
+    };
+
+    std::cout << "Running " << strips.size() << " strips on " << banks
+              << " bank(s)..." << std::flush;
+    RunTimed(
+        [&]() {
+          RunOutOfCore(strips, TimeFolded(timesteps), upload, execute,
+                       download);
+        },
+        static_cast<long>(rows) * cols * timesteps);
+
+    std::cout << "Verifying strips on " << banks << " bank(s)..."
+              << std::flush;
+    const auto memory =
+        (banks == 1) ? host[0] : MergeBanks(host, rows, cols);
+    if (!Verify(reference, memory, rows, cols, timesteps)) {
+      return 1;
+    }
+    std::cout << " Done." << std::endl;
+  }
+
+  return 0;
+}
+
+int RunBatch(int argc, char **argv) {
+
+  if (argc != 3 && argc != 7) {
+    std::cerr << "Usage: ./Testbench batch <grids> [<rows> <cols> <blocks> "
+                 "<timesteps>]"
+              << std::endl;
+    return 1;
+  }
+
+  const int grids = std::stoi(argv[2]);
+  const auto check = [grids](Dimensions const &) {
+    if (grids < 1) {
+      throw std::invalid_argument("At least one grid is required.");
+    }
+  };
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 3, dimensions, check)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const long totalElementsMemory = TotalElementsMemory(rows, cols);
+  const int timeFolded = TimeFolded(timesteps);
+
+  // Every grid starts from a different domain, such that grids taken from the
+  // wrong offset produce the wrong result
+  std::vector<std::vector<Data_t>> inputs;
+  for (int g = 0; g < grids; ++g) {
+    auto input = VaryingInput(rows, cols);
+    for (auto &value : input) {
+      value = Data_t(static_cast<double>(value) + 0.25 * g);
+    }
+    inputs.emplace_back(input);
+  }
+  const auto initial = PackBatch(inputs, rows, cols);
+
+  // Periodic edges additionally separate the passes over the batch
+  const int d = kBoundaryDirichlet;
+  const int n = kBoundaryNeumann;
+  const int p = kBoundaryPeriodic;
+  const std::vector<std::pair<std::string, int>> configurations = {
+      {"Dirichlet/Neumann", BoundaryModes(d, n, n, d)},
+      {"periodic", BoundaryModes(p, p, p, p)}};
+
+  for (auto const &configuration : configurations) {
+    const auto boundary = VaryingBoundary(rows, cols, configuration.second);
+    const auto packed = PackBoundary(boundary, rows, cols);
+
+    std::cout << "Running " << grids << " grids with " << configuration.first
+              << " boundary..." << std::flush;
+    auto memory = initial;
+    auto memoryBanks = PackBanks(inputs, rows, cols);
+    std::vector<Residual_t> residual(grids * timeFolded);
+    std::vector<Residual_t> residualSplit(grids * timeFolded);
+    std::vector<Counter_t> counters(kCounterEntries);
+    Memory_t *banks[kDimms];
+    for (int k = 0; k < kDimms; ++k) {
+      banks[k] = memoryBanks[k].data();
+    }
+    RunTimed(
+        [&]() {
+          Jacobi(memory.data(), memory.data(), residual.data(),
+                 STENCIL_COUNTERS(counters.data(),) packed.data(),
+                 boundary.modes, grids, rows, cols, blocks, timesteps);
+          JacobiBanks(STENCIL_BANK_ARGUMENTS(banks, banks),
+                      residualSplit.data(), STENCIL_COUNTERS(counters.data(),)
+                      packed.data(), boundary.modes, grids, rows, cols, blocks,
+                      timesteps);
+        },
+        2l * grids * rows * cols * timesteps);
+
+    const auto memorySplit = MergeBanks(memoryBanks, rows, cols);
+    const auto unpacked = UnpackBanks(memoryBanks, rows, cols, timesteps);
+    if (unpacked != UnpackBatch(memorySplit, rows, cols, timesteps)) {
+      std::cerr << "Grids unpacked from the banks differ from the batch."
+                << std::endl;
+      return 1;
+    }
+    for (int g = 0; g < grids; ++g) {
+      const GridView view(BankPointers(memoryBanks), rows, cols, g,
+                          timesteps);
+      for (long i = 0; i < static_cast<long>(rows) * cols; ++i) {
+        if (view.Get(i / cols, i % cols) != unpacked[g][i]) {
+          std::cerr << "View of grid " << g
+                    << " differs from the unpacked grid." << std::endl;
+          return 1;
+        }
+      }
+    }
+    for (int g = 0; g < grids; ++g) {
+      std::cout << "Verifying grid " << g << "..." << std::flush;
+      const auto reference =
+          Reference(inputs[g], rows, cols, timesteps, boundary);
+      const auto referencePrevious =
+          Reference(inputs[g], rows, cols, timesteps - 1, boundary);
+      const long begin = 2 * g * totalElementsMemory;
+      const long end = 2 * (g + 1) * totalElementsMemory;
+      const std::vector<Residual_t> residualGrid(
+          residual.begin() + g * timeFolded,
+          residual.begin() + (g + 1) * timeFolded);
+      const std::vector<Residual_t> residualSplitGrid(
+          residualSplit.begin() + g * timeFolded,
+          residualSplit.begin() + (g + 1) * timeFolded);
+      if (!Verify(reference,
+                  HostBuffer_t(memory.begin() + begin, memory.begin() + end),
+                  rows, cols, timesteps) ||
+          !Verify(reference,
+                  HostBuffer_t(memorySplit.begin() + begin,
+                               memorySplit.begin() + end),
+                  rows, cols, timesteps) ||
+          !VerifyResidual(reference, referencePrevious, residualGrid) ||
+          !VerifyResidual(reference, referencePrevious, residualSplitGrid)) {
+        return 1;
+      }
+      std::cout << " Done." << std::endl;
+    }
+  }
+
+  return 0;
+}
+
+/// Injects known errors into a copy of a grid and checks that the verifier
+/// reports them, both against the default tolerance and against relative and
+/// ulp tolerances.
+int RunVerifier(int argc, char **argv) {
+
+  if (argc != 2 && argc != 4) {
+    std::cerr << "Usage: ./Testbench verifier [<rows> <cols>]" << std::endl;
+    return 1;
+  }
+
+  int rows = kRows;
+  int cols = kCols;
+  if (argc == 4) {
+    rows = std::stoi(argv[2]);
+    cols = std::stoi(argv[3]);
+  }
+  if (rows < 8 || cols < 8 || cols % kMemoryWidth != 0) {
+    std::cerr << "Invalid dimensions: at least 8 x 8 cells are required, and "
+                 "columns must be divisable by the memory width."
+              << std::endl;
+    return 1;
+  }
+
+  const auto reference = VaryingInput(rows, cols);
+  std::vector<std::vector<Data_t>> grids = {reference};
+  // Cell (2, 2) holds 1, so increasing it by epsilon is an error of one ulp
+  // within the default tolerance, while cell (3, 1) is clearly wrong
+  grids[0][2 * cols + 2] = Data_t(1 + DataEpsilon());
+  grids[0][3 * cols + 1] = Data_t(static_cast<double>(reference[3 * cols + 1]) +
+                                  0.5);
+  // NaNs only exist for floating point types
+  const bool nan =
+      std::isnan(static_cast<double>(Data_t(std::nan("")))) &&
+      static_cast<double>(Data_t(DataEpsilon() / 4)) != 0;
+  if (nan) {
+    grids[0][1 * cols + 4] = Data_t(std::nan(""));
+  }
+  const auto result = PackBatch(grids, rows, cols);
+
+  std::cout << "Verifying " << static_cast<long>(rows) * cols
+            << " cells..." << std::flush;
+  const auto begin = std::chrono::steady_clock::now();
+  const auto statistics =
+      CompareResult(reference, result.data(), rows, cols, DefaultTolerance());
+  const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+  std::cout << " Done in " << elapsed << " seconds.\n";
+  PrintErrorStatistics(std::cout, statistics);
+  std::cout << std::endl;
+  PrintErrorDetails(std::cout, statistics);
+
+  const long injected = nan ? 3 : 2;
+  const long firstExpected = nan ? 1 * cols + 4 : 3 * cols + 1;
+  bool success = true;
+  const auto check = [&](const bool condition, std::string const &message) {
+    if (!condition) {
+      std::cerr << "Verifier check failed: " << message << std::endl;
+      success = false;
+    }
+  };
+  check(statistics.mismatches == injected - 1, "mismatch count");
+  check(statistics.firstMismatch == firstExpected, "first mismatch");
+  check(static_cast<long>(statistics.worst.size()) == injected,
+        "number of worst cells");
+  if (static_cast<long>(statistics.worst.size()) == injected) {
+    auto const &worst = statistics.worst;
+    check(!nan || (worst[0].row == 1 && worst[0].col == 4), "NaN ranked first");
+    check(worst[injected - 2].row == 3 && worst[injected - 2].col == 1,
+          "largest error ranked before smaller errors");
+    check(worst[injected - 1].row == 2 && worst[injected - 1].col == 2 &&
+              std::fabs(worst[injected - 1].error - DataEpsilon()) <
+                  DataEpsilon() / 2,
+          "error of one ulp");
+  }
+  check(statistics.ulpHistogram[0] ==
+            static_cast<long>(rows) * cols - injected,
+        "exact matches");
+  check(statistics.ulpHistogram[1] == 1, "cells within one ulp");
+  check(CompareResult(reference, result.data(), rows, cols, Tolerance(0))
+                .mismatches == injected,
+        "mismatches without tolerance");
+  check(CompareResult(reference, result.data(), rows, cols,
+                      Tolerance(0, 0, 1))
+                .mismatches == injected - 1,
+        "mismatches with a tolerance of one ulp");
+  check(CompareResult(reference, result.data(), rows, cols, Tolerance(0, 1))
+                .mismatches == injected - 2,
+        "mismatches with a relative tolerance");
+  if (!success) {
+    return 1;
+  }
+  std::cout << "Verifier reported every injected error." << std::endl;
+  return 0;
+}
+
+/// Collects the occupancy of every simulation stream, then searches for the
+/// smallest depth of every stream the dataflow completes with, and verifies
+/// the recommended depths jointly. Only the deadlock-free depth can be
+/// searched for, as the processes are not timed in simulation: whether a
+/// stream stalls its producer in hardware depends on latencies it cannot
+/// observe, which the high water mark and stall counts only hint at. Streams
+/// between the kernel and memory are not searched, and are recommended a full
+/// memory burst instead, which they need to sustain bursts in hardware.
+int RunDepths(int argc, char **argv) {
+
+  if (argc != 2 && argc != 6) {
+    std::cerr << "Usage: ./Testbench depths [<rows> <cols> <blocks> "
+                 "<timesteps>]"
+              << std::endl;
+    return 1;
+  }
+  if (!kStreamStatistics) {
+    std::cerr << "Stream depths can only be searched for when built with "
+                 "STENCIL_STREAM_STATISTICS."
+              << std::endl;
+    return 1;
+  }
+
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 2, dimensions)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+
+  // A depth of two lets producer and consumer overlap every cycle
+  constexpr size_t kMinimumDepth = 2;
+
+  // Streams that the memory interfaces read into or write from in bursts of
+  // one block row
+  const std::vector<std::string> burstStreams = {
+      "readBuffer",   "readBuffers",   "writeBuffer",
+      "writeBuffers", "readBuffer3D", "writeBuffer3D"};
+  const size_t burstDepth = BlockWidthMemory(cols, blocks);
+
+  // Periodic boundaries additionally exercise the barrier between passes
+  const auto input = VaryingInput(rows, cols);
+  const auto initial = PackBatch({input}, rows, cols);
+  const int d = kBoundaryDirichlet;
+  const int p = kBoundaryPeriodic;
+  std::vector<Boundary> boundaries = {
+      VaryingBoundary(rows, cols, BoundaryModes(d, d, d, d)),
+      VaryingBoundary(rows, cols, BoundaryModes(p, p, p, p))};
+  std::vector<HostBuffer_t> packed;
+  std::vector<std::vector<Data_t>> references;
+  for (auto const &boundary : boundaries) {
+    packed.emplace_back(PackBoundary(boundary, rows, cols));
+    references.emplace_back(
+        Reference(input, rows, cols, timesteps, boundary));
+  }
+  const long offset =
+      (TimeFolded(timesteps) % 2 == 0) ? 0 : TotalElementsMemory(rows, cols);
+
+  // Runs both kernels with every boundary using the stream depths given, and
+  // returns the deadlock report and the streams the processes are blocked on
+  // if they deadlock
+  std::vector<std::string> blocked;
+  const auto deadlocks = [&](std::map<std::string, size_t> const &depths,
+                             std::string &report) {
+    SetStreamDepths(depths);
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+      auto memory = initial;
+      auto memoryBanks = SplitBanks(memory, rows, cols);
+      std::vector<Residual_t> residual(TimeFolded(timesteps));
+      std::vector<Counter_t> counters(kCounterEntries);
+      Memory_t *banks[kDimms];
+      for (int k = 0; k < kDimms; ++k) {
+        banks[k] = memoryBanks[k].data();
+      }
+      try {
+        Jacobi(memory.data(), memory.data(), residual.data(),
+               STENCIL_COUNTERS(counters.data(),) packed[i].data(),
+               boundaries[i].modes, 1, rows, cols, blocks, timesteps);
+        JacobiBanks(STENCIL_BANK_ARGUMENTS(banks, banks), residual.data(),
+                    STENCIL_COUNTERS(counters.data(),) packed[i].data(),
+                    boundaries[i].modes, 1, rows, cols, blocks, timesteps);
+      } catch (DataflowDeadlock const &err) {
+        report = err.what();
+        blocked = err.Streams();
+        return true;
+      }
+      const auto merged = MergeBanks(memoryBanks, rows, cols);
+      if (CompareResult(references[i], memory.data() + offset, rows, cols,
+                        DefaultTolerance())
+                  .mismatches != 0 ||
+          CompareResult(references[i], merged.data() + offset, rows, cols,
+                        DefaultTolerance())
+                  .mismatches != 0) {
+        throw std::runtime_error("Wrong result with stream depths capped.");
+      }
+    }
+    return false;
+  };
+
+  std::map<std::string, size_t> recommended;
+  std::vector<StreamStatistics> statistics;
+  try {
+
+    std::cout << "Collecting stream statistics..." << std::flush;
+    std::string report;
+    ResetStreamStatistics();
+    if (deadlocks({}, report)) {
+      std::cerr << report << std::endl;
+      return 1;
+    }
+    statistics = CollectStreamStatistics();
+    std::cout << " Done." << std::endl;
+
+    // The search assumes that a stream never deadlocks at a larger depth if
+    // it completes at a smaller one
+    std::map<std::string, size_t> depths;
+    for (auto const &s : statistics) {
+      if (s.pushes == 0) {
+        continue;
+      }
+      depths[s.name] = s.depth;
+      if (std::find(burstStreams.begin(), burstStreams.end(), s.name) !=
+          burstStreams.end()) {
+        recommended[s.name] = std::min(burstDepth, s.depth);
+        std::cout << "Keeping a full burst of " << s.name << ": "
+                  << recommended[s.name] << "." << std::endl;
+        continue;
+      }
+      std::cout << "Searching for the smallest depth of " << s.name << "..."
+                << std::flush;
+      size_t low = 1;
+      size_t high = s.depth;
+      while (low < high) {
+        const size_t mid = (low + high) / 2;
+        if (deadlocks({{s.name, mid}}, report)) {
+          low = mid + 1;
+        } else {
+          high = mid;
+        }
+      }
+      std::cout << " " << high << "." << std::endl;
+      recommended[s.name] = std::min(std::max(high, kMinimumDepth), s.depth);
+    }
+
+    // Streams that are deep enough on their own can deadlock jointly, in
+    // which case the streams the processes are blocked on are deepened
+    std::cout << "Verifying the recommended depths jointly..." << std::flush;
+    while (deadlocks(recommended, report)) {
+      const auto deepen = [&](std::string const &name) {
+        auto &depth = recommended[name];
+        const bool shallower = depth < depths[name];
+        depth = std::min(2 * depth, depths[name]);
+        return shallower;
+      };
+      bool deepened = false;
+      for (auto const &name : blocked) {
+        if (recommended.count(name) > 0) {
+          deepened = deepen(name) || deepened;
+        }
+      }
+      // Otherwise, the stream that is full is not among those reported
+      if (!deepened) {
+        for (auto const &r : recommended) {
+          deepened = deepen(r.first) || deepened;
+        }
+      }
+      if (!deepened) {
+        throw std::runtime_error(report);
+      }
+    }
+    std::cout << " Done." << std::endl;
+
+  } catch (std::runtime_error const &err) {
+    SetStreamDepths({});
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  SetStreamDepths({});
+
+  std::cout << "\n";
+  PrintStreamStatistics(std::cout, statistics, recommended);
+  return 0;
+}
+
+/// Streams a sequence of values between two threads through a shallow
+/// stream, mixing batches smaller and larger than the stream with single
+/// pushes and pops, and verifies that every value arrives once and in order.
+int RunStreams(int argc, char **) {
+
+  if (argc != 2) {
+    std::cerr << "Usage: ./Testbench streams" << std::endl;
+    return 1;
+  }
+
+  constexpr int kValues = 1 << 16;
+  constexpr int kBatchMax = 40;
+  Stream_t<int, 16> stream("batches");
+
+  std::cout << "Streaming " << kValues << " values in batches..."
+            << std::flush;
+  std::thread producer([&stream]() {
+    std::vector<int> batch(kBatchMax);
+    for (int i = 0, b = 0; i < kValues; ++b) {
+      const int n = std::min(1 + (b * 7) % kBatchMax, kValues - i);
+      if (b % 5 == 0) {
+        stream.Push(i++);
+        continue;
+      }
+      for (int j = 0; j < n; ++j) {
+        batch[j] = i + j;
+      }
+      PushN(stream, batch.data(), n);
+      i += n;
+    }
+  });
+  std::vector<int> received;
+  received.reserve(kValues);
+  std::vector<int> batch(kBatchMax);
+  for (int b = 0; static_cast<int>(received.size()) < kValues; ++b) {
+    const int n = std::min<int>(1 + (b * 11) % kBatchMax,
+                                kValues - received.size());
+    if (b % 3 == 0) {
+      received.emplace_back(stream.Pop());
+      continue;
+    }
+    PopN(stream, batch.data(), n);
+    received.insert(received.end(), batch.begin(), batch.begin() + n);
+  }
+  producer.join();
+
+  for (int i = 0; i < kValues; ++i) {
+    if (received[i] != i) {
+      std::cerr << "\nValue " << i << " arrived as " << received[i] << "."
+                << std::endl;
+      return 1;
+    }
+  }
+  if (!stream.IsEmpty()) {
+    std::cerr << "\nThe stream holds values that were never popped."
+              << std::endl;
+    return 1;
+  }
   std::cout << " Done." << std::endl;
+  return 0;
+}
 
-  std::cout << "Reassembling memory..." << std::flush;
-  for (int rIn = 0, rOut = 0; rOut < kRows; ++rIn, rOut += 2) {
-    static constexpr auto kMemoryCols = kCols / kMemoryWidth;
-    const auto iStart = rIn * kMemoryCols;
-    std::copy(memorySplit0.begin() + iStart,
-              memorySplit0.begin() + iStart + kMemoryCols,
-              memorySplit.begin() + rOut * kMemoryCols);
-    std::copy(memorySplit1.begin() + iStart,
-              memorySplit1.begin() + iStart + kMemoryCols,
-              memorySplit.begin() + (rOut + 1) * kMemoryCols);
+/// Allocates and frees blocks of mixed and ever-growing sizes from an arena
+/// with a small bound on its free blocks, and verifies that the memory it
+/// holds stays within the bound plus the blocks in use, while blocks of a
+/// recurring size are still reused.
+int RunArena(int argc, char **) {
+
+  if (argc != 2) {
+    std::cerr << "Usage: ./Testbench arena" << std::endl;
+    return 1;
+  }
+
+  constexpr size_t kFreeBytesMax = 64 * kHostAlignment;
+  constexpr int kLive = 4;
+  constexpr int kAllocations = 1024;
+  HostArena arena(false, kFreeBytesMax);
+
+  std::cout << "Allocating " << kAllocations << " blocks of mixed sizes..."
+            << std::flush;
+  std::vector<std::pair<void *, size_t>> live;
+  size_t liveBytes = 0;
+  for (int i = 0; i < kAllocations; ++i) {
+    // Every other block grows with the iteration, such that the free blocks
+    // it leaves behind are too small for any later allocation of its kind,
+    // while the others cycle through a few small sizes
+    const size_t bytes =
+        (i % 2 == 0) ? (i + 1) * kHostAlignment
+                     : (1 + (i * 7) % 5) * kHostAlignment - 3 * (i % 3);
+    live.emplace_back(arena.Allocate(bytes), bytes);
+    liveBytes += bytes;
+    if (live.size() > kLive) {
+      arena.Deallocate(live.front().first);
+      liveBytes -= live.front().second;
+      live.erase(live.begin());
+    }
+    // Blocks are rounded up to the alignment, so each block in use holds
+    // less than one alignment more than was requested
+    const size_t bound = kFreeBytesMax + liveBytes + kLive * kHostAlignment;
+    if (arena.BytesFree() > kFreeBytesMax || arena.BytesReserved() > bound) {
+      std::cerr << "\nArena holds " << arena.BytesReserved() << " bytes with "
+                << arena.BytesFree() << " bytes free after " << i + 1
+                << " allocations, but at most " << bound << " bytes with "
+                << kFreeBytesMax << " bytes free are allowed." << std::endl;
+      return 1;
+    }
+  }
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Reusing a freed block..." << std::flush;
+  void *const block = arena.Allocate(kHostAlignment);
+  const size_t reserved = arena.BytesReserved();
+  arena.Deallocate(block);
+  void *const reused = arena.Allocate(kHostAlignment);
+  if (arena.BytesReserved() != reserved) {
+    std::cerr << "\nA freed block of the same size was not reused."
+              << std::endl;
+    return 1;
+  }
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Freeing a block twice..." << std::flush;
+  arena.Deallocate(reused);
+  try {
+    arena.Deallocate(reused);
+    std::cerr << "\nFreeing a block that is not in use was not detected."
+              << std::endl;
+    return 1;
+  } catch (std::invalid_argument const &) {
   }
   std::cout << " Done." << std::endl;
 
+  arena.Trim();
+  if (arena.BytesFree() != 0) {
+    std::cerr << "Trimming the arena left " << arena.BytesFree()
+              << " bytes free." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+
+  if (argc > 1 && std::string(argv[1]) == "3d") {
+    return RunThreeDimensional(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "concurrent") {
+    return RunConcurrent(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "boundary") {
+    return RunBoundary(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "outofcore") {
+    return RunStrips(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "batch") {
+    return RunBatch(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "verifier") {
+    return RunVerifier(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "depths") {
+    return RunDepths(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "arena") {
+    return RunArena(argc, argv);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "streams") {
+    return RunStreams(argc, argv);
+  }
+
+  if (argc != 1 && argc != 5) {
+    std::cerr << "Usage: ./Testbench [<rows> <cols> <blocks> <timesteps>]\n"
+                 "       ./Testbench 3d [<planes> <rows> <cols> <row blocks> "
+                 "<blocks> <timesteps>]\n"
+                 "       ./Testbench concurrent <instances> [<rows> <cols> "
+                 "<blocks> <timesteps>]\n"
+                 "       ./Testbench boundary [<rows> <cols> <blocks> "
+                 "<timesteps>]\n"
+                 "       ./Testbench outofcore <strip rows> [<rows> <cols> "
+                 "<blocks> <timesteps>]\n"
+                 "       ./Testbench batch <grids> [<rows> <cols> <blocks> "
+                 "<timesteps>]\n"
+                 "       ./Testbench verifier [<rows> <cols>]\n"
+                 "       ./Testbench depths [<rows> <cols> <blocks> "
+                 "<timesteps>]\n"
+                 "       ./Testbench arena\n"
+                 "       ./Testbench streams"
+              << std::endl;
+    return 1;
+  }
+
+  Dimensions dimensions;
+  if (!ParseDimensions(argc, argv, 1, dimensions)) {
+    return 1;
+  }
+  const int rows = dimensions.rows;
+  const int cols = dimensions.cols;
+  const int blocks = dimensions.blocks;
+  const int timesteps = dimensions.timesteps;
+  const long totalElementsMemory = TotalElementsMemory(rows, cols);
+  const long cells = static_cast<long>(rows) * cols * timesteps;
+
+  std::cout << "Running reference implementation..." << std::flush;
+  const auto reference = Reference(
+      std::vector<Data_t>(static_cast<long>(rows) * cols, 0), rows, cols,
+      timesteps);
+  const auto referencePrevious = Reference(
+      std::vector<Data_t>(static_cast<long>(rows) * cols, 0), rows, cols,
+      timesteps - 1);
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Initializing memory..." << std::flush;
+  HostBuffer_t memory(2 * totalElementsMemory,
+                      Kernel_t(Data_t(static_cast<Data_t>(0))));
+  auto memoryBanks = SplitBanks(memory, rows, cols);
+  std::vector<Residual_t> residual(TimeFolded(timesteps));
+  std::vector<Residual_t> residualSplit(TimeFolded(timesteps));
+  std::vector<Counter_t> counters(kCounterEntries);
+  std::vector<Counter_t> countersSplit(kCounterEntries);
+  const auto boundary = PackBoundary(MakeBoundary(rows, cols), rows, cols);
+  std::cout << " Done." << std::endl;
+
+  std::cout << "Running single memory implementation..." << std::flush;
+  RunTimed(
+      [&]() {
+        Jacobi(memory.data(), memory.data(), residual.data(),
+               STENCIL_COUNTERS(counters.data(),) boundary.data(),
+               kBoundaryModesDirichlet, 1, rows, cols, blocks, timesteps);
+      },
+      cells);
+
+  std::cout << "Running " << kDimms << "-bank memory implementation..."
+            << std::flush;
+  Memory_t *banks[kDimms];
+  for (int k = 0; k < kDimms; ++k) {
+    banks[k] = memoryBanks[k].data();
+  }
+  RunTimed(
+      [&]() {
+        JacobiBanks(STENCIL_BANK_ARGUMENTS(banks, banks), residualSplit.data(),
+                    STENCIL_COUNTERS(countersSplit.data(),) boundary.data(),
+                    kBoundaryModesDirichlet, 1, rows, cols, blocks,
+                    timesteps);
+      },
+      cells);
+
+  std::cout << "Reassembling memory..." << std::flush;
+  // Reassemble both halves of the ping-pong buffer, as the result resides in
+  // the second half for an odd number of folded timesteps
+  const auto memorySplit = MergeBanks(memoryBanks, rows, cols);
+  std::cout << " Done." << std::endl;
+
   std::cout << "Verifying single memory..." << std::flush;
-  if (!Verify(reference, memory)) {
+  if (!Verify(reference, memory, rows, cols, timesteps)) {
     return 1;
   }
   std::cout << " Done." << std::endl;
 
-  std::cout << "Verifying dual memory..." << std::flush;
-  if (!Verify(reference, memorySplit)) {
+  std::cout << "Verifying " << kDimms << "-bank memory..." << std::flush;
+  if (!Verify(reference, memorySplit, rows, cols, timesteps)) {
     return 1; 
   }
   std::cout << " Done." << std::endl;
+
+  std::cout << "Verifying residuals..." << std::flush;
+  if (!VerifyResidual(reference, referencePrevious, residual) ||
+      !VerifyResidual(reference, referencePrevious, residualSplit)) {
+    return 1;
+  }
+  std::cout << " Done." << std::endl;
+
+  if (kCounters) {
+    std::cout << "Verifying counters..." << std::flush;
+    if (!VerifyCounters(counters, 1, rows, cols, blocks, timesteps) ||
+        !VerifyCounters(countersSplit, kDimms, rows, cols, blocks,
+                        timesteps)) {
+      return 1;
+    }
+    std::cout << " Done (" << counters[kCounterCycles] << " / "
+              << countersSplit[kCounterCycles] << " cycles, "
+              << CyclesRequired(rows, cols, blocks, timesteps)
+              << " predicted)." << std::endl;
+  }
   
   return 0;
 }
@@ -0,0 +1,178 @@
+/// @author    Johannes de Fine Licht (definelicht@inf.ethz.ch)
+/// @copyright This software is copyrighted under the BSD 3-Clause License. 
+
+#include "Trace.h"
+#include "Json.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct Span {
+  std::string name;
+  char const *category;
+  int track;
+  long begin;
+  long end;
+};
+
+/// Spans of a single thread. The lock is only contended while the trace is
+/// being written.
+struct SpanBuffer {
+  std::mutex mutex;
+  std::vector<Span> spans;
+};
+
+const auto kTraceEpoch = std::chrono::steady_clock::now();
+
+std::mutex &TraceMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+/// Names of all tracks, indexed by track
+std::vector<std::string> &Tracks() {
+  static std::vector<std::string> tracks;
+  return tracks;
+}
+
+/// Buffers of all threads, which outlive the threads they belong to
+std::vector<std::shared_ptr<SpanBuffer>> &Buffers() {
+  static std::vector<std::shared_ptr<SpanBuffer>> buffers;
+  return buffers;
+}
+
+// Track spans are currently recorded on, and the track of the calling thread
+// itself, or -1 until first used
+thread_local int currentTrack = -1;
+thread_local int threadTrack = -1;
+
+int ThreadTrack() {
+  if (threadTrack < 0) {
+    threadTrack = MakeTraceTrack("thread");
+  }
+  return threadTrack;
+}
+
+SpanBuffer &ThreadBuffer() {
+  thread_local std::shared_ptr<SpanBuffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<SpanBuffer>();
+    std::lock_guard<std::mutex> lock(TraceMutex());
+    Buffers().emplace_back(buffer);
+  }
+  return *buffer;
+}
+
+/// Chrome traces count in microseconds, so print nanoseconds as fractions
+void WriteMicroseconds(std::ostream &stream, const long nanoseconds) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%ld.%03ld", nanoseconds / 1000,
+                nanoseconds % 1000);
+  stream << buffer;
+}
+
+} // End anonymous namespace
+
+long TraceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - kTraceEpoch)
+      .count();
+}
+
+int MakeTraceTrack(std::string const &name) {
+  std::lock_guard<std::mutex> lock(TraceMutex());
+  Tracks().emplace_back(name);
+  return Tracks().size() - 1;
+}
+
+int TraceTrack() {
+  if (currentTrack < 0) {
+    currentTrack = ThreadTrack();
+  }
+  return currentTrack;
+}
+
+int SetTraceTrack(const int track) {
+  const int previous = TraceTrack();
+  currentTrack = track;
+  return previous;
+}
+
+void NameTraceThread(std::string const &name) {
+  const int track = ThreadTrack();
+  std::lock_guard<std::mutex> lock(TraceMutex());
+  Tracks()[track] = name;
+}
+
+void RecordTraceSpan(std::string const &name, char const *category,
+                     const int track, const long begin, const long end) {
+  auto &buffer = ThreadBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.spans.emplace_back(Span{name, category, track, begin, end});
+}
+
+void WriteTrace(std::string const &path) {
+  std::ofstream file(path);
+  if (!file) {
+    throw std::runtime_error("Failed to open trace file \"" + path + "\".");
+  }
+  std::lock_guard<std::mutex> lock(TraceMutex());
+  file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+  bool first = true;
+  auto const &tracks = Tracks();
+  for (size_t t = 0; t < tracks.size(); ++t) {
+    file << (first ? "" : ",\n")
+         << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": "
+         << t << ", \"args\": {\"name\": ";
+    WriteJsonString(file, tracks[t]);
+    file << "}},\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", "
+            "\"pid\": 0, \"tid\": "
+         << t << ", \"args\": {\"sort_index\": " << t << "}}";
+    first = false;
+  }
+  for (auto const &buffer : Buffers()) {
+    // Other threads may still be recording, so copy their spans under the
+    // lock of the buffer and write the copy without holding it
+    std::vector<Span> spans;
+    {
+      std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+      spans = buffer->spans;
+    }
+    for (auto const &span : spans) {
+      file << (first ? "" : ",\n") << "{\"name\": ";
+      WriteJsonString(file, span.name);
+      file << ", \"cat\": \"" << span.category
+           << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << span.track
+           << ", \"ts\": ";
+      WriteMicroseconds(file, span.begin);
+      file << ", \"dur\": ";
+      WriteMicroseconds(file, span.end - span.begin);
+      file << "}";
+      first = false;
+    }
+  }
+  file << "\n]}\n";
+  if (!file) {
+    throw std::runtime_error("Failed to write trace file \"" + path + "\".");
+  }
+}
+
+TraceWriter::~TraceWriter() {
+  if (!kTrace) {
+    return;
+  }
+  try {
+    WriteTrace(path_);
+    std::cout << "Wrote trace to " << path_ << "." << std::endl;
+  } catch (std::runtime_error const &err) {
+    std::cerr << err.what() << std::endl;
+  }
+}